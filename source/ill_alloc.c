@@ -5,6 +5,7 @@
 #include "include/jmem/ill_alloc.h"
 #include <assert.h>
 #include <string.h>
+#include <stdlib.h>
 #ifndef _WIN32
 #include <sys/mman.h>
 #include <unistd.h>
@@ -13,15 +14,26 @@
 #else
 #include <windows.h>
 #endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 typedef struct mem_chunk_struct mem_chunk;
 struct mem_chunk_struct
 {
 #ifdef JMEM_ALLOC_TRACKING
-    uint_fast64_t size:48;
+    uint_fast64_t size:47;
     uint_fast64_t idx:13;
 #else
-    uint_fast64_t size:63;
+    uint_fast64_t size:60;
 #endif
+    uint_fast64_t mapped:1;
+    uint_fast64_t oversized:1;
+    uint_fast64_t prev_used:1;
     uint_fast64_t used:1;
     mem_chunk* next;
     mem_chunk* prev;
@@ -29,16 +41,54 @@ struct mem_chunk_struct
 #if __STDC_VERSION__ == 201112L
 static_assert(offsetof(mem_chunk, next) == 8);
 #endif
+//  Free chunks also end with a boundary tag holding their size, which lets the chunk physically following them find
+//  them in constant time when its prev_used bit is not set. Chunks must therefore have room for the tag.
+enum {MIN_CHUNK_SIZE = sizeof(mem_chunk) + sizeof(uint_fast64_t)};
+
+//  Free chunks of each pool are kept in a two-level segregated fit index (TLSF). The first level splits sizes by
+//  powers of two, the second level splits each power of two range linearly into SL_INDEX_COUNT bins. Bitmaps of
+//  non-empty bins allow finding a fitting bin with a couple of bit scans, instead of walking a list of chunks.
+enum
+{
+    ALIGN_SIZE_LOG2 = 3,
+    ALIGN_SIZE = (1 << ALIGN_SIZE_LOG2),
+    SL_INDEX_LOG2 = 4,
+    SL_INDEX_COUNT = (1 << SL_INDEX_LOG2),
+    FL_INDEX_SHIFT = (SL_INDEX_LOG2 + ALIGN_SIZE_LOG2),
+    SMALL_BLOCK_SIZE = (1 << FL_INDEX_SHIFT),
+    FL_INDEX_COUNT = (64 - FL_INDEX_SHIFT + 1),
+};
+
 typedef struct mem_pool_struct mem_pool;
+//  Pool control block, which is placed at the very beginning of the pool's memory, followed by its free chunk bins
+//  and then by the chunks themselves
 struct mem_pool_struct
 {
     uint_fast64_t size;
     uint_fast64_t free;
     uint_fast64_t used;
-    mem_chunk* largest;
-    mem_chunk* smallest;
+    uint_fast64_t fl_bitmap;
+    uint_fast32_t fl_count;
+    uint_fast32_t index;
+    //  Value of the allocator's free counter when the pool last became empty
+    uint_fast64_t empty_since;
+    uint32_t sl_bitmap[FL_INDEX_COUNT];
     void* base;
+    mem_chunk* bins[];
+};
+
+typedef struct mapped_block_struct mapped_block;
+//  Blocks above the allocator's mmap threshold get a mapping of their own, which starts with this header. Its chunk is
+//  marked as mapped and its size covers everything after the header, so that the memory of the block is aligned to
+//  MAPPED_BLOCK_ALIGNMENT.
+struct mapped_block_struct
+{
+    mapped_block* next;
+    mapped_block* prev;
+    uint_fast64_t mapping_size;
+    mem_chunk chunk;
 };
+enum {MAPPED_BLOCK_ALIGNMENT = offsetof(mapped_block, chunk) + offsetof(mem_chunk, next)};
 
 /**
  * @brief Opaque structure to store the state of allocator. Not thread safe.
@@ -50,6 +100,7 @@ struct ill_allocator_struct
     uint_fast64_t pool_size;
     uint_fast64_t capacity;
     uint_fast64_t count;
+    uint_fast32_t flags;
 #ifdef JMEM_ALLOC_TRACKING
     uint_fast64_t allocator_index;
     uint_fast64_t total_allocated;
@@ -63,8 +114,28 @@ struct ill_allocator_struct
     void(* trap_callbacks[JMEM_ALLOC_TRAP_COUNT])(uint32_t idx, void* param);
     void* trap_params[JMEM_ALLOC_TRAP_COUNT];
 #endif
-    mem_pool* pools;
+    mem_pool** pools;
     uint_fast64_t pool_buffer_size;
+    //  One past the index of the largest non-empty bin of each pool, or zero if a pool has no free chunks. These are
+    //  kept in one dense array, so that a pool which can fit an allocation is found without touching the pools.
+    uint16_t* pool_classes;
+    uint_fast64_t class_buffer_size;
+    //  Pools larger than pool_size, sorted by address. Only used with ILL_ALLOCATOR_ALIGNED_POOLS, since pointers to
+    //  these can not be masked to find their pool.
+    mem_pool** oversized_pools;
+    uint_fast64_t oversized_count;
+    uint_fast64_t oversized_capacity;
+    uint_fast64_t oversized_buffer_size;
+    //  Blocks with their own mappings, which are not part of any pool
+    mapped_block* mapped_blocks;
+    uint_fast64_t mmap_threshold;
+    //  Trimming policy: number of empty pools of the default size to keep, and the number of frees a pool must have
+    //  been empty for before it is released automatically
+    uint_fast64_t free_count;
+    uint_fast64_t spare_pools;
+    uint_fast64_t trim_delay;
+    uint_fast64_t next_trim;
+    int auto_trim;
 
     void (* bad_alloc_callback)(ill_allocator* allocator, void* param);
     void* bad_alloc_param;
@@ -75,6 +146,9 @@ struct ill_allocator_struct
 
 static uint_fast64_t PAGE_SIZE = 0;
 
+//  Size of huge pages used with ILL_ALLOCATOR_HUGE_PAGES
+enum {HUGE_PAGE_SIZE = 1 << 21};
+
 static const char* const ILL_ALLOCATOR_TYPE_STRING = "Implicit linked list allocator";
 
 static inline uint_fast64_t round_to_nearest_page_up(uint_fast64_t v)
@@ -87,27 +161,473 @@ static inline uint_fast64_t round_to_nearest_page_up(uint_fast64_t v)
     return v;
 }
 
+static inline uint_fast32_t bit_scan_forward(uint_fast64_t v)
+{
+    assert(v);
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward64(&idx, v);
+    return idx;
+#else
+    return __builtin_ctzll(v);
+#endif
+}
 
-void ill_allocator_destroy(ill_allocator* allocator)
+static inline uint_fast32_t bit_scan_reverse(uint_fast64_t v)
 {
-    ill_allocator* this = (ill_allocator*)allocator;
-    for (uint_fast32_t i = 0; i < this->count; ++i)
+    assert(v);
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanReverse64(&idx, v);
+    return idx;
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+static inline void mapping_insert(uint_fast64_t size, uint_fast32_t* p_fl, uint_fast32_t* p_sl)
+{
+    if (size < SMALL_BLOCK_SIZE)
+    {
+        //  Small chunks are split linearly into the first level
+        *p_fl = 0;
+        *p_sl = size >> ALIGN_SIZE_LOG2;
+    }
+    else
+    {
+        const uint_fast32_t msb = bit_scan_reverse(size);
+        *p_sl = (size >> (msb - SL_INDEX_LOG2)) ^ SL_INDEX_COUNT;
+        *p_fl = msb - (FL_INDEX_SHIFT - 1);
+    }
+}
+
+static inline void mapping_search(uint_fast64_t size, uint_fast32_t* p_fl, uint_fast32_t* p_sl)
+{
+    //  Round the size up to the next bin, so that any chunk in the bin found is large enough
+    if (size >= SMALL_BLOCK_SIZE)
+    {
+        size += (1llu << (bit_scan_reverse(size) - SL_INDEX_LOG2)) - 1;
+    }
+    mapping_insert(size, p_fl, p_sl);
+}
+
+static inline uint_fast32_t pool_fl_count(uint_fast64_t pool_size)
+{
+    //  No chunk can be larger than the pool itself, which bounds the number of first level bins it needs
+    uint_fast32_t fl, sl;
+    mapping_insert(pool_size, &fl, &sl);
+    return fl + 1;
+}
+
+static inline uint_fast64_t pool_header_size(uint_fast64_t pool_size)
+{
+    const uint_fast64_t size = sizeof(mem_pool) + pool_fl_count(pool_size) * SL_INDEX_COUNT * sizeof(mem_chunk*);
+    return (size + 7) & ~(uint_fast64_t)7;
+}
+
+static inline mem_chunk* next_chunk(const mem_pool* pool, const mem_chunk* chunk)
+{
+    const uintptr_t next = (uintptr_t)chunk + chunk->size;
+    return next < (uintptr_t)pool + pool->size ? (mem_chunk*)next : NULL;
+}
+
+static inline mem_chunk* previous_free_chunk(const mem_chunk* chunk)
+{
+    assert(!chunk->prev_used);
+    const uint_fast64_t prev_size = *(const uint_fast64_t*)((uintptr_t)chunk - sizeof(uint_fast64_t));
+    return (mem_chunk*)((uintptr_t)chunk - prev_size);
+}
+
+static inline void mark_chunk_used(const mem_pool* pool, mem_chunk* chunk)
+{
+    chunk->used = 1;
+    mem_chunk* const next = next_chunk(pool, chunk);
+    if (next)
+    {
+        next->prev_used = 1;
+    }
+}
+
+static inline void update_pool_class(ill_allocator* allocator, const mem_pool* pool)
+{
+    uint16_t class = 0;
+    if (pool->fl_bitmap)
+    {
+        const uint_fast32_t fl = bit_scan_reverse(pool->fl_bitmap);
+        const uint_fast32_t sl = bit_scan_reverse(pool->sl_bitmap[fl]);
+        class = fl * SL_INDEX_COUNT + sl + 1;
+    }
+    allocator->pool_classes[pool->index] = class;
+}
+
+static inline void insert_chunk_into_bins(ill_allocator* allocator, mem_pool* pool, mem_chunk* chunk)
+{
+    assert(chunk->used == 0);
+    //  Write the boundary tag and let the following chunk know this one is free
+    *(uint_fast64_t*)((uintptr_t)chunk + chunk->size - sizeof(uint_fast64_t)) = chunk->size;
+    mem_chunk* const next = next_chunk(pool, chunk);
+    if (next)
+    {
+        assert(next->used);
+        next->prev_used = 0;
+    }
+    uint_fast32_t fl, sl;
+    mapping_insert(chunk->size, &fl, &sl);
+    assert(fl < pool->fl_count);
+    mem_chunk** const p_head = pool->bins + fl * SL_INDEX_COUNT + sl;
+    chunk->prev = NULL;
+    chunk->next = *p_head;
+    if (*p_head)
+    {
+        (*p_head)->prev = chunk;
+    }
+    *p_head = chunk;
+    pool->fl_bitmap |= (uint_fast64_t)1 << fl;
+    pool->sl_bitmap[fl] |= (uint32_t)1 << sl;
+    pool->free += chunk->size;
+    pool->used -= chunk->size;
+    update_pool_class(allocator, pool);
+}
+
+static inline void remove_chunk_from_pool(ill_allocator* allocator, mem_pool* pool, mem_chunk* chunk)
+{
+    uint_fast32_t fl, sl;
+    mapping_insert(chunk->size, &fl, &sl);
+    mem_chunk** const p_head = pool->bins + fl * SL_INDEX_COUNT + sl;
+    if (chunk->next)
+    {
+        assert(chunk->next->prev == chunk);
+        (chunk->next)->prev = chunk->prev;
+    }
+    if (chunk->prev)
+    {
+        assert(chunk->prev->next == chunk);
+        (chunk->prev)->next = chunk->next;
+    }
+    else
+    {
+        assert(*p_head == chunk);
+        *p_head = chunk->next;
+        //  Check if the bin is now empty
+        if (!*p_head)
+        {
+            pool->sl_bitmap[fl] &= ~((uint32_t)1 << sl);
+            if (!pool->sl_bitmap[fl])
+            {
+                pool->fl_bitmap &= ~((uint_fast64_t)1 << fl);
+            }
+            update_pool_class(allocator, pool);
+        }
+    }
+    pool->free -= chunk->size;
+    pool->used += chunk->size;
+}
+
+static inline void insert_chunk_into_pool(ill_allocator* allocator, mem_pool* pool, mem_chunk* chunk)
+{
+    assert(chunk->used == 0);
+    //  Check if the chunk directly following is free
+    mem_chunk* const next = next_chunk(pool, chunk);
+    if (next && next->used == 0)
+    {
+        //  Pull it from the pool and merge chunk with it
+        remove_chunk_from_pool(allocator, pool, next);
+        chunk->size += next->size;
+    }
+
+    //  Check if the chunk directly preceding is free
+    if (!chunk->prev_used)
+    {
+        //  Pull it from the pool and merge it with chunk
+        mem_chunk* const prev = previous_free_chunk(chunk);
+        assert(prev->used == 0 && prev->prev_used);
+        remove_chunk_from_pool(allocator, pool, prev);
+        prev->size += chunk->size;
+        chunk = prev;
+    }
+
+    insert_chunk_into_bins(allocator, pool, chunk);
+}
+
+static inline mem_chunk* find_good_fit_chunk(const mem_pool* pool, uint_fast64_t size)
+{
+    //  Search from the bin after the one size would be put in, since all chunks there are guaranteed to be large enough
+    uint_fast32_t fl, sl;
+    mapping_search(size, &fl, &sl);
+    if (fl >= pool->fl_count)
+    {
+        return NULL;
+    }
+    uint_fast32_t sl_map = pool->sl_bitmap[fl] & (~(uint32_t)0 << sl);
+    if (!sl_map)
+    {
+        //  No bins in this first level, so move to the first larger non-empty one
+        const uint_fast64_t fl_map = pool->fl_bitmap & (~(uint_fast64_t)0 << (fl + 1));
+        if (!fl_map)
+        {
+            return NULL;
+        }
+        fl = bit_scan_forward(fl_map);
+        sl_map = pool->sl_bitmap[fl];
+        assert(sl_map);
+    }
+    sl = bit_scan_forward(sl_map);
+    assert(pool->bins[fl * SL_INDEX_COUNT + sl]);
+    return pool->bins[fl * SL_INDEX_COUNT + sl];
+}
+
+static inline mem_chunk* find_exact_fit_chunk(const mem_pool* pool, uint_fast64_t size)
+{
+    //  Chunks which fit, but were skipped by find_good_fit_chunk, can only be in the bin size itself would be put in
+    uint_fast32_t fl, sl;
+    mapping_insert(size, &fl, &sl);
+    if (fl >= pool->fl_count)
+    {
+        return NULL;
+    }
+    for (mem_chunk* current = pool->bins[fl * SL_INDEX_COUNT + sl]; current; current = current->next)
+    {
+        if (current->size >= size)
+        {
+            return current;
+        }
+    }
+    return NULL;
+}
+
+#ifndef _WIN32
+static void* map_aligned_memory(uint_fast64_t size, uint_fast64_t alignment, int mmap_flags, uint_fast64_t granularity)
+{
+    if (alignment <= granularity)
+    {
+        void* const ptr = mmap(NULL, size, PROT_READ|PROT_WRITE, mmap_flags, -1, 0);
+        return ptr != MAP_FAILED ? ptr : NULL;
+    }
+    //  Map enough memory to be sure it contains an aligned block, then unmap what is left over on either side
+    const uint_fast64_t mapped_size = size + alignment - granularity;
+    void* const ptr = mmap(NULL, mapped_size, PROT_READ|PROT_WRITE, mmap_flags, -1, 0);
+    if (ptr == MAP_FAILED)
+    {
+        return NULL;
+    }
+    const uintptr_t aligned = ((uintptr_t)ptr + alignment - 1) & ~(alignment - 1);
+    if (aligned != (uintptr_t)ptr)
     {
+        munmap(ptr, aligned - (uintptr_t)ptr);
+    }
+    if (aligned + size != (uintptr_t)ptr + mapped_size)
+    {
+        munmap((void*)(aligned + size), (uintptr_t)ptr + mapped_size - (aligned + size));
+    }
+    return (void*)aligned;
+}
+#endif
+
+static void* map_memory(uint_fast64_t size, uint_fast64_t alignment, int huge_pages)
+{
+    assert((size & (PAGE_SIZE - 1)) == 0);
 #ifndef _WIN32
-        munmap(this->pools[i].base, this->pool_size);
+    if (!huge_pages)
+    {
+        return map_aligned_memory(size, alignment, MAP_ANONYMOUS|MAP_PRIVATE, PAGE_SIZE);
+    }
+    //  Huge pages only help if the mapping is aligned to them, which explicit huge pages always are
+    assert((size & (HUGE_PAGE_SIZE - 1)) == 0);
+    if (alignment < HUGE_PAGE_SIZE)
+    {
+        alignment = HUGE_PAGE_SIZE;
+    }
+    void* ptr = map_aligned_memory(size, alignment, MAP_ANONYMOUS|MAP_PRIVATE|MAP_HUGETLB, HUGE_PAGE_SIZE);
+    if (ptr)
+    {
+        return ptr;
+    }
+    //  No explicit huge pages are available, so ask for transparent ones instead
+    ptr = map_aligned_memory(size, alignment, MAP_ANONYMOUS|MAP_PRIVATE, PAGE_SIZE);
+    if (ptr)
+    {
+        madvise(ptr, size, MADV_HUGEPAGE);
+    }
+    return ptr;
 #else
-        BOOL res = VirtualFree(allocator->pools[i].base, 0, MEM_RELEASE);
-        assert(res != 0);
+    //  Large pages need special privileges on Windows, so huge_pages is ignored
+    (void)huge_pages;
+    if (alignment <= PAGE_SIZE)
+    {
+        return VirtualAlloc(NULL, size, MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
+    }
+    //  Regions can not be partially released, so find an aligned address and try to claim it. Someone else may take it
+    //  first, in which case try again.
+    for (;;)
+    {
+        void* const ptr = VirtualAlloc(NULL, size + alignment, MEM_RESERVE, PAGE_NOACCESS);
+        if (ptr == NULL)
+        {
+            return NULL;
+        }
+        const uintptr_t aligned = ((uintptr_t)ptr + alignment - 1) & ~(alignment - 1);
+        VirtualFree(ptr, 0, MEM_RELEASE);
+        void* const res = VirtualAlloc((void*)aligned, size, MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
+        if (res != NULL)
+        {
+            return res;
+        }
+    }
 #endif
+}
+
+static inline uint_fast64_t pool_granularity(const ill_allocator* this)
+{
+    //  Pool sizes are multiples of this
+    return (this->flags & ILL_ALLOCATOR_HUGE_PAGES) ? HUGE_PAGE_SIZE : PAGE_SIZE;
+}
+
+static mem_pool* map_pool(ill_allocator* this, uint_fast64_t pool_size)
+{
+    const int aligned = (this->flags & ILL_ALLOCATOR_ALIGNED_POOLS) != 0;
+    const int oversized = aligned && pool_size != this->pool_size;
+    mem_pool* pool = map_memory(pool_size, aligned && !oversized ? pool_size : PAGE_SIZE, (this->flags & ILL_ALLOCATOR_HUGE_PAGES) != 0);
+    if (!pool)
+    {
+        return NULL;
     }
-    for (uint_fast64_t i = 0; i < this->count; ++i)
+    //  Memory is zeroed when it is mapped, so bitmaps and bins are already empty
+    const uint_fast64_t header_size = pool_header_size(pool_size);
+    pool->size = pool_size;
+    pool->fl_count = pool_fl_count(pool_size);
+    //  Pool is going to be added at the end of the pool table
+    pool->index = this->count;
+    pool->empty_since = this->free_count;
+    pool->base = (void*)((uintptr_t)pool + header_size);
+    pool->used = pool_size - header_size;
+    pool->free = 0;
+    mem_chunk* base_chunk = pool->base;
+    base_chunk->size = pool_size - header_size;
+    base_chunk->used = 0;
+    base_chunk->prev_used = 1;
+    base_chunk->oversized = oversized;
+    base_chunk->mapped = 0;
+    insert_chunk_into_bins(this, pool, base_chunk);
+    return pool;
+}
+
+static void unmap_pool(mem_pool* pool)
+{
+#ifndef _WIN32
+    munmap(pool, pool->size);
+#else
+    BOOL res = VirtualFree(pool, 0, MEM_RELEASE);
+    assert(res != 0);
+#endif
+}
+
+static mem_chunk* map_block(ill_allocator* this, uint_fast64_t size)
+{
+    const uint_fast64_t mapping_size = round_to_nearest_page_up(size + offsetof(mapped_block, chunk));
+#ifndef _WIN32
+    mapped_block* const block = mmap(NULL, mapping_size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+    if (block == MAP_FAILED)
+#else
+    mapped_block* const block = VirtualAlloc(NULL, mapping_size, MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
+    if (block == NULL)
+#endif
+    {
+        return NULL;
+    }
+    block->mapping_size = mapping_size;
+    block->chunk.size = mapping_size - offsetof(mapped_block, chunk);
+    block->chunk.mapped = 1;
+    block->chunk.oversized = 0;
+    block->chunk.prev_used = 1;
+    block->chunk.used = 1;
+    block->prev = NULL;
+    block->next = this->mapped_blocks;
+    if (block->next)
+    {
+        block->next->prev = block;
+    }
+    this->mapped_blocks = block;
+    return &block->chunk;
+}
+
+static inline mapped_block* chunk_mapped_block(mem_chunk* chunk)
+{
+    assert(chunk->mapped);
+    return (mapped_block*)((uintptr_t)chunk - offsetof(mapped_block, chunk));
+}
+
+static void relink_mapped_block(ill_allocator* this, mapped_block* block)
+{
+    //  Makes the neighbours of a block point to it, after it may have been moved
+    if (block->prev)
+    {
+        block->prev->next = block;
+    }
+    else
     {
-        this->pools[i] = (mem_pool){0};
+        this->mapped_blocks = block;
+    }
+    if (block->next)
+    {
+        block->next->prev = block;
+    }
+}
+
+static void unmap_block(ill_allocator* this, mem_chunk* chunk)
+{
+    mapped_block* const block = chunk_mapped_block(chunk);
+    if (block->prev)
+    {
+        block->prev->next = block->next;
+    }
+    else
+    {
+        assert(this->mapped_blocks == block);
+        this->mapped_blocks = block->next;
+    }
+    if (block->next)
+    {
+        block->next->prev = block->prev;
+    }
+#ifndef _WIN32
+    munmap(block, block->mapping_size);
+#else
+    BOOL res = VirtualFree(block, 0, MEM_RELEASE);
+    assert(res != 0);
+#endif
+}
+
+static inline int should_map_block(const ill_allocator* this, uint_fast64_t size, uint_fast64_t alignment)
+{
+    return this->mmap_threshold && size >= this->mmap_threshold && alignment <= MAPPED_BLOCK_ALIGNMENT;
+}
+
+void ill_allocator_destroy(ill_allocator* allocator)
+{
+    ill_allocator* this = (ill_allocator*)allocator;
+    for (uint_fast32_t i = 0; i < this->count; ++i)
+    {
+        unmap_pool(this->pools[i]);
+        this->pools[i] = NULL;
+    }
+    while (this->mapped_blocks)
+    {
+        unmap_block(this, &this->mapped_blocks->chunk);
     }
 #ifndef _WIN32
     munmap(this->pools, this->pool_buffer_size);
+    munmap(this->pool_classes, this->class_buffer_size);
+    if (this->oversized_pools)
+    {
+        munmap(this->oversized_pools, this->oversized_buffer_size);
+    }
 #else
     VirtualFree(this->pools, 0, MEM_RELEASE);
+    VirtualFree(this->pool_classes, 0, MEM_RELEASE);
+    if (this->oversized_pools)
+    {
+        VirtualFree(this->oversized_pools, 0, MEM_RELEASE);
+    }
 #endif
     *this = (ill_allocator){0};
 #ifndef _WIN32
@@ -122,300 +642,561 @@ static inline uint_fast64_t round_up_size(uint_fast64_t size)
     uint_fast64_t remainder = 8 - (size & 7);
     size += remainder;
     size += offsetof(mem_chunk, next);
-    if (size < sizeof(mem_chunk))
+    if (size < MIN_CHUNK_SIZE)
     {
-        return sizeof(mem_chunk);
+        return MIN_CHUNK_SIZE;
     }
     return size;
 }
 
-static inline mem_pool* find_supporting_pool(ill_allocator* allocator, uint_fast64_t size)
+static inline uint_fast64_t find_pool_above_class(const uint16_t* classes, uint_fast64_t begin, uint_fast64_t count, uint_fast32_t class)
 {
-    for (uint_fast32_t i = 0; i < allocator->count; ++i)
+    //  Find the first pool with its class greater than the one given
+    uint_fast64_t i = begin;
+#if defined(__AVX2__)
+    const __m256i threshold = _mm256_set1_epi16((short)class);
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(classes + i));
+        const uint32_t mask = _mm256_movemask_epi8(_mm256_cmpgt_epi16(v, threshold));
+        if (mask)
+        {
+            return i + bit_scan_forward(mask) / 2;
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i threshold = _mm_set1_epi16((short)class);
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(classes + i));
+        const uint32_t mask = _mm_movemask_epi8(_mm_cmpgt_epi16(v, threshold));
+        if (mask)
+        {
+            return i + bit_scan_forward(mask) / 2;
+        }
+    }
+#endif
+    for (; i < count; ++i)
     {
-        mem_pool* pool = allocator->pools + i;
-        if (pool->largest && size <= pool->largest->size)
+        if (classes[i] > class)
         {
+            return i;
+        }
+    }
+    return count;
+}
+
+static inline mem_pool* find_supporting_pool(ill_allocator* allocator, uint_fast64_t size, mem_chunk** p_chunk)
+{
+    uint_fast32_t fl, sl;
+    //  Any pool with a non-empty bin at or above the one found by mapping_search has a chunk which fits
+    mapping_search(size, &fl, &sl);
+    uint_fast64_t i = find_pool_above_class(allocator->pool_classes, 0, allocator->count, fl * SL_INDEX_COUNT + sl);
+    if (i != allocator->count)
+    {
+        mem_pool* pool = allocator->pools[i];
+        *p_chunk = find_good_fit_chunk(pool, size);
+        assert(*p_chunk);
+        return pool;
+    }
+    //  No pool has a chunk which certainly fits, so check for exact fits before giving up
+    mapping_insert(size, &fl, &sl);
+    for (i = find_pool_above_class(allocator->pool_classes, 0, allocator->count, fl * SL_INDEX_COUNT + sl);
+         i != allocator->count;
+         i = find_pool_above_class(allocator->pool_classes, i + 1, allocator->count, fl * SL_INDEX_COUNT + sl))
+    {
+        mem_pool* pool = allocator->pools[i];
+        mem_chunk* chunk = find_exact_fit_chunk(pool, size);
+        if (chunk)
+        {
+            *p_chunk = chunk;
             return pool;
         }
     }
     return NULL;
 }
 
-static inline mem_chunk* find_ge_chunk_from_largest(mem_pool* pool, uint_fast64_t size)
+static inline mem_pool* find_oversized_pool(const ill_allocator* allocator, const void* ptr)
 {
-    mem_chunk* current;
-    for (current = pool->largest; current; current = current->prev)
+    //  Find the last oversized pool which begins before ptr
+    uint_fast64_t begin = 0, end = allocator->oversized_count;
+    while (begin < end)
     {
-        if (current->size >= size)
+        const uint_fast64_t middle = begin + (end - begin) / 2;
+        if ((uintptr_t)allocator->oversized_pools[middle] <= (uintptr_t)ptr)
         {
-            return current;
+            begin = middle + 1;
+        }
+        else
+        {
+            end = middle;
         }
     }
-    return NULL;
+    if (begin == 0)
+    {
+        return NULL;
+    }
+    mem_pool* const pool = allocator->oversized_pools[begin - 1];
+    return (uintptr_t)pool + pool->size > (uintptr_t)ptr ? pool : NULL;
 }
 
-static inline mem_chunk* find_ge_chunk_from_smallest(mem_pool* pool, uint_fast64_t size)
+static inline mem_pool* find_chunk_pool(ill_allocator* allocator, void* ptr)
 {
-    mem_chunk* current;
-    for (current = pool->smallest; current; current = current->next)
+    if (allocator->flags & ILL_ALLOCATOR_ALIGNED_POOLS)
     {
-        if (current->size >= size)
+        //  Regular pools are aligned to their size, so their control block is found by masking the pointer
+        const mem_chunk* const chunk = (void*)((uintptr_t)ptr - offsetof(mem_chunk, next));
+        if (!chunk->oversized)
         {
-            return current;
+            return (mem_pool*)((uintptr_t)ptr & ~(allocator->pool_size - 1));
+        }
+        return find_oversized_pool(allocator, ptr);
+    }
+    for (uint_fast32_t i = 0; i < allocator->count; ++i)
+    {
+        mem_pool* pool = allocator->pools[i];
+        if ((void*)pool <= ptr && (uintptr_t)pool + pool->size > (uintptr_t)ptr)
+        {
+            return pool;
         }
     }
     return NULL;
 }
 
-static inline void remove_chunk_from_pool(mem_pool* pool, mem_chunk* chunk)
+static void* grow_table(void* table, uint_fast64_t* p_buffer_size)
 {
-    if (chunk->next)
+    const uint_fast64_t new_memory_size = *p_buffer_size + PAGE_SIZE;
+#ifndef _WIN32
+    void* new_ptr = table ? mremap(table, *p_buffer_size, new_memory_size, MREMAP_MAYMOVE) : MAP_FAILED;
+    if (new_ptr == MAP_FAILED)
     {
-        assert(chunk->next->prev == chunk);
-        (chunk->next)->prev = chunk->prev;
+        new_ptr = mmap(NULL, new_memory_size, PROT_WRITE|PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (new_ptr == MAP_FAILED)
+        {
+            return NULL;
+        }
+        if (table)
+        {
+            memcpy(new_ptr, table, *p_buffer_size);
+            munmap(table, *p_buffer_size);
+        }
     }
-    else
+#else
+    void* new_ptr = VirtualAlloc(NULL, new_memory_size, MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
+    if (new_ptr == NULL)
     {
-//        assert(pool->largest == chunk);
-        pool->largest = chunk->prev;
+        return NULL;
     }
-    if (chunk->prev)
+    if (table)
     {
-        assert(chunk->prev->next == chunk);
-        (chunk->prev)->next = chunk->next;
+        memcpy(new_ptr, table, *p_buffer_size);
+        VirtualFree(table, 0, MEM_RELEASE);
     }
-    else
+#endif
+    memset((void*)((uintptr_t)new_ptr + *p_buffer_size), 0, PAGE_SIZE);
+    *p_buffer_size = new_memory_size;
+    return new_ptr;
+}
+
+static mem_pool* create_pool(ill_allocator* this, uint_fast64_t size)
+{
+    if (this->count == this->capacity)
     {
-        assert(pool->smallest == chunk);
-        pool->smallest = chunk->next;
+        mem_pool** const new_pools = grow_table(this->pools, &this->pool_buffer_size);
+        if (!new_pools)
+        {
+            return NULL;
+        }
+        this->pools = new_pools;
+        this->capacity = this->pool_buffer_size / sizeof(*this->pools);
     }
-    pool->free -= chunk->size;
-    pool->used += chunk->size;
+    while (this->class_buffer_size < this->capacity * sizeof(*this->pool_classes))
+    {
+        uint16_t* const new_classes = grow_table(this->pool_classes, &this->class_buffer_size);
+        if (!new_classes)
+        {
+            return NULL;
+        }
+        this->pool_classes = new_classes;
+    }
+
+    uint_fast64_t pool_size = this->pool_size;
+    if (pool_size - pool_header_size(pool_size) < size)
+    {
+        //  Pool dedicated to this allocation
+        const uint_fast64_t granularity = pool_granularity(this);
+        pool_size = (size + pool_header_size(size) + granularity - 1) & ~(granularity - 1);
+        while (pool_size - pool_header_size(pool_size) < size)
+        {
+            pool_size += granularity;
+        }
+    }
+    const int oversized = (this->flags & ILL_ALLOCATOR_ALIGNED_POOLS) && pool_size != this->pool_size;
+    if (oversized && this->oversized_count == this->oversized_capacity)
+    {
+        mem_pool** const new_oversized = grow_table(this->oversized_pools, &this->oversized_buffer_size);
+        if (!new_oversized)
+        {
+            return NULL;
+        }
+        this->oversized_pools = new_oversized;
+        this->oversized_capacity = this->oversized_buffer_size / sizeof(*this->oversized_pools);
+    }
+
+    mem_pool* const pool = map_pool(this, pool_size);
+    if (!pool)
+    {
+        return NULL;
+    }
+    this->pools[this->count++] = pool;
+    if (oversized)
+    {
+        //  Keep the oversized pools sorted by address
+        uint_fast64_t i;
+        for (i = this->oversized_count; i > 0 && (uintptr_t)this->oversized_pools[i - 1] > (uintptr_t)pool; --i)
+        {
+            this->oversized_pools[i] = this->oversized_pools[i - 1];
+        }
+        this->oversized_pools[i] = pool;
+        this->oversized_count += 1;
+    }
+    return pool;
 }
 
-static inline void insert_chunk_into_pool(mem_pool* pool, mem_chunk* chunk)
+static inline uint_fast64_t aligned_padding(const mem_chunk* chunk, uint_fast64_t alignment)
 {
-beginning_of_fn:
-    assert(chunk->used == 0);
-    //  Check if pool has other chunks
-    if (pool->free == 0)
+    //  Padding in front of the chunk needed to align its memory, which must be large enough to become a free chunk
+    const uintptr_t ptr = (uintptr_t)&chunk->next;
+    uint_fast64_t padding = (alignment - (ptr & (alignment - 1))) & (alignment - 1);
+    while (padding && padding < MIN_CHUNK_SIZE)
     {
-        assert(!pool->smallest && !pool->largest);
-        pool->smallest = chunk;
-        pool->largest = chunk;
-        chunk->next = NULL;
-        chunk->prev = NULL;
+        padding += alignment;
     }
-    else
+    return padding;
+}
+
+static inline void record_allocation(ill_allocator* this, mem_chunk* chunk)
+{
+#ifdef JMEM_ALLOC_TRACKING
+    chunk->idx = ++this->allocator_index;
+#ifdef JMEM_ALLOC_TRAP_COUNT
+    for (uint32_t i = 0; i < this->trap_counts; ++i)
     {
-        mem_chunk* ge_chunk = NULL;
-        for (mem_chunk* current = pool->smallest; current; current = current->next)
+        if (chunk->idx == this->trap_values[i])
         {
-            //  Check if the current directly follows chunk
-            if (((uintptr_t)chunk) + chunk->size == (uintptr_t)current)
+            void (* callback)(uint32_t idx, void* param) = this->trap_callbacks[i];
+            void* param = this->trap_params[i];
+            for (uint32_t j = i; j < this->trap_counts - 1; ++j)
             {
-                //  Pull the current from the pool
-                remove_chunk_from_pool(pool, current);
-                //  Merge chunk with current
-                chunk->size += current->size;
-                goto beginning_of_fn;
+                this->trap_values[j] = this->trap_values[j + 1];
             }
+            this->trap_counts -= 1;
+            assert(callback);
+            callback(this->allocator_index, param);
+            break;
+        }
+    }
+#endif
+    this->total_allocated += chunk->size;
+    if (this->max_allocated < chunk->size)
+    {
+        this->max_allocated = chunk->size;
+    }
+    this->current_allocated += chunk->size;
+    if (this->current_allocated > this->max_allocated)
+    {
+        this->max_allocated = this->current_allocated;
+    }
+#else
+    (void)this;
+    (void)chunk;
+#endif
+}
 
-            //  Check if the current directly precedes chunk
-            if (((uintptr_t)current) + current->size == (uintptr_t)chunk)
-            {
-                //  Pull the current from the pool
-                remove_chunk_from_pool(pool, current);
-                //  Merge chunk with current
-                current->size += chunk->size;
-                chunk = current;
-                goto beginning_of_fn;
-            }
+static mem_chunk* take_chunk(ill_allocator* this, uint_fast64_t size, uint_fast64_t alignment)
+{
+    //  Size must already be rounded up. For alignments above the natural one, look for a chunk with enough extra space
+    //  for any padding that might be needed
+    const uint_fast64_t search_size = alignment > ALIGN_SIZE ? size + alignment + MIN_CHUNK_SIZE : size;
 
-            //  Check if current->size is greater than or equal chunk->size
-            if (!ge_chunk && current->size >= chunk->size)
+    //  Check there's a pool that can support the allocation
+    mem_chunk* chunk = NULL;
+    mem_pool* pool = find_supporting_pool(this, search_size, &chunk);
+    if (!pool)
+    {
+        //  Create a new pool
+        pool = create_pool(this, search_size);
+        if (!pool)
+        {
+            if (this->bad_alloc_callback)
             {
-                ge_chunk = current;
+                this->bad_alloc_callback(this, this->bad_alloc_param);
             }
+            return NULL;
         }
-
-        //  Find first larger or equally sized chunk
-//        mem_chunk* ge_chunk = find_ge_chunk_from_smallest(pool, chunk->size);
-        if (!ge_chunk)
+        chunk = find_good_fit_chunk(pool, search_size);
+        if (!chunk)
         {
-            //  No others are larger or of equal size, so this is the new largest
-            assert(pool->largest->size < chunk->size);
-            pool->largest->next = chunk;
-            chunk->prev = pool->largest;
-            chunk->next = NULL;
-            pool->largest = chunk;
+            chunk = find_exact_fit_chunk(pool, search_size);
         }
-        else
+    }
+
+    //  Use the chunk which was found to fit
+    assert(chunk);
+    remove_chunk_from_pool(this, pool, chunk);
+
+    if (alignment > ALIGN_SIZE)
+    {
+        const uint_fast64_t padding = aligned_padding(chunk, alignment);
+        if (padding)
         {
-            //  Chunk belongs after the ge_chunk in the list
-            chunk->prev = ge_chunk->prev;
-            chunk->next = ge_chunk;
-            assert(!chunk->prev || chunk->prev->size <= chunk->size);
-            assert(!chunk->next || chunk->next->size >= chunk->size);
-            //  Check if ge_chunk was smallest in pool
-            if (ge_chunk->prev)
-            {
-                (ge_chunk->prev)->next = chunk;
-            }
-            else
-            {
-                assert(ge_chunk == pool->smallest);
-                pool->smallest = chunk;
-            }
-            ge_chunk->prev = chunk;
+            //  Padding is split off into a free chunk of its own, so it can still be used by other allocations. The
+            //  chunk was free, so the one before it is used and no merging is needed.
+            mem_chunk* const aligned_chunk = (void*)((uintptr_t)chunk + padding);
+            aligned_chunk->size = chunk->size - padding;
+            aligned_chunk->oversized = chunk->oversized;
+            aligned_chunk->mapped = 0;
+            aligned_chunk->used = 1;
+            chunk->size = padding;
+            insert_chunk_into_bins(this, pool, chunk);
+            aligned_chunk->used = 0;
+            chunk = aligned_chunk;
         }
+        assert(((uintptr_t)&chunk->next & (alignment - 1)) == 0);
     }
-    pool->free += chunk->size;
-    pool->used -= chunk->size;
+
+    //  Check if chunk can be split
+    uint_fast64_t remaining = chunk->size - size;
+    if (remaining >= MIN_CHUNK_SIZE)
+    {
+        mem_chunk* new_chunk = (void*)(((uintptr_t)chunk) + size);
+        new_chunk->used = 0;
+        new_chunk->prev_used = 1;
+        new_chunk->oversized = chunk->oversized;
+        new_chunk->mapped = 0;
+        new_chunk->size = remaining;
+        chunk->size = size;
+        //  Chunk was free, so its neighbours were not, thus no merging is needed
+        insert_chunk_into_bins(this, pool, new_chunk);
+    }
+
+    mark_chunk_used(pool, chunk);
+    return chunk;
 }
 
-static inline mem_pool* find_chunk_pool(ill_allocator* allocator, void* ptr)
+static void* allocate_chunk(ill_allocator* this, uint_fast64_t size, uint_fast64_t alignment)
 {
-    for (uint_fast32_t i = 0; i < allocator->count; ++i)
+    mem_chunk* chunk;
+    if (should_map_block(this, size, alignment))
     {
-        mem_pool* pool = allocator->pools + i;
-        if (pool->base <= ptr && (uintptr_t)pool->base + (pool->used + pool->free) > (uintptr_t)ptr)
+        chunk = map_block(this, size);
+        if (!chunk)
         {
-            return pool;
+            if (this->bad_alloc_callback)
+            {
+                this->bad_alloc_callback(this, this->bad_alloc_param);
+            }
+            return NULL;
         }
     }
-    return NULL;
+    else
+    {
+        chunk = take_chunk(this, size, alignment);
+        if (!chunk)
+        {
+            return NULL;
+        }
+    }
+    record_allocation(this, chunk);
+    return &chunk->next;
 }
 
-void* ill_alloc(ill_allocator* allocator, uint_fast64_t size)
+static int allocate_batch(ill_allocator* this, uint_fast64_t count, const uint_fast64_t* sizes, uint_fast64_t uniform_size, void** out_ptrs)
 {
-    ill_allocator* this = (ill_allocator*)allocator;
-    const uint_fast64_t original_size = size;
-    //  Round up size to 8 bytes
-    size = round_up_size(size);
-
-    //  Check there's a pool that can support the allocation
-    mem_pool* pool = find_supporting_pool(this, size);
-    if (!pool)
+    //  Blocks are gathered into groups, each of which is taken from the pools as a single chunk and then carved up.
+    //  Groups are kept well below the pool size, so that they fit into existing pools instead of dedicated ones.
+    const uint_fast64_t group_limit = this->pool_size / 4;
+    uint_fast64_t i = 0;
+    while (i < count)
     {
-        //  Create a new pool
-        if (this->count == this->capacity)
+        uint_fast64_t total = round_up_size(sizes ? sizes[i] : uniform_size);
+        uint_fast64_t j = i + 1;
+        if (!should_map_block(this, total, ALIGN_SIZE))
         {
-            uint_fast64_t new_memory_size = this->pool_buffer_size + PAGE_SIZE;
-#ifndef _WIN32
-            mem_pool* new_ptr = mremap(this->pools, this->pool_buffer_size, new_memory_size, MREMAP_MAYMOVE);
-            if (new_ptr == MAP_FAILED)
+            for (; j < count; ++j)
             {
-                new_ptr = mmap(NULL, new_memory_size, PROT_WRITE|PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
-                if (new_ptr == MAP_FAILED)
-                {
-                    return NULL;
-                }
-                for (uint_fast64_t i = 0; i < this->count; ++i)
+                const uint_fast64_t size = round_up_size(sizes ? sizes[j] : uniform_size);
+                if (total + size > group_limit || should_map_block(this, size, ALIGN_SIZE))
                 {
-                    new_ptr[i] = this->pools[i];
+                    break;
                 }
-                munmap(this->pools, this->pool_buffer_size);
+                total += size;
             }
-#else
-            mem_pool* new_ptr = VirtualAlloc(NULL, new_memory_size, MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
-            if (new_ptr == NULL)
-            {
-                return NULL;
-            }
-            for (uint_fast64_t i = 0; i < this->count; ++i)
+        }
+        if (j == i + 1)
+        {
+            out_ptrs[i] = allocate_chunk(this, total, ALIGN_SIZE);
+            if (!out_ptrs[i])
             {
-                new_ptr[i] = this->pools[i];
+                goto failed;
             }
-            VirtualFree(this->pools, 0, MEM_RELEASE);
-#endif
-            memset((void*)((uintptr_t)new_ptr + this->pool_buffer_size), 0, PAGE_SIZE);
-            this->pool_buffer_size = new_memory_size;
-            this->pools = new_ptr;
+            i = j;
+            continue;
         }
 
-        const uint_fast64_t pool_size = round_to_nearest_page_up(this->pool_size > size + sizeof(mem_chunk) ? this->pool_size : size + sizeof(mem_chunk));
-#ifndef _WIN32
-        mem_chunk* base_chunk = mmap(NULL, pool_size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
-        if (base_chunk == MAP_FAILED)
-#else
-        mem_chunk* base_chunk = VirtualAlloc(NULL, pool_size, MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
-        if (base_chunk == NULL)
-#endif
+        mem_chunk* const group = take_chunk(this, total, ALIGN_SIZE);
+        if (!group)
+        {
+            goto failed;
+        }
+        //  Group chunk is used, as is the one before each block carved from it, so only the sizes need to be set up.
+        //  Last block also gets any space left over, which was too small to be split off as a free chunk.
+        const uint_fast64_t available = group->size;
+        uint_fast64_t offset = 0;
+        for (; i < j; ++i)
         {
-            if (allocator->bad_alloc_callback)
+            const uint_fast64_t size = round_up_size(sizes ? sizes[i] : uniform_size);
+            mem_chunk* const chunk = (void*)((uintptr_t)group + offset);
+            if (offset)
             {
-                allocator->bad_alloc_callback(allocator, allocator->bad_alloc_param);
+                chunk->mapped = 0;
+                chunk->oversized = group->oversized;
+                chunk->prev_used = 1;
+                chunk->used = 1;
             }
-            return NULL;
+            chunk->size = i + 1 == j ? available - offset : size;
+            offset += size;
+            record_allocation(this, chunk);
+            out_ptrs[i] = &chunk->next;
         }
-        base_chunk->size = pool_size;
-        base_chunk->used = 0;
-        base_chunk->next = NULL;
-        base_chunk->prev = NULL;
-        mem_pool new_pool =
-                {
-                .base = base_chunk,
-                .largest = base_chunk,
-                .smallest = base_chunk,
-                .used = 0,
-                .free = pool_size,
-                .size = pool_size,
-                };
-        pool = this->pools + this->count;
-        this->pools[this->count++] = new_pool;
-    }
-
-    //  Find the smallest block which fits
-    mem_chunk* chunk = find_ge_chunk_from_largest(pool, size);
-    assert(chunk);
-    remove_chunk_from_pool(pool, chunk);
+    }
+    return 0;
 
-    //  Check if chunk can be split
-    uint_fast64_t remaining = chunk->size - size;
-    if (remaining >= sizeof(mem_chunk))
+failed:
+    //  Batch either succeeds as a whole or leaves nothing allocated
+    for (uint_fast64_t k = 0; k < i; ++k)
     {
-        mem_chunk* new_chunk = (void*)(((uintptr_t)chunk) + size);
-        new_chunk->used = 0;
-        new_chunk->size = remaining;
-        chunk->size = size;
-        insert_chunk_into_pool(pool, new_chunk);
+        ill_jfree(this, out_ptrs[k]);
+        out_ptrs[k] = NULL;
     }
+    for (uint_fast64_t k = i; k < count; ++k)
+    {
+        out_ptrs[k] = NULL;
+    }
+    return -1;
+}
 
-    chunk->used = 1;
-#ifdef JMEM_ALLOC_TRACKING
-    chunk->idx = ++this->allocator_index;
-#ifdef JMEM_ALLOC_TRAP_COUNT
-    for (uint32_t i = 0; i < this->trap_counts; ++i)
+int ill_alloc_batch(ill_allocator* allocator, uint_fast64_t count, const uint_fast64_t* sizes, void** out_ptrs)
+{
+    ill_allocator* this = (ill_allocator*)allocator;
+    return allocate_batch(this, count, sizes, 0, out_ptrs);
+}
+
+int ill_alloc_batch_uniform(ill_allocator* allocator, uint_fast64_t count, uint_fast64_t size, void** out_ptrs)
+{
+    ill_allocator* this = (ill_allocator*)allocator;
+    return allocate_batch(this, count, NULL, size, out_ptrs);
+}
+
+void* ill_alloc(ill_allocator* allocator, uint_fast64_t size)
+{
+    ill_allocator* this = (ill_allocator*)allocator;
+    //  Round up size to 8 bytes
+    size = round_up_size(size);
+    return allocate_chunk(this, size, ALIGN_SIZE);
+}
+
+void* ill_alloc_aligned(ill_allocator* allocator, uint_fast64_t size, uint_fast64_t alignment)
+{
+    ill_allocator* this = (ill_allocator*)allocator;
+    if (alignment & (alignment - 1))
     {
-        if (chunk->idx == this->trap_values[i])
+        return NULL;
+    }
+    size = round_up_size(size);
+    return allocate_chunk(this, size, alignment);
+}
+
+static void release_pool(ill_allocator* this, uint_fast64_t i)
+{
+    mem_pool* const pool = this->pools[i];
+    assert(pool->index == i && pool->used == 0);
+    if ((this->flags & ILL_ALLOCATOR_ALIGNED_POOLS) && pool->size != this->pool_size)
+    {
+        //  Keep the oversized pools sorted by address
+        uint_fast64_t j;
+        for (j = 0; this->oversized_pools[j] != pool; ++j)
         {
-            void (* callback)(uint32_t idx, void* param) = this->trap_callbacks[i];
-            void* param = this->trap_params[i];
-            for (uint32_t j = i; j < this->trap_counts - 1; ++j)
-            {
-                this->trap_values[j] = this->trap_values[j + 1];
-            }
-            this->trap_counts -= 1;
-            assert(callback);
-            callback(this->allocator_index, param);
-            break;
+            assert(j < this->oversized_count);
+        }
+        for (; j + 1 < this->oversized_count; ++j)
+        {
+            this->oversized_pools[j] = this->oversized_pools[j + 1];
         }
+        this->oversized_count -= 1;
     }
-#endif
-    this->total_allocated += chunk->size;
-    if (this->max_allocated < chunk->size)
+    //  Move the last pool into the hole
+    const uint_fast64_t last = this->count - 1;
+    if (i != last)
     {
-        this->max_allocated = chunk->size;
+        this->pools[i] = this->pools[last];
+        this->pools[i]->index = i;
+        this->pool_classes[i] = this->pool_classes[last];
+    }
+    this->pools[last] = NULL;
+    this->pool_classes[last] = 0;
+    this->count -= 1;
+    unmap_pool(pool);
+}
+
+static uint_fast64_t trim_pools(ill_allocator* this, uint_fast64_t delay)
+{
+    //  Pools which have not been empty for long enough are kept, and count towards the spare pools
+    uint_fast64_t kept = 0;
+    for (uint_fast64_t i = 0; i < this->count; ++i)
+    {
+        const mem_pool* const pool = this->pools[i];
+        if (pool->used == 0 && pool->size == this->pool_size && this->free_count - pool->empty_since < delay)
+        {
+            kept += 1;
+        }
+    }
+    uint_fast64_t released = 0;
+    //  Go backwards, so that pools moved into the holes were already checked
+    for (uint_fast64_t i = this->count; i > 0; --i)
+    {
+        const mem_pool* const pool = this->pools[i - 1];
+        if (pool->used != 0 || this->free_count - pool->empty_since < delay)
+        {
+            continue;
+        }
+        if (pool->size == this->pool_size && kept < this->spare_pools)
+        {
+            kept += 1;
+            continue;
+        }
+        released += pool->size;
+        release_pool(this, i - 1);
     }
-    this->current_allocated += chunk->size;
-    if (this->current_allocated > this->max_allocated)
+    return released;
+}
+
+static int count_frees(ill_allocator* this, mem_pool* pool, uint_fast64_t freed)
+{
+    //  Returns non-zero if pools were trimmed
+    this->free_count += freed;
+    if (pool->used == 0)
     {
-        this->max_allocated = this->current_allocated;
+        pool->empty_since = this->free_count;
+        //  Pool that was just emptied is not old enough to be released, unless there is no delay
+        if (this->auto_trim && this->free_count >= this->next_trim)
+        {
+            trim_pools(this, this->trim_delay);
+            this->next_trim = this->free_count + this->trim_delay;
+            return 1;
+        }
     }
-#endif
-    return &chunk->next;
+    return 0;
 }
 
 void ill_jfree(ill_allocator* allocator, void* ptr)
@@ -423,12 +1204,18 @@ void ill_jfree(ill_allocator* allocator, void* ptr)
     ill_allocator* this = (ill_allocator*)allocator;
     //  Check for null
     if (!ptr) return;
-    //  Check what pool this is from
-    mem_pool* pool = find_chunk_pool(this, ptr);
     mem_chunk* chunk = (void*)((uintptr_t)ptr - offsetof(mem_chunk, next));
 #ifdef JMEM_ALLOC_TRACKING
     this->current_allocated -= chunk->size;
 #endif
+    if (chunk->mapped)
+    {
+        //  Block has its own mapping, which is released right away
+        unmap_block(this, chunk);
+        return;
+    }
+    //  Check what pool this is from
+    mem_pool* pool = find_chunk_pool(this, ptr);
     if (!pool)
     {
         return;
@@ -446,31 +1233,278 @@ void ill_jfree(ill_allocator* allocator, void* ptr)
 
     //  Mark chunk as no longer used, then return it back to the pool
     chunk->used = 0;
-    insert_chunk_into_pool(pool, chunk);
+    insert_chunk_into_pool(this, pool, chunk);
+    count_frees(this, pool, 1);
 }
 
-void* ill_jrealloc(ill_allocator* allocator, void* ptr, uint_fast64_t new_size)
+static int compare_pointers(const void* a, const void* b)
+{
+    const uintptr_t pa = (uintptr_t)*(void* const*)a;
+    const uintptr_t pb = (uintptr_t)*(void* const*)b;
+    return (pa > pb) - (pa < pb);
+}
+
+void ill_jfree_batch(ill_allocator* allocator, uint_fast64_t count, void** ptrs)
 {
     ill_allocator* this = (ill_allocator*)allocator;
-    if (!ptr)
+    //  Once sorted, blocks from the same pool are next to each other, as are blocks which are physically adjacent
+    qsort(ptrs, count, sizeof(*ptrs), compare_pointers);
+    mem_pool* pool = NULL;
+    uint_fast64_t i = 0;
+    while (i < count)
     {
-        return ill_alloc(allocator, new_size);
+        void* const ptr = ptrs[i++];
+        if (!ptr) continue;
+        if (i > 1 && ptrs[i - 2] == ptr)
+        {
+            //  Same block given more than once, which sorting put right after the first one
+            if (this->double_free_callback)
+            {
+                this->double_free_callback(this, this->double_free_param);
+            }
+            continue;
+        }
+        mem_chunk* const chunk = (void*)((uintptr_t)ptr - offsetof(mem_chunk, next));
+        if (chunk->mapped)
+        {
+#ifdef JMEM_ALLOC_TRACKING
+            this->current_allocated -= chunk->size;
+#endif
+            unmap_block(this, chunk);
+            continue;
+        }
+        if (!pool || (uintptr_t)ptr < (uintptr_t)pool || (uintptr_t)ptr >= (uintptr_t)pool + pool->size)
+        {
+            pool = find_chunk_pool(this, ptr);
+            if (!pool)
+            {
+                continue;
+            }
+        }
+        if (chunk->used == 0)
+        {
+            //  Double free
+            if (this->double_free_callback)
+            {
+                this->double_free_callback(this, this->double_free_param);
+            }
+            continue;
+        }
+#ifdef JMEM_ALLOC_TRACKING
+        this->current_allocated -= chunk->size;
+#endif
+        //  Blocks directly following this one are merged into it, so that the whole run is inserted only once
+        uint_fast64_t freed = 1;
+        mem_chunk* next;
+        while (i < count && (next = next_chunk(pool, chunk)) && ptrs[i] == (void*)&next->next && next->used)
+        {
+#ifdef JMEM_ALLOC_TRACKING
+            this->current_allocated -= next->size;
+#endif
+            //  Header of the merged block is left marked as free, so that freeing it again is caught as a double free
+            next->used = 0;
+            chunk->size += next->size;
+            i += 1;
+            freed += 1;
+        }
+        chunk->used = 0;
+        insert_chunk_into_pool(this, pool, chunk);
+        if (count_frees(this, pool, freed))
+        {
+            //  Pools may have been released
+            pool = NULL;
+        }
     }
-    const uint_fast64_t original_size = new_size;
-    new_size = round_up_size(new_size);
+}
+
+static int absorb_next_chunk(ill_allocator* this, mem_pool* pool, mem_chunk* chunk, uint_fast64_t new_size)
+{
+    //  Location of potential candidate
+    mem_chunk* possible_chunk = next_chunk(pool, chunk);
+    if (!(possible_chunk                                                     //  Is the pointer in range?
+        && possible_chunk->used == 0                                         //  Is the other chunk in use
+        && possible_chunk->size + chunk->size >= new_size))               //  Is the other chunk large enough to accommodate us
+    {
+        return 0;
+    }
+    //  Pull the chunk from the pool
+    remove_chunk_from_pool(this, pool, possible_chunk);
+    //  Join the two chunks together
+    chunk->size += possible_chunk->size;
+    mark_chunk_used(pool, chunk);
+    return 1;
+}
+
+static mem_chunk* absorb_previous_chunk(ill_allocator* this, mem_pool* pool, mem_chunk* chunk, uint_fast64_t new_size, uint_fast64_t alignment)
+{
+    //  Free chunk before this one, together with the one after it if needed, may be large enough once the block is
+    //  moved down to its start
+    if (chunk->prev_used)
+    {
+        return NULL;
+    }
+    mem_chunk* const prev = previous_free_chunk(chunk);
+    if ((uintptr_t)&prev->next & (alignment - 1))
+    {
+        return NULL;
+    }
+    mem_chunk* const next = next_chunk(pool, chunk);
+    const uint_fast64_t size = prev->size + chunk->size;
+    const int use_next = size < new_size;
+    if (use_next && !(next && next->used == 0 && size + next->size >= new_size))
+    {
+        return NULL;
+    }
+    //  Free chunks are pulled from the pool before the block is moved over their links
+    remove_chunk_from_pool(this, pool, prev);
+    uint_fast64_t total = size;
+    if (use_next)
+    {
+        remove_chunk_from_pool(this, pool, next);
+        total += next->size;
+    }
+#ifdef JMEM_ALLOC_TRACKING
+    const uint_fast64_t idx = chunk->idx;
+#endif
+    memmove(&prev->next, &chunk->next, chunk->size - offsetof(mem_chunk, next));
+    prev->size = total;
+    prev->used = 1;
+#ifdef JMEM_ALLOC_TRACKING
+    prev->idx = idx;
+#endif
+    mark_chunk_used(pool, prev);
+    return prev;
+}
+
+static void split_chunk_tail(ill_allocator* this, mem_pool* pool, mem_chunk* chunk, uint_fast64_t new_size)
+{
+    assert(chunk->size >= new_size);
+    //  Check if block can be split in two
+    const uint_fast64_t remainder = chunk->size - new_size;
+    if (remainder < MIN_CHUNK_SIZE)
+    {
+        //  Can not be split, so the chunk keeps the extra space
+        return;
+    }
+    //  Split the chunk
+    mem_chunk* new_chunk = (void*)(((uintptr_t)chunk) + new_size);
+    chunk->size = new_size;
+    new_chunk->size = remainder;
+    new_chunk->used = 0;
+    new_chunk->prev_used = 1;
+    new_chunk->oversized = chunk->oversized;
+    new_chunk->mapped = 0;
+    //  Put the split chunk into the pool
+    insert_chunk_into_pool(this, pool, new_chunk);
+}
 
+static inline void record_resize(ill_allocator* this, uint_fast64_t old_size, uint_fast64_t new_size)
+{
+#ifdef JMEM_ALLOC_TRACKING
+    this->current_allocated -= old_size;
+    this->current_allocated += new_size;
+    this->total_allocated += new_size > old_size ? new_size - old_size : 0;
+    if (this->current_allocated > this->max_allocated)
+    {
+        this->max_allocated = this->current_allocated;
+    }
+    if (new_size > this->biggest_allocation)
+    {
+        this->biggest_allocation = new_size;
+    }
+#else
+    (void)this;
+    (void)old_size;
+    (void)new_size;
+#endif
+}
 
+static void* reallocate_mapped(ill_allocator* this, mem_chunk* chunk, uint_fast64_t new_size, uint_fast64_t alignment)
+{
+    const uint_fast64_t old_size = chunk->size;
+    if (!should_map_block(this, new_size, alignment))
+    {
+        //  Block no longer belongs in a mapping of its own, so move it into a pool
+        void* const new_ptr = allocate_chunk(this, new_size, alignment);
+        if (!new_ptr)
+        {
+            return NULL;
+        }
+        memcpy(new_ptr, &chunk->next, (old_size < new_size ? old_size : new_size) - offsetof(mem_chunk, next));
+        ill_jfree(this, &chunk->next);
+        return new_ptr;
+    }
+    mapped_block* block = chunk_mapped_block(chunk);
+    const uint_fast64_t mapping_size = round_to_nearest_page_up(new_size + offsetof(mapped_block, chunk));
+    if (mapping_size != block->mapping_size)
+    {
+#ifndef _WIN32
+        //  Pages are moved by the kernel instead of being copied
+        mapped_block* const new_block = mremap(block, block->mapping_size, mapping_size, MREMAP_MAYMOVE);
+        if (new_block == MAP_FAILED)
+        {
+            if (this->bad_alloc_callback)
+            {
+                this->bad_alloc_callback(this, this->bad_alloc_param);
+            }
+            return NULL;
+        }
+        block = new_block;
+        block->mapping_size = mapping_size;
+        block->chunk.size = mapping_size - offsetof(mapped_block, chunk);
+        relink_mapped_block(this, block);
+#else
+        mem_chunk* const new_chunk = map_block(this, new_size);
+        if (!new_chunk)
+        {
+            if (this->bad_alloc_callback)
+            {
+                this->bad_alloc_callback(this, this->bad_alloc_param);
+            }
+            return NULL;
+        }
+        memcpy(&new_chunk->next, &chunk->next, (old_size < new_chunk->size ? old_size : new_chunk->size) - offsetof(mem_chunk, next));
+#ifdef JMEM_ALLOC_TRACKING
+        new_chunk->idx = chunk->idx;
+#endif
+        unmap_block(this, chunk);
+        block = chunk_mapped_block(new_chunk);
+#endif
+    }
+    record_resize(this, old_size, block->chunk.size);
+    return &block->chunk.next;
+}
 
+static void* reallocate_chunk(ill_allocator* this, void* ptr, uint_fast64_t new_size, uint_fast64_t alignment)
+{
+    //  Resizing in place keeps the address, so the alignment only needs to be considered when the block is moved
     mem_chunk* chunk = (void*)((uintptr_t)ptr - offsetof(mem_chunk, next));
+    if (chunk->mapped)
+    {
+        return reallocate_mapped(this, chunk, new_size, alignment);
+    }
+    if ((uintptr_t)ptr & (alignment - 1))
+    {
+        //  Block was not allocated with this alignment, so it has to be moved
+        void* new_ptr = allocate_chunk(this, new_size, alignment);
+        if (!new_ptr)
+        {
+            return NULL;
+        }
+        const uint_fast64_t copy_size = chunk->size < new_size ? chunk->size : new_size;
+        memcpy(new_ptr, ptr, copy_size - offsetof(mem_chunk, next));
+        ill_jfree(this, ptr);
+        return new_ptr;
+    }
     //  Try and find pool it came from
     mem_pool* pool = find_chunk_pool(this, ptr);
     //  Check if it came from a pool
     if (!pool)
     {
         //  It did not come from a pool
-        if (allocator->bad_alloc_callback)
+        if (this->bad_alloc_callback)
         {
-            allocator->bad_alloc_callback(allocator, allocator->bad_alloc_param);
+            this->bad_alloc_callback(this, this->bad_alloc_param);
         }
         return NULL;
     }
@@ -481,71 +1515,104 @@ void* ill_jrealloc(ill_allocator* allocator, void* ptr, uint_fast64_t new_size)
         return ptr;
     }
 
+    const uint_fast64_t old_size = chunk->size;
+    //  Check if current block can be expanded so that there's no moving it
+    if (new_size > chunk->size && !absorb_next_chunk(this, pool, chunk, new_size))
+    {
+        mem_chunk* const merged = absorb_previous_chunk(this, pool, chunk, new_size, alignment);
+        if (merged)
+        {
+            split_chunk_tail(this, pool, merged, new_size);
+            record_resize(this, old_size, merged->size);
+            return &merged->next;
+        }
+        //  Can not make use of any adjacent chunks, so allocate a new block, copy memory to it, free current block, then return the new block
+        void* new_ptr = allocate_chunk(this, new_size, alignment);
+        if (!new_ptr)
+        {
+            return NULL;
+        }
+        memcpy(new_ptr, ptr, chunk->size - offsetof(mem_chunk, next));
+        ill_jfree(this, ptr);
+        return new_ptr;
+    }
+    split_chunk_tail(this, pool, chunk, new_size);
+    record_resize(this, old_size, chunk->size);
+    return &chunk->next;
+}
+
+uint_fast64_t ill_usable_size(ill_allocator* allocator, const void* ptr)
+{
+    (void)allocator;
+    if (!ptr) return 0;
+    const mem_chunk* const chunk = (const void*)((uintptr_t)ptr - offsetof(mem_chunk, next));
+    return chunk->size - offsetof(mem_chunk, next);
+}
 
+int ill_try_expand(ill_allocator* allocator, void* ptr, uint_fast64_t new_size)
+{
+    ill_allocator* this = (ill_allocator*)allocator;
+    if (!ptr) return -1;
+    new_size = round_up_size(new_size);
+    mem_chunk* const chunk = (void*)((uintptr_t)ptr - offsetof(mem_chunk, next));
     const uint_fast64_t old_size = chunk->size;
-    //  Check if increasing or decreasing the chunk's size
-    if (new_size > chunk->size)
-    {
-        //  Increasing
-        //  Check if current block can be expanded so that there's no moving it
-        //  Location of potential candidate
-        mem_chunk* possible_chunk = (void*)(((uintptr_t)chunk) + chunk->size);
-        if (!((void*)possible_chunk >= pool->base                              //  Is the pointer in range?
-            && (uintptr_t)possible_chunk < (uintptr_t)pool->base + pool->free + pool->used //  Is the pointer in range?
-            && possible_chunk->used == 0                                         //  Is the other chunk in use
-            && possible_chunk->size + chunk->size >= new_size))               //  Is the other chunk large enough to accommodate us
-        {
-            //  Can not make use of any adjacent chunks, so allocate a new block, copy memory to it, free current block, then return the new block
-            void* new_ptr = ill_alloc(allocator, new_size - offsetof(mem_chunk, next));
-            memcpy(new_ptr, ptr, chunk->size - offsetof(mem_chunk, next));
-            ill_jfree(allocator, ptr);
-            return new_ptr;
-        }
-
-        //  All requirements met
-        //  Pull the chunk from the pool
-        remove_chunk_from_pool(pool, possible_chunk);
-        //  Join the two chunks together
-        chunk->size += possible_chunk->size;
-        //  Redo size check
-        goto size_check;
+    if (new_size <= old_size)
+    {
+        //  Already large enough, and shrinking is left to ill_jrealloc
+        return 0;
     }
-    else
+    if (chunk->mapped)
     {
-    size_check:
-        assert(chunk->size >= new_size);
-        //  Decreasing
-        //  Check if block can be split in two
-        const uint_fast64_t remainder = chunk->size - new_size;
-        if (remainder < sizeof(mem_chunk))
+#ifndef _WIN32
+        //  Mapping may only grow into the address space directly after it
+        mapped_block* const block = chunk_mapped_block(chunk);
+        const uint_fast64_t mapping_size = round_to_nearest_page_up(new_size + offsetof(mapped_block, chunk));
+        if (mremap(block, block->mapping_size, mapping_size, 0) == MAP_FAILED)
         {
-            //  Can not be split, return the original pointer
-            return ptr;
+            return -1;
         }
-        //  Split the chunk
-        mem_chunk* new_chunk = (void*)(((uintptr_t)chunk) + new_size);
-        chunk->size = new_size;
-        new_chunk->size = remainder;
-        new_chunk->used = 0;
-        //  Put the split chunk into the pool
-        insert_chunk_into_pool(pool, new_chunk);
+        block->mapping_size = mapping_size;
+        block->chunk.size = mapping_size - offsetof(mapped_block, chunk);
+        record_resize(this, old_size, block->chunk.size);
+        return 0;
+#else
+        return -1;
+#endif
+    }
+    mem_pool* const pool = find_chunk_pool(this, ptr);
+    if (!pool || !absorb_next_chunk(this, pool, chunk, new_size))
+    {
+        return -1;
     }
+    split_chunk_tail(this, pool, chunk, new_size);
+    record_resize(this, old_size, chunk->size);
+    return 0;
+}
 
+void* ill_jrealloc(ill_allocator* allocator, void* ptr, uint_fast64_t new_size)
+{
+    ill_allocator* this = (ill_allocator*)allocator;
+    if (!ptr)
+    {
+        return ill_alloc(allocator, new_size);
+    }
+    new_size = round_up_size(new_size);
+    return reallocate_chunk(this, ptr, new_size, ALIGN_SIZE);
+}
 
-#ifdef JMEM_ALLOC_TRACKING
-    this->current_allocated -= old_size;
-    this->current_allocated += new_size;
-    this->total_allocated += new_size > old_size ? new_size - old_size : 0;
-    if (this->current_allocated > this->max_allocated)
+void* ill_jrealloc_aligned(ill_allocator* allocator, void* ptr, uint_fast64_t new_size, uint_fast64_t alignment)
+{
+    ill_allocator* this = (ill_allocator*)allocator;
+    if (!ptr)
     {
-        this->max_allocated = this->current_allocated;
+        return ill_alloc_aligned(allocator, new_size, alignment);
     }
-    if (new_size > this->biggest_allocation)
+    if (alignment & (alignment - 1))
     {
-        this->biggest_allocation = new_size;
+        return NULL;
     }
-#endif
-    return &chunk->next;
+    new_size = round_up_size(new_size);
+    return reallocate_chunk(this, ptr, new_size, alignment > ALIGN_SIZE ? alignment : ALIGN_SIZE);
 }
 
 int ill_allocator_verify(ill_allocator* allocator, int_fast32_t* i_pool, int_fast32_t* i_block)
@@ -559,63 +1626,93 @@ int ill_allocator_verify(ill_allocator* allocator, int_fast32_t* i_pool, int_fas
 
     for (int_fast32_t i = 0, j = 0; i < this->count; ++i, j = -1)
     {
-        const mem_pool* pool = this->pools + i;
-        uint_fast32_t accounted_free_space = 0, accounted_used_space = 0;
-        //  Loop forward to verify forward links and free space
-        j = 0;
-        for (const mem_chunk* current = pool->smallest; current; current = current->next, ++j)
+        const mem_pool* pool = this->pools[i];
+        uint_fast64_t accounted_free_space = 0, accounted_used_space = 0;
+        VERIFICATION_CHECK(pool->fl_count == pool_fl_count(pool->size));
+        VERIFICATION_CHECK((uintptr_t)pool->base == (uintptr_t)pool + pool_header_size(pool->size));
+        VERIFICATION_CHECK(pool->used + pool->free == pool->size - pool_header_size(pool->size));
+        VERIFICATION_CHECK((pool->fl_bitmap >> pool->fl_count) == 0);
+        VERIFICATION_CHECK(pool->index == (uint_fast32_t)i);
+        if (pool->fl_bitmap)
         {
-            VERIFICATION_CHECK(current->prev || current == pool->smallest);
-            VERIFICATION_CHECK(!current->prev || current->size >= current->prev->size);
-            VERIFICATION_CHECK(!current->next || current->next->prev == current);
-            VERIFICATION_CHECK(current->used == 0);
-            VERIFICATION_CHECK(current->size >= sizeof(mem_chunk));
-            accounted_free_space += current->size;
+            const uint_fast32_t fl = bit_scan_reverse(pool->fl_bitmap);
+            VERIFICATION_CHECK(this->pool_classes[i] == fl * SL_INDEX_COUNT + bit_scan_reverse(pool->sl_bitmap[fl]) + 1);
         }
-        VERIFICATION_CHECK(accounted_free_space == pool->free);
-
-        accounted_free_space = 0;
-        //  Loop forward to verify backwards links and free space
+        else
+        {
+            VERIFICATION_CHECK(this->pool_classes[i] == 0);
+        }
+        const uint_fast32_t oversized = (this->flags & ILL_ALLOCATOR_ALIGNED_POOLS) && pool->size != this->pool_size;
+        if (oversized)
+        {
+            VERIFICATION_CHECK(find_oversized_pool(this, pool) == pool);
+        }
+        else if (this->flags & ILL_ALLOCATOR_ALIGNED_POOLS)
+        {
+            VERIFICATION_CHECK(((uintptr_t)pool & (this->pool_size - 1)) == 0);
+        }
+        //  Loop through every bin to verify the links, bitmaps and free space
         j = 0;
-        for (const mem_chunk* current = pool->largest; current; current = current->prev, ++j)
+        for (uint_fast32_t fl = 0; fl < pool->fl_count; ++fl)
         {
-            VERIFICATION_CHECK(current->next || current == pool->largest);
-            VERIFICATION_CHECK(!current->next || current->size <= current->next->size);
-            VERIFICATION_CHECK(!current->prev || current->prev->next == current);
-            VERIFICATION_CHECK(current->used == 0);
-            VERIFICATION_CHECK(current->size >= sizeof(mem_chunk));
-            accounted_free_space += current->size;
+            VERIFICATION_CHECK(((pool->fl_bitmap >> fl) & 1) == (pool->sl_bitmap[fl] != 0));
+            for (uint_fast32_t sl = 0; sl < SL_INDEX_COUNT; ++sl)
+            {
+                const mem_chunk* const head = pool->bins[fl * SL_INDEX_COUNT + sl];
+                VERIFICATION_CHECK(((pool->sl_bitmap[fl] >> sl) & 1) == (head != NULL));
+                for (const mem_chunk* current = head; current; current = current->next, ++j)
+                {
+                    VERIFICATION_CHECK(current->prev || current == head);
+                    VERIFICATION_CHECK(!current->next || current->next->prev == current);
+                    VERIFICATION_CHECK(current->used == 0);
+                    VERIFICATION_CHECK(current->size >= MIN_CHUNK_SIZE);
+                    uint_fast32_t chunk_fl, chunk_sl;
+                    mapping_insert(current->size, &chunk_fl, &chunk_sl);
+                    VERIFICATION_CHECK(chunk_fl == fl && chunk_sl == sl);
+                    accounted_free_space += current->size;
+                }
+            }
         }
         VERIFICATION_CHECK(accounted_free_space == pool->free);
 
         accounted_free_space = 0;
         j = 0;
-        //  Do a full walk through the whole block
-        for (void* current = pool->base; (uintptr_t)current < (uintptr_t)pool->base + this->pool_size; current = (void*)((uintptr_t)current + ((mem_chunk*)current)->size), j -= 1)
+        //  Do a full walk through the whole block, checking the boundary tags on the way
+        uint_fast32_t previous_used = 1;
+        for (void* current = pool->base; (uintptr_t)current < (uintptr_t)pool + pool->size; current = (void*)((uintptr_t)current + ((mem_chunk*)current)->size), j -= 1)
         {
             mem_chunk* chunk = current;
-            VERIFICATION_CHECK(chunk->size >= sizeof(mem_chunk));
-            VERIFICATION_CHECK((uintptr_t)current < (uintptr_t)pool->base + this->pool_size);
+            VERIFICATION_CHECK(chunk->size >= MIN_CHUNK_SIZE);
+            VERIFICATION_CHECK((uintptr_t)current + chunk->size <= (uintptr_t)pool + pool->size);
+            VERIFICATION_CHECK(chunk->prev_used == previous_used);
+            VERIFICATION_CHECK(chunk->oversized == oversized);
             if (chunk->used)
             {
                 accounted_used_space += chunk->size;
             }
             else
             {
+                //  Free chunks are always merged, so two can never be adjacent
+                VERIFICATION_CHECK(previous_used);
+                VERIFICATION_CHECK(*(const uint_fast64_t*)((uintptr_t)chunk + chunk->size - sizeof(uint_fast64_t)) == chunk->size);
                 accounted_free_space += chunk->size;
             }
-            if (chunk->used == 0)
-            {
-                if (chunk->next)
-                {
-                    VERIFICATION_CHECK(chunk->next->prev == chunk && chunk->size <= chunk->next->size);
-                }
-                if (chunk->prev)
-                {
-                    VERIFICATION_CHECK(chunk->prev->next == chunk && chunk->size >= chunk->prev->size);
-                }
-            }
+            previous_used = chunk->used;
         }
+        VERIFICATION_CHECK(accounted_free_space == pool->free);
+        VERIFICATION_CHECK(accounted_used_space == pool->used);
+    }
+
+    //  Mapped blocks are reported as pool -1
+    int_fast32_t i = -1, j = 0;
+    (void)i;
+    for (const mapped_block* block = this->mapped_blocks; block; block = block->next, ++j)
+    {
+        VERIFICATION_CHECK(block->prev || block == this->mapped_blocks);
+        VERIFICATION_CHECK(!block->next || block->next->prev == block);
+        VERIFICATION_CHECK((block->mapping_size & (PAGE_SIZE - 1)) == 0);
+        VERIFICATION_CHECK(block->chunk.size == block->mapping_size - offsetof(mapped_block, chunk));
+        VERIFICATION_CHECK(block->chunk.mapped && block->chunk.used && !block->chunk.oversized);
     }
     return 0;
 }
@@ -630,7 +1727,7 @@ uint_fast32_t ill_allocator_count_used_blocks(ill_allocator* allocator, uint_fas
     uint_fast32_t found = 0;
     for (uint_fast64_t i = 0; i < this->count; ++i)
     {
-        const mem_pool* pool = this->pools + i;
+        const mem_pool* pool = this->pools[i];
         const void* pos = pool->base;
         while (pos != pool->base + pool->used + pool->free)
         {
@@ -650,7 +1747,14 @@ uint_fast32_t ill_allocator_count_used_blocks(ill_allocator* allocator, uint_fas
             pos += chunk->size;
         }
     }
-
+    for (const mapped_block* block = this->mapped_blocks; block; block = block->next)
+    {
+        if (found < size_out_buffer)
+        {
+            out_buffer[found] = block->chunk.idx;
+        }
+        found += 1;
+    }
 
     return found;
 #endif
@@ -694,18 +1798,12 @@ int ill_allocator_set_debug_trap(ill_allocator* allocator, uint32_t index, void(
     return 1;
 }
 
-static inline uint_fast64_t check_for_aligned_size(mem_chunk* chunk, uint_fast64_t alignment, uint_fast64_t size)
+ill_allocator* ill_allocator_create(uint_fast64_t pool_size, uint_fast64_t initial_pool_count)
 {
-    void* ptr = (void*)&chunk->next;
-    uintptr_t extra = (uintptr_t)ptr & (alignment - 1);
-    if (!extra)
-    {
-        return size;
-    }
-    return size + (alignment - extra);
+    return ill_allocator_create_with_flags(pool_size, initial_pool_count, 0);
 }
 
-ill_allocator* ill_allocator_create(uint_fast64_t pool_size, uint_fast64_t initial_pool_count)
+ill_allocator* ill_allocator_create_with_flags(uint_fast64_t pool_size, uint_fast64_t initial_pool_count, uint_fast32_t flags)
 {
     if (!PAGE_SIZE)
     {
@@ -754,49 +1852,58 @@ ill_allocator* ill_allocator_create(uint_fast64_t pool_size, uint_fast64_t initi
         return NULL;
     }
 #endif
-
-    this->pool_size = round_to_nearest_page_up(pool_size);
-    for (uint_fast32_t i = 0; i < initial_pool_count; ++i)
-    {
-        mem_pool* p = this->pools + i;
+    this->class_buffer_size = round_to_nearest_page_up(this->capacity * sizeof(*this->pool_classes));
 #ifndef _WIN32
-        p->base = mmap(NULL, pool_size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
-        if (p->base == MAP_FAILED)
+    this->pool_classes = mmap(0, this->class_buffer_size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+    if (this->pool_classes == MAP_FAILED)
+    {
+        munmap(this->pools, this->pool_buffer_size);
+        munmap(this, round_to_nearest_page_up(sizeof(*this)));
+        return NULL;
+    }
 #else
-            p->base = VirtualAlloc(NULL, pool_size, MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
-        if (p->base == NULL)
+    this->pool_classes = VirtualAlloc(NULL, this->class_buffer_size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+    if (this->pool_classes == NULL)
+    {
+        VirtualFree(this->pools, 0, MEM_RELEASE);
+        VirtualFree(this, 0, MEM_RELEASE);
+        return NULL;
+    }
 #endif
+
+    this->flags = flags;
+    this->pool_size = (pool_size + pool_granularity(this) - 1) & ~(pool_granularity(this) - 1);
+    if (flags & ILL_ALLOCATOR_ALIGNED_POOLS)
+    {
+        //  Pools must be a power of two in size for masking to work
+        while (this->pool_size & (this->pool_size - 1))
+        {
+            this->pool_size += this->pool_size & ~(this->pool_size - 1);
+        }
+    }
+    for (uint_fast32_t i = 0; i < initial_pool_count; ++i)
+    {
+        mem_pool* const p = map_pool(this, this->pool_size);
+        if (!p)
         {
-            for (uint_fast32_t j = 0; j < i; ++j)
+            for (uint_fast32_t j = 0; j < this->count; ++j)
             {
-#ifndef _WIN32
-                munmap(this->pools[i].base, pool_size);
-#else
-                BOOL res = VirtualFree(this->pools[i].base, 0, MEM_RELEASE);
-                assert(res != 0);
-#endif
+                unmap_pool(this->pools[j]);
             }
 #ifndef _WIN32
+            munmap(this->pool_classes, this->class_buffer_size);
             munmap(this->pools, this->pool_buffer_size);
             munmap(this, round_to_nearest_page_up(sizeof(*this)));
 #else
+            VirtualFree(this->pool_classes, 0, MEM_RELEASE);
             VirtualFree(this->pools, 0, MEM_RELEASE);
             VirtualFree(this, 0, MEM_RELEASE);
 #endif
             return NULL;
         }
-        p->size = this->pool_size;
-        p->used = 0;
-        p->free = this->pool_size;
-        mem_chunk* c = p->base;
-        p->smallest = c;
-        p->largest = c;
-        c->used = 0;
-        c->prev = NULL;
-        c->next = NULL;
-        c->size = this->pool_size;
-    }
-    this->count = initial_pool_count;
+        //  Pool's index is taken from the count, so it must be incremented for each pool
+        this->pools[this->count++] = p;
+    }
 #ifdef JMEM_ALLOC_TRACKING
     this->biggest_allocation = 0;
     this->max_allocated = 0;
@@ -808,6 +1915,27 @@ ill_allocator* ill_allocator_create(uint_fast64_t pool_size, uint_fast64_t initi
     return this;
 }
 
+void ill_allocator_set_trim_policy(ill_allocator* allocator, uint_fast64_t spare_pools, uint_fast64_t delay)
+{
+    ill_allocator* this = (ill_allocator*)allocator;
+    this->auto_trim = 1;
+    this->spare_pools = spare_pools;
+    this->trim_delay = delay;
+    this->next_trim = this->free_count;
+}
+
+uint_fast64_t ill_allocator_trim(ill_allocator* allocator)
+{
+    ill_allocator* this = (ill_allocator*)allocator;
+    return trim_pools(this, 0);
+}
+
+void ill_allocator_set_mmap_threshold(ill_allocator* allocator, uint_fast64_t threshold)
+{
+    ill_allocator* this = (ill_allocator*)allocator;
+    this->mmap_threshold = threshold;
+}
+
 void
 ill_allocator_set_bad_alloc_callback(ill_allocator* allocator, void (* callback)(ill_allocator* allocator, void* param), void* param)
 {
@@ -821,3 +1949,11 @@ void ill_allocator_set_double_free_callback(
     allocator->double_free_callback = callback;
     allocator->double_free_param = param;
 }
+
+void ill_allocator_report_double_free(ill_allocator* allocator)
+{
+    if (allocator->double_free_callback)
+    {
+        allocator->double_free_callback(allocator, allocator->double_free_param);
+    }
+}
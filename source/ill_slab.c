@@ -0,0 +1,423 @@
+//
+// Created by jan on 17.10.2026.
+//
+
+#include "include/jmem/ill_slab.h"
+#include <assert.h>
+#include <string.h>
+#include <stddef.h>
+#ifndef _WIN32
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
+
+typedef struct slab_struct slab;
+//  Slab control block, which is placed at the very beginning of the slab's memory, followed by its objects
+struct slab_struct
+{
+    slab* next;
+    slab* prev;
+    void* free_list;
+    uint_fast32_t used;
+    uint_fast32_t carved;
+};
+
+//  Object memory starts after the control block
+enum {SLAB_HEADER_SIZE = (sizeof(slab) + 7) & ~(uint_fast64_t)7};
+//  Slabs are made large enough that the header is a small fraction of them
+enum {MIN_OBJECTS_PER_SLAB = 8};
+
+struct ill_slab_cache_struct
+{
+    ill_allocator* parent;
+    uint_fast64_t object_size;
+    uint_fast64_t slab_size;
+    uint_fast32_t objects_per_slab;
+    slab* partial;
+    slab* full;
+    slab* empty;
+    //  Open addressing hash table of all slabs, keyed by the slab's address divided by the slab size. Since slabs do not
+    //  overlap, only one slab can start in any such slab sized range, so the key is unique. An object lies either in
+    //  the range of its slab's key, or in the one directly after it.
+    slab** table;
+    uint_fast64_t table_capacity;
+    uint_fast64_t table_count;
+};
+
+static uint_fast64_t PAGE_SIZE = 0;
+
+static inline uint_fast64_t round_to_nearest_page_up(uint_fast64_t v)
+{
+    uint_fast64_t excess = v & (PAGE_SIZE - 1); //  Works BC PAGE_SIZE is a multiple of two
+    if (excess)
+    {
+        v += PAGE_SIZE - excess;
+    }
+    return v;
+}
+
+static inline uint_fast64_t slab_key(const ill_slab_cache* cache, const void* ptr)
+{
+    return (uintptr_t)ptr / cache->slab_size;
+}
+
+static inline uint_fast64_t slab_hash(const ill_slab_cache* cache, uint_fast64_t key)
+{
+    //  Multiplying by an odd constant keeps consecutive keys, which are very common, in distinct slots
+    return (key * 0x9E3779B97F4A7C15llu) & (cache->table_capacity - 1);
+}
+
+static inline void* slab_objects(const slab* s)
+{
+    return (void*)((uintptr_t)s + SLAB_HEADER_SIZE);
+}
+
+static void table_insert(slab** table, const ill_slab_cache* cache, slab* s)
+{
+    uint_fast64_t i = slab_hash(cache, slab_key(cache, s));
+    while (table[i])
+    {
+        i = (i + 1) & (cache->table_capacity - 1);
+    }
+    table[i] = s;
+}
+
+static int grow_table(ill_slab_cache* cache)
+{
+    const uint_fast64_t old_capacity = cache->table_capacity;
+    slab** const old_table = cache->table;
+    const uint_fast64_t new_capacity = old_capacity ? old_capacity * 2 : 16;
+    slab** const new_table = ill_alloc(cache->parent, new_capacity * sizeof(*new_table));
+    if (!new_table)
+    {
+        return 0;
+    }
+    memset(new_table, 0, new_capacity * sizeof(*new_table));
+    cache->table = new_table;
+    cache->table_capacity = new_capacity;
+    for (uint_fast64_t i = 0; i < old_capacity; ++i)
+    {
+        if (old_table[i])
+        {
+            table_insert(new_table, cache, old_table[i]);
+        }
+    }
+    ill_jfree(cache->parent, old_table);
+    return 1;
+}
+
+static void table_remove(ill_slab_cache* cache, const slab* s)
+{
+    const uint_fast64_t mask = cache->table_capacity - 1;
+    uint_fast64_t i = slab_hash(cache, slab_key(cache, s));
+    while (cache->table[i] != s)
+    {
+        assert(cache->table[i]);
+        i = (i + 1) & mask;
+    }
+    //  Shift back any entries which would no longer be reachable once there is a hole at i
+    for (uint_fast64_t j = (i + 1) & mask; cache->table[j]; j = (j + 1) & mask)
+    {
+        const uint_fast64_t home = slab_hash(cache, slab_key(cache, cache->table[j]));
+        //  Entry at j may move to i only if its home is not cyclically within (i, j]
+        if (((j - home) & mask) >= ((j - i) & mask))
+        {
+            cache->table[i] = cache->table[j];
+            i = j;
+        }
+    }
+    cache->table[i] = NULL;
+    cache->table_count -= 1;
+}
+
+static slab* find_slab_with_key(const ill_slab_cache* cache, const void* ptr, uint_fast64_t key)
+{
+    for (uint_fast64_t i = slab_hash(cache, key); cache->table[i]; i = (i + 1) & (cache->table_capacity - 1))
+    {
+        slab* const s = cache->table[i];
+        if (slab_key(cache, s) == key)
+        {
+            //  Key is unique, so this is the only candidate
+            return (uintptr_t)ptr >= (uintptr_t)s && (uintptr_t)ptr < (uintptr_t)s + cache->slab_size ? s : NULL;
+        }
+    }
+    return NULL;
+}
+
+static inline slab* find_slab(const ill_slab_cache* cache, const void* ptr)
+{
+    const uint_fast64_t key = slab_key(cache, ptr);
+    slab* s = find_slab_with_key(cache, ptr, key);
+    if (!s && key)
+    {
+        s = find_slab_with_key(cache, ptr, key - 1);
+    }
+    return s;
+}
+
+static inline void list_push(slab** p_head, slab* s)
+{
+    s->prev = NULL;
+    s->next = *p_head;
+    if (*p_head)
+    {
+        (*p_head)->prev = s;
+    }
+    *p_head = s;
+}
+
+static inline void list_remove(slab** p_head, slab* s)
+{
+    if (s->next)
+    {
+        s->next->prev = s->prev;
+    }
+    if (s->prev)
+    {
+        s->prev->next = s->next;
+    }
+    else
+    {
+        assert(*p_head == s);
+        *p_head = s->next;
+    }
+}
+
+static slab* create_slab(ill_slab_cache* cache)
+{
+    //  Keep the load factor of the table at most one half
+    if ((cache->table_count + 1) * 2 > cache->table_capacity && !grow_table(cache))
+    {
+        return NULL;
+    }
+    slab* const s = ill_alloc(cache->parent, cache->slab_size);
+    if (!s)
+    {
+        return NULL;
+    }
+    s->next = NULL;
+    s->prev = NULL;
+    s->free_list = NULL;
+    s->used = 0;
+    s->carved = 0;
+    table_insert(cache->table, cache, s);
+    cache->table_count += 1;
+    return s;
+}
+
+static void destroy_slab(ill_slab_cache* cache, slab* s)
+{
+    table_remove(cache, s);
+    ill_jfree(cache->parent, s);
+}
+
+ill_slab_cache* ill_slab_cache_create(ill_allocator* parent, uint_fast64_t object_size)
+{
+    if (!PAGE_SIZE)
+    {
+#ifndef _WIN32
+        PAGE_SIZE = sysconf(_SC_PAGESIZE);
+#else
+        SYSTEM_INFO sys_info;
+        GetSystemInfo(&sys_info);
+        PAGE_SIZE = (long) sys_info.dwPageSize;
+#endif
+        //  Check that we have the page size
+        if (!PAGE_SIZE)
+        {
+            return NULL;
+        }
+    }
+    if (!object_size)
+    {
+        return NULL;
+    }
+    //  Slab size must not overflow, even once rounded up to a whole page
+    const uint_fast64_t max_object_size =
+            (((UINT64_MAX & ~(PAGE_SIZE - 1)) - SLAB_HEADER_SIZE) / MIN_OBJECTS_PER_SLAB) & ~(uint_fast64_t)7;
+    if (object_size > max_object_size)
+    {
+        return NULL;
+    }
+    //  Free objects hold the free list link, so they must fit a pointer
+    object_size = (object_size + 7) & ~(uint_fast64_t)7;
+    if (object_size < sizeof(void*))
+    {
+        object_size = sizeof(void*);
+    }
+
+    ill_slab_cache* const this = ill_alloc(parent, sizeof(*this));
+    if (!this)
+    {
+        return NULL;
+    }
+    *this = (ill_slab_cache){0};
+    this->parent = parent;
+    this->object_size = object_size;
+    this->slab_size = round_to_nearest_page_up(SLAB_HEADER_SIZE + MIN_OBJECTS_PER_SLAB * object_size);
+    this->objects_per_slab = (this->slab_size - SLAB_HEADER_SIZE) / object_size;
+    return this;
+}
+
+static void destroy_slab_list(ill_slab_cache* cache, slab* s)
+{
+    while (s)
+    {
+        slab* const next = s->next;
+        ill_jfree(cache->parent, s);
+        s = next;
+    }
+}
+
+void ill_slab_cache_destroy(ill_slab_cache* cache)
+{
+    ill_slab_cache* this = (ill_slab_cache*)cache;
+    destroy_slab_list(this, this->partial);
+    destroy_slab_list(this, this->full);
+    destroy_slab_list(this, this->empty);
+    ill_jfree(this->parent, this->table);
+    ill_jfree(this->parent, this);
+}
+
+void* ill_slab_alloc(ill_slab_cache* cache)
+{
+    ill_slab_cache* this = (ill_slab_cache*)cache;
+    slab* s = this->partial;
+    if (!s)
+    {
+        //  Reuse the kept empty slab before asking the parent for a new one
+        s = this->empty;
+        if (s)
+        {
+            list_remove(&this->empty, s);
+        }
+        else
+        {
+            s = create_slab(this);
+            if (!s)
+            {
+                return NULL;
+            }
+        }
+        list_push(&this->partial, s);
+    }
+
+    void* ptr;
+    if (s->free_list)
+    {
+        ptr = s->free_list;
+        s->free_list = *(void**)ptr;
+    }
+    else
+    {
+        //  Objects which were never handed out are carved lazily, so a new slab needs no initialization
+        assert(s->carved < this->objects_per_slab);
+        ptr = (void*)((uintptr_t)slab_objects(s) + s->carved * this->object_size);
+        s->carved += 1;
+    }
+    s->used += 1;
+    if (s->used == this->objects_per_slab)
+    {
+        list_remove(&this->partial, s);
+        list_push(&this->full, s);
+    }
+    return ptr;
+}
+
+void ill_slab_free(ill_slab_cache* cache, void* ptr)
+{
+    ill_slab_cache* this = (ill_slab_cache*)cache;
+    if (!ptr) return;
+    slab* const s = find_slab(this, ptr);
+    if (!s)
+    {
+        assert(0);
+        return;
+    }
+    assert(((uintptr_t)ptr - (uintptr_t)slab_objects(s)) % this->object_size == 0);
+#ifndef NDEBUG
+    //  Object which was never handed out, or which is already on the free list, is a double free. Pushing it would
+    //  leave the count of used objects wrong, so the slab could be released while some of its objects are still live.
+    int is_free = (uintptr_t)ptr >= (uintptr_t)slab_objects(s) + s->carved * this->object_size;
+    for (const void* obj = s->free_list; obj && !is_free; obj = *(void* const*)obj)
+    {
+        is_free = obj == ptr;
+    }
+    if (is_free)
+    {
+        ill_allocator_report_double_free(this->parent);
+        return;
+    }
+#endif
+    *(void**)ptr = s->free_list;
+    s->free_list = ptr;
+    if (s->used == this->objects_per_slab)
+    {
+        list_remove(&this->full, s);
+        list_push(&this->partial, s);
+    }
+    s->used -= 1;
+    if (s->used == 0)
+    {
+        list_remove(&this->partial, s);
+        if (!this->empty)
+        {
+            list_push(&this->empty, s);
+        }
+        else
+        {
+            destroy_slab(this, s);
+        }
+    }
+}
+
+int ill_slab_cache_verify(ill_slab_cache* cache)
+{
+    ill_slab_cache* this = (ill_slab_cache*)cache;
+#ifndef NDEBUG
+#define VERIFICATION_CHECK(x) assert(x)
+#else
+#define VERIFICATION_CHECK(x) if (!(x)) { return -1;} (void)0
+#endif
+    uint_fast64_t slab_count = 0;
+    slab* const lists[3] = {this->partial, this->full, this->empty};
+    for (uint_fast32_t i = 0; i < 3; ++i)
+    {
+        for (const slab* s = lists[i]; s; s = s->next)
+        {
+            VERIFICATION_CHECK(!s->next || s->next->prev == s);
+            VERIFICATION_CHECK(find_slab(this, s) == s);
+            VERIFICATION_CHECK(find_slab(this, (void*)((uintptr_t)s + this->slab_size - 1)) == s);
+            VERIFICATION_CHECK(s->carved <= this->objects_per_slab);
+            VERIFICATION_CHECK(s->used <= s->carved);
+            //  Every carved object is either used or on the free list
+            uint_fast64_t free_count = 0;
+            for (const void* obj = s->free_list; obj; obj = *(void* const*)obj)
+            {
+                VERIFICATION_CHECK((uintptr_t)obj >= (uintptr_t)slab_objects(s));
+                VERIFICATION_CHECK((uintptr_t)obj < (uintptr_t)slab_objects(s) + s->carved * this->object_size);
+                free_count += 1;
+                VERIFICATION_CHECK(free_count <= s->carved);
+            }
+            VERIFICATION_CHECK(free_count + s->used == s->carved);
+            switch (i)
+            {
+            case 0:
+                VERIFICATION_CHECK(s->used > 0 && s->used < this->objects_per_slab);
+                break;
+            case 1:
+                VERIFICATION_CHECK(s->used == this->objects_per_slab);
+                break;
+            default:
+                VERIFICATION_CHECK(s->used == 0);
+                break;
+            }
+            slab_count += 1;
+        }
+    }
+    VERIFICATION_CHECK(!this->empty || !this->empty->next);
+    VERIFICATION_CHECK(slab_count == this->table_count);
+#undef VERIFICATION_CHECK
+    return 0;
+}
@@ -21,6 +21,35 @@ typedef struct ill_allocator_struct ill_allocator;
  */
 ill_allocator* ill_allocator_create(uint_fast64_t pool_size, uint_fast64_t initial_pool_count);
 
+/**
+ * Flags which can be passed to ill_allocator_create_with_flags
+ */
+enum ill_allocator_flags
+{
+    /**
+     * Pool size is rounded up to a power of two and pools are mapped at addresses aligned to it, so that the pool of a
+     * block can be found by masking its address. This keeps ill_jfree and ill_jrealloc constant time regardless of
+     * the number of pools. Pointers not allocated by the allocator must not be passed to it.
+     */
+    ILL_ALLOCATOR_ALIGNED_POOLS = 1 << 0,
+    /**
+     * Pools are backed by huge pages and their size is rounded up to a multiple of 2 MiB, which reduces TLB misses with
+     * large heaps. Explicit huge pages (MAP_HUGETLB) are used if the system has any reserved, otherwise transparent huge
+     * pages are requested with madvise. Ignored on Windows, where large pages need special privileges.
+     */
+    ILL_ALLOCATOR_HUGE_PAGES = 1 << 1,
+};
+
+/**
+ * Creates a new memory allocator the same way as ill_allocator_create, but with additional options.
+ * @param pool_size default size of pools (gets rounded up to nearest PAGE_SIZE, or huge page size with
+ * ILL_ALLOCATOR_HUGE_PAGES)
+ * @param initial_pool_count number of memory pools to allocate in advance
+ * @param flags combination of values from ill_allocator_flags
+ * @return NULL on failure, otherwise a valid pointer to the allocator
+ */
+ill_allocator* ill_allocator_create_with_flags(uint_fast64_t pool_size, uint_fast64_t initial_pool_count, uint_fast32_t flags);
+
 /**
  * Verify that memory allocator is working as intended and that no corruptions occurred
  * @param allocator pointer to a valid allocator
@@ -52,6 +81,38 @@ void ill_jfree(ill_allocator* allocator, void* ptr);
  */
 void* ill_alloc(ill_allocator* allocator, uint_fast64_t size);
 
+/**
+ * Allocates <b>count</b> blocks of memory at once, the i-th one valid for at least <b>sizes[i]</b> bytes. Small blocks are
+ * carved out of a few large free chunks, so the search for free memory is done once per group of blocks instead of
+ * once per block. Blocks are freed individually as usual. Not thread safe.
+ * @param allocator allocator from which the allocations are made
+ * @param count number of blocks to allocate
+ * @param sizes array of <b>count</b> sizes of blocks in bytes
+ * @param out_ptrs array which receives <b>count</b> pointers to the allocated blocks
+ * @return 0 on success, -1 on failure, in which case no block is allocated and all of <b>out_ptrs</b> are set to NULL
+ */
+int ill_alloc_batch(ill_allocator* allocator, uint_fast64_t count, const uint_fast64_t* sizes, void** out_ptrs);
+
+/**
+ * Allocates <b>count</b> blocks of memory at once, each valid for at least <b>size</b> bytes. Works the same way as
+ * ill_alloc_batch. Not thread safe.
+ * @param allocator allocator from which the allocations are made
+ * @param count number of blocks to allocate
+ * @param size size of each block in bytes
+ * @param out_ptrs array which receives <b>count</b> pointers to the allocated blocks
+ * @return 0 on success, -1 on failure, in which case no block is allocated and all of <b>out_ptrs</b> are set to NULL
+ */
+int ill_alloc_batch_uniform(ill_allocator* allocator, uint_fast64_t count, uint_fast64_t size, void** out_ptrs);
+
+/**
+ * Frees <b>count</b> blocks at once. Pointers are sorted by address, so that blocks which are physically adjacent
+ * are merged and returned to their pool together. Not thread safe.
+ * @param allocator allocator from which the blocks were allocated
+ * @param count number of blocks to free
+ * @param ptrs array of <b>count</b> pointers to blocks (any of which may be null), which gets sorted by address
+ */
+void ill_jfree_batch(ill_allocator* allocator, uint_fast64_t count, void** ptrs);
+
 /**
  * (Re-)allocates a block of memory if possible to a <b>new_size</b>. Not thread safe.
  * @param allocator allocator from which the allocation is made
@@ -61,6 +122,46 @@ void* ill_alloc(ill_allocator* allocator, uint_fast64_t size);
  */
 void* ill_jrealloc(ill_allocator* allocator, void* ptr, uint_fast64_t new_size);
 
+/**
+ * Returns the number of bytes which can actually be used in a block, which may be more than was requested
+ * @param allocator allocator from which the block was allocated
+ * @param ptr pointer to a block previously (re-)allocated or NULL
+ * @return size of the block's memory in bytes, or 0 if <b>ptr</b> is NULL
+ */
+uint_fast64_t ill_usable_size(ill_allocator* allocator, const void* ptr);
+
+/**
+ * Grows a block to at least <b>new_size</b> bytes without moving it, which is possible only when the memory directly
+ * after it is free. Unlike ill_jrealloc, the block is never moved, so the call can fail when there is still plenty
+ * of memory available. Block is never shrunk. Not thread safe.
+ * @param allocator allocator from which the block was allocated
+ * @param ptr pointer to a block previously (re-)allocated
+ * @param new_size size to which to grow the block to
+ * @return 0 if the block is now at least <b>new_size</b> bytes large, -1 if it could not be grown and was left as is
+ */
+int ill_try_expand(ill_allocator* allocator, void* ptr, uint_fast64_t new_size);
+
+/**
+ * Allocates a block of memory, valid for at least <b>size</b> bytes, with its address a multiple of <b>alignment</b>.
+ * Any padding needed in front of the block is returned to the allocator as a free chunk. Not thread safe.
+ * @param allocator allocator from which the allocation is made
+ * @param size size of the block to be allocated in bytes
+ * @param alignment required alignment of the block, which must be a power of two
+ * @return pointer to a valid block of memory on success, NULL on failure
+ */
+void* ill_alloc_aligned(ill_allocator* allocator, uint_fast64_t size, uint_fast64_t alignment);
+
+/**
+ * (Re-)allocates a block of memory if possible to a <b>new_size</b>, so that its address is a multiple of
+ * <b>alignment</b>. If the block is moved, the new block has the same alignment. Not thread safe.
+ * @param allocator allocator from which the allocation is made
+ * @param ptr either a pointer to a block previously (re-)allocated or NULL
+ * @param new_size size to which to resize the block to
+ * @param alignment required alignment of the block, which must be a power of two
+ * @return pointer to a valid block of memory on success, NULL on failure
+ */
+void* ill_jrealloc_aligned(ill_allocator* allocator, void* ptr, uint_fast64_t new_size, uint_fast64_t alignment);
+
 /**
  * Counts the total number of used blocks which are currently marked as allocated. Useful for tracking memory leaks.
  * Not thread safe.
@@ -92,8 +193,42 @@ void ill_allocator_statistics(
  */
 int ill_allocator_set_debug_trap(ill_allocator* allocator, uint32_t index, void(*callback_function)(uint32_t index, void* param), void* param);
 
+/**
+ * Enables releasing of empty pools back to the OS. Whenever a pool becomes empty, pools which have been empty for at
+ * least <b>delay</b> calls to ill_jfree are unmapped, apart from <b>spare_pools</b> pools of the default size, which
+ * are kept to avoid repeatedly mapping and unmapping pools. By default no pools are released. Not thread safe.
+ * @param allocator allocator to configure
+ * @param spare_pools number of empty pools of the default size to keep
+ * @param delay number of frees a pool must remain empty for before it is released
+ */
+void ill_allocator_set_trim_policy(ill_allocator* allocator, uint_fast64_t spare_pools, uint_fast64_t delay);
+
+/**
+ * Immediately unmaps all empty pools, apart from the number of spare pools set by ill_allocator_set_trim_policy (none
+ * if it was not called). Not thread safe.
+ * @param allocator allocator to trim
+ * @return number of bytes returned to the OS
+ */
+uint_fast64_t ill_allocator_trim(ill_allocator* allocator);
+
+/**
+ * Sets the size at and above which blocks are not placed in pools, but are given a mapping of their own instead. Such
+ * blocks are unmapped as soon as they are freed, and are resized with mremap, which avoids copying their contents. Their
+ * memory is aligned to 32 bytes, so aligned allocations with larger alignments always use pools. Not thread safe.
+ * @param allocator allocator to configure
+ * @param threshold size in bytes from which blocks get their own mapping, or 0 to always use pools (the default)
+ */
+void ill_allocator_set_mmap_threshold(ill_allocator* allocator, uint_fast64_t threshold);
+
 void ill_allocator_set_bad_alloc_callback(ill_allocator* allocator, void(*callback)(ill_allocator* allocator, void* param), void* param);
 
 void ill_allocator_set_double_free_callback(ill_allocator* allocator, void(*callback)(ill_allocator* allocator, void* param), void* param);
 
+/**
+ * Calls the allocator's double free callback, if one is set. Meant for allocators built on top of this one, such as
+ * ill_slab_cache, which find double frees of their own objects.
+ * @param allocator allocator whose callback should be called
+ */
+void ill_allocator_report_double_free(ill_allocator* allocator);
+
 #endif //JMEM_ILL_ALLOC_H
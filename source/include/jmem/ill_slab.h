@@ -0,0 +1,52 @@
+//
+// Created by jan on 17.10.2026.
+//
+
+#ifndef JMEM_ILL_SLAB_H
+#define JMEM_ILL_SLAB_H
+#include "ill_alloc.h"
+
+/**
+ *  Cache of fixed size objects, which are carved from slabs allocated from a parent ill_allocator. Allocating and
+ *  freeing an object takes constant time and needs no per-object header. Slabs which become empty are returned to the
+ *  parent allocator, apart from one which is kept to avoid repeatedly allocating and freeing a slab at the boundary.
+ *  Not thread safe.
+ */
+typedef struct ill_slab_cache_struct ill_slab_cache;
+
+/**
+ * Creates a new object cache which allocates its slabs from the parent allocator
+ * @param parent allocator from which slabs and the cache itself are allocated. Must outlive the cache
+ * @param object_size size of each object in bytes (gets rounded up to a multiple of 8)
+ * @return NULL on failure, otherwise a valid pointer to the cache
+ */
+ill_slab_cache* ill_slab_cache_create(ill_allocator* parent, uint_fast64_t object_size);
+
+/**
+ * Destroys the cache and returns all of its slabs to the parent allocator. Any objects still allocated become invalid
+ * @param cache pointer to a valid cache
+ */
+void ill_slab_cache_destroy(ill_slab_cache* cache);
+
+/**
+ * Allocates a single object from the cache
+ * @param cache cache from which the object is allocated
+ * @return pointer to an object of the cache's object size on success, NULL on failure
+ */
+void* ill_slab_alloc(ill_slab_cache* cache);
+
+/**
+ * Returns an object back to the cache
+ * @param cache cache from which the object was allocated
+ * @param ptr pointer to the object (may be null)
+ */
+void ill_slab_free(ill_slab_cache* cache, void* ptr);
+
+/**
+ * Verify that the cache is consistent and that no corruptions occurred
+ * @param cache pointer to a valid cache
+ * @return 0 on success, -1 on failure
+ */
+int ill_slab_cache_verify(ill_slab_cache* cache);
+
+#endif //JMEM_ILL_SLAB_H
@@ -5,6 +5,9 @@
 #ifndef JMEM_JMEM_H
 #define JMEM_JMEM_H
 #include "ill_alloc.h"
+#include "ill_slab.h"
 #include "lin_alloc.h"
 #include "shm_ill_alloc.h"
+#include "shm_block_pool.h"
+#include "shm_channel.h"
 #endif //JMEM_JMEM_H
@@ -28,6 +28,41 @@ typedef struct lin_allocator_struct lin_allocator;
  */
 lin_allocator* lin_allocator_create(uint_fast64_t total_size);
 
+/**
+ * Flags which can be passed to lin_allocator_create_with_flags
+ */
+enum lin_allocator_flags
+{
+    /**
+     * Allocator's memory is backed by huge pages and its size is rounded up to a multiple of 2 MiB. Explicit huge pages
+     * (MAP_HUGETLB) are used if the system has any reserved, otherwise transparent huge pages are requested with
+     * madvise. Ignored on Windows, where large pages need special privileges.
+     */
+    LIN_ALLOCATOR_HUGE_PAGES = 1 << 0,
+
+    /**
+     * Total size of the allocator is only reserved as address space, and memory is committed as allocations grow past
+     * it, so an allocator can be given a very large size with no up-front memory cost. Memory is not decommitted unless
+     * a watermark is set with lin_allocator_set_decommit_watermark.
+     */
+    LIN_ALLOCATOR_COMMIT_ON_DEMAND = 1 << 1,
+
+    /**
+     * When the allocator runs out of memory, a new block is mapped and linked to it instead of failing. Each new block is
+     * twice the size of the previous one. Blocks are released once all their allocations are freed, so freeing and
+     * restoring state works across block boundaries.
+     */
+    LIN_ALLOCATOR_CHAINED = 1 << 2,
+};
+
+/**
+ * Creates a new linear memory allocator the same way as lin_allocator_create, but with additional options.
+ * @param total_size minimum size of the linear allocator
+ * @param flags combination of values from lin_allocator_flags
+ * @return NULL on failure, otherwise a pointer to a valid linear allocator
+ */
+lin_allocator* lin_allocator_create_with_flags(uint_fast64_t total_size, uint_fast32_t flags);
+
 /**
  * Destroys the allocator and releases all of its memory
  * @param allocator memory allocator to destroy
@@ -42,6 +77,34 @@ void lin_allocator_destroy(lin_allocator* allocator);
  */
 void* lin_alloc(lin_allocator* allocator, uint_fast64_t size);
 
+/**
+ * Allocates a block of memory, valid for at least specified size, with its address a multiple of the alignment. Padding
+ * needed to align the block is reclaimed once the block allocated before it is freed. Must be freed in FOLI manner. Not
+ * thread safe.
+ * @param allocator allocator to use for the allocation
+ * @param size size of the block that should be returned by the function
+ * @param alignment required alignment of the block, which must be a power of two
+ * @return NULL on failure, a pointer to a valid block of memory on success
+ */
+void* lin_alloc_aligned(lin_allocator* allocator, uint_fast64_t size, uint_fast64_t alignment);
+
+/**
+ * Allocates a block of memory, valid for at least specified size. Thread safe with respect to other calls to
+ * lin_alloc_atomic, so many threads can allocate from the same allocator. Blocks allocated this way can not be freed
+ * individually, only all at once with lin_allocator_reset or lin_allocator_restore_current, once no other thread is
+ * allocating. Fails for allocators created with LIN_ALLOCATOR_COMMIT_ON_DEMAND or LIN_ALLOCATOR_CHAINED.
+ * @param allocator allocator to use for the allocation
+ * @param size size of the block that should be returned by the function
+ * @return NULL on failure, a pointer to a valid block of memory on success
+ */
+void* lin_alloc_atomic(lin_allocator* allocator, uint_fast64_t size);
+
+/**
+ * Frees all blocks allocated by the allocator at once. Not thread safe.
+ * @param allocator allocator which should be reset
+ */
+void lin_allocator_reset(lin_allocator* allocator);
+
 /**
  * Frees a block which was the most recently allocated by the allocator. Must be freed in FOLI manner. Not thread safe.
  * @param allocator allocator from which the block came from
@@ -61,7 +124,8 @@ void* lin_jrealloc(lin_allocator* allocator, void* ptr, uint_fast64_t new_size);
 
 /**
  * Obtains the current allocator base, which can be used to reset the allocator's state at a later point. Can be used to
- * leave function abruptly with quick cleanup.
+ * leave function abruptly with quick cleanup. With LIN_ALLOCATOR_CHAINED, the returned pointer also identifies the block of the
+ * chain it belongs to, since blocks never overlap.
  * @param allocator allocator whose base should be returned
  * @return base pointer of the allocator
  */
@@ -74,4 +138,12 @@ void* lin_allocator_save_state(lin_allocator* allocator);
  */
 void lin_allocator_restore_current(lin_allocator* allocator, void* ptr);
 
+/**
+ * Sets how much memory above the top of the stack is kept committed when blocks are freed by an allocator created with
+ * LIN_ALLOCATOR_COMMIT_ON_DEMAND. Memory above that is returned to the system. Has no effect on other allocators.
+ * @param allocator allocator whose watermark should be set
+ * @param watermark number of bytes to keep committed above the top of the stack, or UINT64_MAX to never decommit
+ */
+void lin_allocator_set_decommit_watermark(lin_allocator* allocator, uint_fast64_t watermark);
+
 #endif //JMEM_LIN_ALLOC_H
@@ -0,0 +1,58 @@
+//
+// Created by jan on 17.10.2026.
+//
+
+#ifndef JMEM_SHM_BLOCK_POOL_H
+#define JMEM_SHM_BLOCK_POOL_H
+#include "shm_ill_alloc.h"
+
+/**
+ *  Pool of fixed size blocks in shared memory, which are carved from segments allocated from a parent shm_ill_allocator.
+ *  Free blocks are kept on a lock-free stack, so allocating or freeing a block is a single compare-and-swap, which any
+ *  thread of any process sharing the parent may do at the same time without taking the parent's lock. The pool only
+ *  refers to its memory by offsets, so it works wherever the parent is mapped. Segments are never returned to the
+ *  parent before the pool is destroyed. Segments added after a fork are only visible to other processes if the parent
+ *  was created with shm_ill_allocator_create_reserved (or if they called shm_ill_allocator_refresh on a named parent),
+ *  so with other parents the pool should be created with enough blocks up front.
+ */
+typedef struct shm_block_pool_struct shm_block_pool;
+
+/**
+ * Creates a new block pool, which allocates itself and its segments from the parent allocator
+ * @param parent allocator from which segments and the pool itself are allocated. Must outlive the pool
+ * @param block_size size of each block in bytes (gets rounded up to a multiple of 8)
+ * @param initial_block_count number of blocks the first segment holds at least, which is allocated right away
+ * @return NULL on failure, otherwise a valid pointer to the pool
+ */
+shm_block_pool* shm_block_pool_create(shm_ill_allocator* parent, uint_fast64_t block_size, uint_fast64_t initial_block_count);
+
+/**
+ * Destroys the pool and returns all of its segments to the parent allocator. Any blocks still allocated become invalid,
+ * and no other thread or process may be using the pool at the time
+ * @param pool pointer to a valid pool
+ */
+void shm_block_pool_destroy(shm_block_pool* pool);
+
+/**
+ * Allocates a single block from the pool
+ * @param pool pool from which the block is allocated
+ * @return pointer to a block of the pool's block size on success, NULL on failure
+ */
+void* shm_block_alloc(shm_block_pool* pool);
+
+/**
+ * Returns a block back to the pool
+ * @param pool pool from which the block was allocated
+ * @param ptr pointer to the block (may be null)
+ */
+void shm_block_free(shm_block_pool* pool, void* ptr);
+
+/**
+ * Verify that the pool is consistent and that no corruptions occurred. No other thread or process may be using the
+ * pool at the time
+ * @param pool pointer to a valid pool
+ * @return 0 on success, -1 on failure
+ */
+int shm_block_pool_verify(shm_block_pool* pool);
+
+#endif //JMEM_SHM_BLOCK_POOL_H
@@ -0,0 +1,101 @@
+//
+// Created by jan on 17.10.2026.
+//
+
+#ifndef JMEM_SHM_CHANNEL_H
+#define JMEM_SHM_CHANNEL_H
+#include "shm_ill_alloc.h"
+
+/**
+ *  Bounded queue of pointers to memory from a shm_ill_allocator, which lives in that allocator's memory, so that it
+ *  can be used by every process sharing the allocator. Only the offset of each block is stored in the queue, so the
+ *  block itself is handed over without being copied, and it may be mapped at a different address in the receiving
+ *  process. Any number of threads and processes may send and receive at once, unless the channel is created with
+ *  flags promising otherwise. Blocking calls wait on a futex, so the memory must be shared with the other processes
+ *  (MAP_SHARED), which is the case for all shm_ill_allocator memory. Not available on Windows.
+ */
+typedef struct shm_channel_struct shm_channel;
+
+/**
+ * Flags which promise how the channel is going to be used, given to shm_channel_create
+ */
+enum shm_channel_flags
+{
+    /**
+     * Only one thread of one process sends at any time, so sending needs no compare-and-swap.
+     */
+    SHM_CHANNEL_SINGLE_PRODUCER = 1 << 0,
+    /**
+     * Only one thread of one process receives at any time, so receiving needs no compare-and-swap.
+     */
+    SHM_CHANNEL_SINGLE_CONSUMER = 1 << 1,
+};
+
+/**
+ * Creates a new channel, which is allocated from the parent allocator
+ * @param parent allocator from which the channel is allocated and whose blocks are sent through it. Must outlive the
+ * channel
+ * @param capacity most pointers the channel holds at once (gets rounded up to a power of two)
+ * @param flags combination of values from shm_channel_flags
+ * @return NULL on failure, otherwise a valid pointer to the channel
+ */
+shm_channel* shm_channel_create(shm_ill_allocator* parent, uint_fast32_t capacity, uint_fast32_t flags);
+
+/**
+ * Destroys the channel and returns its memory to the parent allocator. Blocks still in the channel are not freed. No
+ * other thread or process may be using the channel at the time
+ * @param channel pointer to a valid channel
+ */
+void shm_channel_destroy(shm_channel* channel);
+
+/**
+ * Closes the channel, after which nothing more can be sent. Pointers already in the channel may still be received,
+ * after which receiving fails. Everyone blocked on the channel is woken. Pointers sent at the same time as the channel
+ * is closed may be left in it.
+ * @param channel pointer to a valid channel
+ */
+void shm_channel_close(shm_channel* channel);
+
+/**
+ * Sends a pointer through the channel, if there is room for it
+ * @param channel channel to send the pointer through
+ * @param ptr pointer to memory from the channel's parent allocator (may be null)
+ * @return 0 on success, -1 if the channel is full or closed
+ */
+int shm_channel_try_send(shm_channel* channel, void* ptr);
+
+/**
+ * Sends a pointer through the channel, waiting for room if it is full
+ * @param channel channel to send the pointer through
+ * @param ptr pointer to memory from the channel's parent allocator (may be null)
+ * @return 0 on success, -1 if the channel is closed
+ */
+int shm_channel_send(shm_channel* channel, void* ptr);
+
+/**
+ * Receives a pointer from the channel, if there is any in it
+ * @param channel channel to receive the pointer from
+ * @param p_ptr receives the pointer, valid in the calling process
+ * @return 0 on success, -1 if the channel is empty
+ */
+int shm_channel_try_recv(shm_channel* channel, void** p_ptr);
+
+/**
+ * Receives a pointer from the channel, waiting for one if it is empty
+ * @param channel channel to receive the pointer from
+ * @param p_ptr receives the pointer, valid in the calling process
+ * @return 0 on success, -1 if the channel is closed and empty
+ */
+int shm_channel_recv(shm_channel* channel, void** p_ptr);
+
+/**
+ * Receives as many pointers from the channel as are in it, up to max_count, waiting if it is empty. Pointers are taken
+ * out with a single compare-and-swap, in the order they were sent in
+ * @param channel channel to receive pointers from
+ * @param max_count most pointers to receive
+ * @param out_ptrs array of at least max_count elements, which receives the pointers, valid in the calling process
+ * @return number of pointers received, which is 0 only once the channel is closed and empty
+ */
+uint_fast32_t shm_channel_recv_batch(shm_channel* channel, uint_fast32_t max_count, void** out_ptrs);
+
+#endif //JMEM_SHM_CHANNEL_H
@@ -14,8 +14,10 @@
  *  Shared memory allocator, which maps using mmap shared memory pages, allowing it to be shared among several
  *  sub-processes (like across a fork or clone call). While the allocator memory can be shared, its capabilities
  *  are still limited. Since it uses mmap, it means that any allocations or deallocations of pools in one process will
- *  not be visible in another. This may be fixed by changing the implementation to use shm_open/shm_close, though
- *  that would likely make it much slower.
+ *  not be visible in another. Allocators created with shm_ill_allocator_create_reserved do not have this limitation,
+ *  as they map all the memory they may ever use before any fork, nor do allocators created with
+ *  shm_ill_allocator_create_named, as they are backed by a named shared memory object, which other processes can also
+ *  attach to.
  */
 typedef struct shm_ill_allocator_struct shm_ill_allocator;
 /**
@@ -28,6 +30,131 @@ typedef struct shm_ill_allocator_struct shm_ill_allocator;
  */
 shm_ill_allocator* shm_ill_allocator_create(uint_fast64_t pool_size, uint_fast64_t initial_pool_count);
 
+/**
+ * Flags which change the behaviour of the allocator, given to shm_ill_allocator_create_with_flags
+ */
+enum shm_ill_allocator_flags
+{
+    /**
+     * Small blocks are cached in per-thread magazines, which are refilled from and flushed to the shared heap in
+     * batches, so most small allocations and frees do not take the allocator's lock. Blocks in a thread's cache are
+     * still counted as used by the shared heap, so each thread should call shm_ill_allocator_thread_flush before it
+     * exits, and any thread other than the one destroying the allocator must flush before the allocator is destroyed.
+     * A child process starts with empty caches, as the blocks cached by the forking thread stay with the parent.
+     * Freeing a block which sits in any thread's cache is reported as a double free.
+     */
+    SHM_ILL_ALLOCATOR_THREAD_CACHE = 1 << 0,
+    /**
+     * Pools are backed by huge pages and their size is rounded up to a multiple of 2 MiB, which reduces TLB misses with
+     * large heaps. Explicit huge pages (MAP_HUGETLB) are used if the system has any reserved, otherwise transparent huge
+     * pages are requested with madvise. Ignored on Windows, where large pages need special privileges.
+     */
+    SHM_ILL_ALLOCATOR_HUGE_PAGES = 1 << 1,
+    /**
+     * Each pool gets its own lock instead of the whole allocator sharing one. Frees only lock the pool the block came
+     * from and allocations skip pools which are locked by someone else, so threads and processes using different pools
+     * do not wait on each other. The allocator's own lock is then only taken when a pool is added or when pools are
+     * trimmed. Pool table is reserved up front, so the number of pools is limited to a large fixed number.
+     */
+    SHM_ILL_ALLOCATOR_POOL_LOCKS = 1 << 2,
+};
+
+/**
+ * Creates a new memory allocator in the same way as shm_ill_allocator_create, but with additional flags
+ * @param pool_size default size of pools (gets rounded up to nearest PAGE_SIZE, or huge page size with
+ * SHM_ILL_ALLOCATOR_HUGE_PAGES)
+ * @param initial_pool_count number of memory pools to allocate in advance
+ * @param flags combination of values from shm_ill_allocator_flags
+ * @return NULL on failure, otherwise a valid pointer to the allocator
+ */
+shm_ill_allocator* shm_ill_allocator_create_with_flags(uint_fast64_t pool_size, uint_fast64_t initial_pool_count, uint_fast32_t flags);
+
+/**
+ * Creates a new memory allocator in the same way as shm_ill_allocator_create_with_flags, but maps a single shared
+ * region large enough for all the memory it may ever use up front. Pools and the pool table are carved out of it, so
+ * adding a pool needs no system call, and processes forked from the creator at any time see pools added by any of the
+ * others. Pages of the region are only committed once they are first touched. On Windows, address space is reserved
+ * instead and pages are committed as pools are added.
+ * @param pool_size default size of pools (gets rounded up to nearest PAGE_SIZE, or huge page size with
+ * SHM_ILL_ALLOCATOR_HUGE_PAGES)
+ * @param initial_pool_count number of memory pools to allocate in advance
+ * @param flags combination of values from shm_ill_allocator_flags
+ * @param max_size size of the region, including the allocator and its pool table. Allocations fail once it is used up.
+ * @return NULL on failure, otherwise a valid pointer to the allocator
+ */
+shm_ill_allocator* shm_ill_allocator_create_reserved(
+        uint_fast64_t pool_size, uint_fast64_t initial_pool_count, uint_fast32_t flags, uint_fast64_t max_size);
+
+/**
+ * Creates a new memory allocator in the same way as shm_ill_allocator_create_with_flags, but backed by a shared memory
+ * object opened with shm_open. Pools are added by growing the object, so pools added by any process become visible to
+ * all others, which map them the next time they call into the allocator (or shm_ill_allocator_refresh). Unrelated
+ * processes may use the allocator after calling shm_ill_allocator_attach. Address space for the whole object is
+ * reserved up front, so that it can grow in place. Each process may map it at a different address, so blocks should be
+ * passed between processes as offsets (see shm_ill_allocator_to_offset). Not available on Windows.
+ * @param name name of the shared memory object, as given to shm_open (such as "/my_heap"), shorter than 64 characters.
+ * Creation fails if an object with this name already exists.
+ * @param pool_size default size of pools (gets rounded up to nearest PAGE_SIZE, or huge page size with
+ * SHM_ILL_ALLOCATOR_HUGE_PAGES)
+ * @param initial_pool_count number of memory pools to allocate in advance
+ * @param flags combination of values from shm_ill_allocator_flags
+ * @param max_size largest size the shared memory object may grow to, including the allocator and its pool table
+ * @return NULL on failure, otherwise a valid pointer to the allocator
+ */
+shm_ill_allocator* shm_ill_allocator_create_named(
+        const char* name, uint_fast64_t pool_size, uint_fast64_t initial_pool_count, uint_fast32_t flags,
+        uint_fast64_t max_size);
+
+/**
+ * Attaches to an allocator created by another process with shm_ill_allocator_create_named. The shared memory object
+ * is mapped wherever there is enough free address space, which need not match the address used by other processes.
+ * Callbacks set by other processes are not used by the attached process. Not available on Windows.
+ * @param name name the allocator was created with
+ * @return NULL on failure (including when the allocator is still being created), otherwise a valid pointer to the
+ * allocator
+ */
+shm_ill_allocator* shm_ill_allocator_attach(const char* name);
+
+/**
+ * Unmaps an allocator created with shm_ill_allocator_create_named from the calling process, without destroying it.
+ * Should be called by every process which attached to the allocator, instead of shm_ill_allocator_destroy, which is
+ * meant for the process that created it. Does nothing for allocators which are not named.
+ * @param allocator pointer to a valid named allocator
+ */
+void shm_ill_allocator_detach(shm_ill_allocator* allocator);
+
+/**
+ * Maps any pools of a named allocator which were added by other processes, so that blocks from them may be accessed
+ * before the calling process next calls into the allocator. Does nothing for allocators which are not named.
+ * @param allocator pointer to a valid allocator
+ * @return 0 on success, -1 on failure
+ */
+int shm_ill_allocator_refresh(shm_ill_allocator* allocator);
+
+/**
+ * Converts a pointer to a block of the allocator into an offset, which refers to the same block in any process the
+ * allocator is mapped in, regardless of the address it is mapped at.
+ * @param allocator pointer to a valid allocator
+ * @param ptr pointer to memory from the allocator, or NULL
+ * @return offset of the memory from the allocator, or 0 if ptr was NULL
+ */
+uint_fast64_t shm_ill_allocator_to_offset(const shm_ill_allocator* allocator, const void* ptr);
+
+/**
+ * Converts an offset returned by shm_ill_allocator_to_offset back into a pointer valid in the calling process.
+ * @param allocator pointer to a valid allocator
+ * @param offset offset of memory from the allocator, or 0
+ * @return pointer to the memory, or NULL if offset was 0
+ */
+void* shm_ill_allocator_from_offset(const shm_ill_allocator* allocator, uint_fast64_t offset);
+
+/**
+ * Returns all blocks cached by the calling thread back to the shared heap and releases the thread's cache. Does nothing
+ * if the allocator was not created with SHM_ILL_ALLOCATOR_THREAD_CACHE or the thread has no blocks cached.
+ * @param allocator pointer to a valid allocator
+ */
+void shm_ill_allocator_thread_flush(shm_ill_allocator* allocator);
+
 /**
  * Verify that memory allocator is working as intended and that no corruptions occurred
  * @param allocator pointer to a valid allocator
@@ -37,6 +164,36 @@ shm_ill_allocator* shm_ill_allocator_create(uint_fast64_t pool_size, uint_fast64
  */
 int shm_ill_allocator_verify(shm_ill_allocator* allocator, int_fast32_t* i_pool, int_fast32_t* i_block);
 
+/**
+ * Verify the allocator in the same way as shm_ill_allocator_verify, but without keeping it from being used for the
+ * whole time. Pools are checked one at a time and only the pool being checked is locked, so others may keep allocating
+ * from the rest of them (without SHM_ILL_ALLOCATOR_POOL_LOCKS, the allocator's lock is taken and released again for
+ * each pool). Pools added while the check is running may or may not be checked.
+ * @param allocator pointer to a valid allocator
+ * @param i_pool pointer which will receive the index of the pool where the memory error occurred
+ * @param i_block pointer which will receive the index of the block where the memory error occurred
+ * @return 0 on success, -1 on failure
+ */
+int shm_ill_allocator_verify_incremental(shm_ill_allocator* allocator, int_fast32_t* i_pool, int_fast32_t* i_block);
+
+/**
+ * Reads the allocator's usage counters, which are always kept and can be read at any time without taking any lock.
+ * While others are using the allocator, each counter is up to date on its own, but they may not agree with each other.
+ * Counters describe the shared heap, so blocks held by thread caches (with SHM_ILL_ALLOCATOR_THREAD_CACHE) count as in
+ * use, and only the batches in which caches are refilled and flushed are counted as allocations and frees. Any of the
+ * output pointers may be null.
+ * @param allocator pointer to a valid allocator
+ * @param p_bytes_in_use receives the number of bytes in used blocks, including their headers
+ * @param p_peak_bytes_in_use receives the largest value bytes in use ever had
+ * @param p_allocation_count receives the number of blocks ever allocated
+ * @param p_free_count receives the number of blocks ever freed
+ * @param p_reallocation_count receives the number of successful reallocations (those which move a block also count
+ * as an allocation and a free)
+ */
+void shm_ill_allocator_counters(
+        shm_ill_allocator* allocator, uint_fast64_t* p_bytes_in_use, uint_fast64_t* p_peak_bytes_in_use,
+        uint_fast64_t* p_allocation_count, uint_fast64_t* p_free_count, uint_fast64_t* p_reallocation_count);
+
 
 /**
  * Destroy an allocator and release all of its memory
@@ -68,8 +225,96 @@ void* shm_ill_alloc(shm_ill_allocator* allocator, uint_fast64_t size);
  */
 void* shm_ill_jrealloc(shm_ill_allocator* allocator, void* ptr, uint_fast64_t new_size);
 
+/**
+ * Allocates a block of shared memory, valid for at least <b>size</b> bytes, with its address a multiple of
+ * <b>alignment</b>. Any padding needed in front of the block is returned to the allocator as a free chunk.
+ * @param allocator allocator from which the allocation is made
+ * @param size size of the block to be allocated in bytes
+ * @param alignment required alignment of the block, which must be a power of two
+ * @return pointer to a valid block of memory on success, NULL on failure
+ */
+void* shm_ill_alloc_aligned(shm_ill_allocator* allocator, uint_fast64_t size, uint_fast64_t alignment);
+
+/**
+ * Allocates <b>count</b> blocks of shared memory at once, the i-th one valid for at least <b>sizes[i]</b> bytes. Small blocks are
+ * carved out of a few large free chunks, so the search for free memory is done once per group of blocks instead of
+ * once per block. The allocator is locked once for the whole batch. Blocks are freed individually as usual.
+ * @param allocator allocator from which the allocations are made
+ * @param count number of blocks to allocate
+ * @param sizes array of <b>count</b> sizes of blocks in bytes
+ * @param out_ptrs array which receives <b>count</b> pointers to the allocated blocks
+ * @return 0 on success, -1 on failure, in which case no block is allocated and all of <b>out_ptrs</b> are set to NULL
+ */
+int shm_ill_alloc_batch(shm_ill_allocator* allocator, uint_fast64_t count, const uint_fast64_t* sizes, void** out_ptrs);
+
+/**
+ * Allocates <b>count</b> blocks of shared memory at once, each valid for at least <b>size</b> bytes. Works the same way as
+ * shm_ill_alloc_batch.
+ * @param allocator allocator from which the allocations are made
+ * @param count number of blocks to allocate
+ * @param size size of each block in bytes
+ * @param out_ptrs array which receives <b>count</b> pointers to the allocated blocks
+ * @return 0 on success, -1 on failure, in which case no block is allocated and all of <b>out_ptrs</b> are set to NULL
+ */
+int shm_ill_alloc_batch_uniform(shm_ill_allocator* allocator, uint_fast64_t count, uint_fast64_t size, void** out_ptrs);
+
+/**
+ * Frees <b>count</b> blocks at once. Pointers are sorted by address, so that blocks which are physically adjacent
+ * are merged and returned to their pool together. The allocator is locked once for the whole batch and
+ * blocks bypass the thread cache.
+ * @param allocator allocator from which the blocks were allocated
+ * @param count number of blocks to free
+ * @param ptrs array of <b>count</b> pointers to blocks (any of which may be null), which gets sorted by address
+ */
+void shm_ill_jfree_batch(shm_ill_allocator* allocator, uint_fast64_t count, void** ptrs);
+
+/**
+ * (Re-)allocates a block of shared memory if possible to a <b>new_size</b>, so that its address is a multiple of
+ * <b>alignment</b>. If the block is moved, the new block has the same alignment.
+ * @param allocator allocator from which the allocation is made
+ * @param ptr either a pointer to a block previously (re-)allocated or NULL
+ * @param new_size size to which to resize the block to
+ * @param alignment required alignment of the block, which must be a power of two
+ * @return pointer to a valid block of memory on success, NULL on failure
+ */
+void* shm_ill_jrealloc_aligned(shm_ill_allocator* allocator, void* ptr, uint_fast64_t new_size, uint_fast64_t alignment);
+
+/**
+ * Enables releasing of memory held by empty pools. Whenever a pool becomes empty, the pages of pools which have been
+ * empty for at least <b>delay</b> frees are given back to the OS, apart from <b>spare_pools</b> pools of the default
+ * size, which are kept to avoid repeatedly faulting pages back in. Pools themselves stay mapped, since other processes
+ * sharing the allocator may still refer to them. By default no memory is released.
+ * @param allocator allocator to configure
+ * @param spare_pools number of empty pools of the default size to keep
+ * @param delay number of frees a pool must remain empty for before its memory is released
+ */
+void shm_ill_allocator_set_trim_policy(shm_ill_allocator* allocator, uint_fast64_t spare_pools, uint_fast64_t delay);
+
+/**
+ * Immediately releases the pages of all empty pools, apart from the number of spare pools set by
+ * shm_ill_allocator_set_trim_policy (none if it was not called).
+ * @param allocator allocator to trim
+ * @return number of bytes returned to the OS
+ */
+uint_fast64_t shm_ill_allocator_trim(shm_ill_allocator* allocator);
+
+/**
+ * Sets the function called when an allocation fails. For named allocators the callback only applies to the calling
+ * process, since the functions of one process can not be called from another, so every process which attaches to the
+ * allocator starts without one. For other allocators it is kept in the shared memory, so forked children keep it.
+ * @param allocator allocator to set the callback for
+ * @param callback function to call, or NULL for none
+ * @param param parameter passed to the callback
+ */
 void shm_ill_allocator_set_bad_alloc_callback(shm_ill_allocator* allocator, void(*callback)(shm_ill_allocator* allocator, void* param), void* param);
 
+/**
+ * Sets the function called when a block which is not in use is freed. Applies to processes the same way as with
+ * shm_ill_allocator_set_bad_alloc_callback.
+ * @param allocator allocator to set the callback for
+ * @param callback function to call, or NULL for none
+ * @param param parameter passed to the callback
+ */
 void shm_ill_allocator_set_double_free_callback(shm_ill_allocator* allocator, void(*callback)(shm_ill_allocator* allocator, void* param), void* param);
 
 #endif //JMEM_SHM_ILL_ALLOC_H
@@ -6,6 +6,7 @@
 #include "include/jmem/lin_alloc.h"
 #include <string.h>
 #include <assert.h>
+#include <stdatomic.h>
 #ifndef _WIN32
 #include <unistd.h>
 #include <sys/mman.h>
@@ -15,6 +16,18 @@
 
 static const char* const LIN_ALLOC_NAME_STRING = "linear lin_allocator";
 
+typedef struct lin_block_struct lin_block;
+//  Header of a block added to the chain by an allocator created with LIN_ALLOCATOR_CHAINED. It holds the state of the
+//  block which was active before it, so that it can be restored once this block is released.
+struct lin_block_struct
+{
+    lin_block* prev;
+    void* prev_base;
+    void* prev_max;
+    void* prev_current;
+    uint_fast64_t size;
+};
+
 typedef struct lin_allocator_struct lin_allocator;
 struct lin_allocator_struct
 {
@@ -22,12 +35,194 @@ struct lin_allocator_struct
     void* base;
     void* current;
     void* peek;
+    //  End of memory which may be accessed. Equal to max rounded to a page, unless memory is committed on demand
+    void* committed;
+    //  How much memory is kept committed above current when freeing, or UINT64_MAX to never decommit
+    uint_fast64_t decommit_watermark;
+    uint_fast32_t flags;
+    //  Most recently added block of the chain, or NULL if the allocator's own memory is in use
+    lin_block* blocks;
+    //  Last released block, which is kept to avoid mapping and unmapping a block at the boundary repeatedly
+    lin_block* spare;
+    uint_fast64_t next_block_size;
     unsigned char memory[];
 };
 
+static uint64_t PAGE_SIZE = 0;
+
+//  Size of huge pages used with LIN_ALLOCATOR_HUGE_PAGES
+enum {HUGE_PAGE_SIZE = 1 << 21};
+
+static inline uint_fast64_t round_to_nearest_page_up(uint_fast64_t v)
+{
+    uint_fast64_t excess = v & (PAGE_SIZE - 1); //  Works BC PAGE_SIZE is a multiple of two
+    if (excess)
+    {
+        v += PAGE_SIZE - excess;
+    }
+    return v;
+}
+
+//  Memory is committed in steps of at least this much, so that each page does not need its own system call
+enum {COMMIT_GRANULARITY = 1 << 16};
+
+static int commit_memory(lin_allocator* this, void* end)
+{
+    //  Blocks of the chain are committed as a whole
+    if (end <= this->committed || this->blocks)
+    {
+        return 1;
+    }
+    const uintptr_t reserved_end = round_to_nearest_page_up((uintptr_t)this->max);
+    uintptr_t new_committed = ((uintptr_t)end + COMMIT_GRANULARITY - 1) & ~(uintptr_t)(COMMIT_GRANULARITY - 1);
+    new_committed = round_to_nearest_page_up(new_committed);
+    if (new_committed > reserved_end)
+    {
+        new_committed = reserved_end;
+    }
+#ifndef _WIN32
+    if (mprotect(this->committed, new_committed - (uintptr_t)this->committed, PROT_READ|PROT_WRITE) != 0)
+    {
+        return 0;
+    }
+#else
+    if (!VirtualAlloc(this->committed, new_committed - (uintptr_t)this->committed, MEM_COMMIT, PAGE_READWRITE))
+    {
+        return 0;
+    }
+#endif
+    this->committed = (void*)new_committed;
+    return 1;
+}
+
+static void decommit_memory(lin_allocator* this)
+{
+    if (!(this->flags & LIN_ALLOCATOR_COMMIT_ON_DEMAND) || this->decommit_watermark == UINT64_MAX || this->blocks)
+    {
+        return;
+    }
+    const uintptr_t current = (uintptr_t)this->current;
+    if ((uintptr_t)this->committed - current <= this->decommit_watermark)
+    {
+        return;
+    }
+    //  Keep the first page committed, since the allocator itself lives there
+    const uintptr_t keep = round_to_nearest_page_up(current + this->decommit_watermark);
+    if (keep >= (uintptr_t)this->committed)
+    {
+        return;
+    }
+#ifndef _WIN32
+    madvise((void*)keep, (uintptr_t)this->committed - keep, MADV_DONTNEED);
+    mprotect((void*)keep, (uintptr_t)this->committed - keep, PROT_NONE);
+#else
+    VirtualFree((void*)keep, (uintptr_t)this->committed - keep, MEM_DECOMMIT);
+#endif
+    this->committed = (void*)keep;
+}
+
+static void unmap_block(lin_block* block)
+{
+#ifndef _WIN32
+    munmap(block, block->size);
+#else
+    BOOL res = VirtualFree(block, 0, MEM_RELEASE);
+    assert(res != 0);
+#endif
+}
+
+static void* push_block(lin_allocator* this, uint_fast64_t size, uint_fast64_t alignment)
+{
+    if (alignment < 8)
+    {
+        alignment = 8;
+    }
+    //  Worst case for the padding is alignment - 8, since the header size is a multiple of 8
+    const uint_fast64_t needed = round_to_nearest_page_up(sizeof(lin_block) + alignment - 8 + size);
+    lin_block* block;
+    if (this->spare && this->spare->size >= needed)
+    {
+        block = this->spare;
+        this->spare = NULL;
+    }
+    else
+    {
+        const uint_fast64_t block_size = needed > this->next_block_size ? needed : this->next_block_size;
+#ifndef _WIN32
+        block = mmap(NULL, block_size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+        if (block == MAP_FAILED) return NULL;
+#else
+        block = VirtualAlloc(0, block_size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+        if (block == NULL) return NULL;
+#endif
+        block->size = block_size;
+        //  Blocks grow geometrically, so that the chain stays short
+        this->next_block_size = block_size * 2;
+    }
+    block->prev = this->blocks;
+    block->prev_base = this->base;
+    block->prev_max = this->max;
+    block->prev_current = this->current;
+    this->blocks = block;
+    this->base = (void*)((uintptr_t)block + sizeof(*block));
+    this->max = (void*)((uintptr_t)block + block->size);
+    void* const ret = (void*)(((uintptr_t)this->base + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    this->current = (void*)((uintptr_t)ret + size);
+#ifndef NDEBUG
+    memset(ret, 0xCC, size);
+#endif
+    return ret;
+}
+
+static void pop_block(lin_allocator* this)
+{
+    lin_block* const block = this->blocks;
+    this->blocks = block->prev;
+    this->base = block->prev_base;
+    this->max = block->prev_max;
+    this->current = block->prev_current;
+    if (!this->spare)
+    {
+        this->spare = block;
+    }
+    else if (this->spare->size < block->size)
+    {
+        unmap_block(this->spare);
+        this->spare = block;
+    }
+    else
+    {
+        unmap_block(block);
+    }
+}
+
+//  Releases blocks of the chain until the one containing ptr is active. Since blocks do not overlap, a pointer in range
+//  of a block, including its end, identifies that block uniquely.
+static int pop_blocks_to(lin_allocator* this, void* ptr)
+{
+    while (!(this->base <= ptr && this->max >= ptr))
+    {
+        if (!this->blocks)
+        {
+            return 0;
+        }
+        pop_block(this);
+    }
+    return 1;
+}
+
 void lin_allocator_destroy(lin_allocator* allocator)
 {
     lin_allocator* this = (lin_allocator*)allocator;
+    while (this->blocks)
+    {
+        pop_block(this);
+    }
+    if (this->spare)
+    {
+        unmap_block(this->spare);
+        this->spare = NULL;
+    }
 //    const uint_fast64_t ret_v = this->peek - this->base;
 #ifndef _WIN32
     munmap(this, sizeof(*this) + this->max - this->base);
@@ -52,6 +247,14 @@ void* lin_alloc(lin_allocator* allocator, uint_fast64_t size)
     if (new_bottom > this->max)
     {
 //        return malloc(size);
+        if (this->flags & LIN_ALLOCATOR_CHAINED)
+        {
+            return push_block(this, size, 8);
+        }
+        return NULL;
+    }
+    if (!commit_memory(this, new_bottom))
+    {
         return NULL;
     }
     this->current = new_bottom;
@@ -65,10 +268,94 @@ void* lin_alloc(lin_allocator* allocator, uint_fast64_t size)
     return ret;
 }
 
+void* lin_alloc_aligned(lin_allocator* allocator, uint_fast64_t size, uint_fast64_t alignment)
+{
+    if (alignment & (alignment - 1))
+    {
+        return NULL;
+    }
+    if (size & 7)
+    {
+        size += (8 - (size & 7));
+    }
+    lin_allocator* this = (lin_allocator*)allocator;
+    //  Skip forward to the aligned position, so that padding is freed together with the block
+    const uintptr_t misalignment = alignment ? (uintptr_t)this->current & (alignment - 1) : 0;
+    if ((this->flags & LIN_ALLOCATOR_CHAINED) &&
+        (uintptr_t)this->max - (uintptr_t)this->current < size + (misalignment ? alignment - misalignment : 0))
+    {
+        //  New block must be aligned as well, so it can not be left to lin_alloc
+        return push_block(this, size, alignment);
+    }
+    if (misalignment)
+    {
+        void* const aligned = (void*)((uintptr_t)this->current + (alignment - misalignment));
+        if (aligned > this->max)
+        {
+            return NULL;
+        }
+        void* const previous = this->current;
+        this->current = aligned;
+        void* const ret = lin_alloc(allocator, size);
+        if (!ret)
+        {
+            this->current = previous;
+        }
+        return ret;
+    }
+    return lin_alloc(allocator, size);
+}
+
+void* lin_alloc_atomic(lin_allocator* allocator, uint_fast64_t size)
+{
+    lin_allocator* this = (lin_allocator*)allocator;
+    //  Memory must be usable without taking any further action, which is not the case with these modes. Sizes which
+    //  would wrap around when rounded up can never fit either.
+    if ((this->flags & (LIN_ALLOCATOR_COMMIT_ON_DEMAND|LIN_ALLOCATOR_CHAINED)) || size > UINT64_MAX - 7)
+    {
+        return NULL;
+    }
+    if (size & 7)
+    {
+        size += (8 - (size & 7));
+    }
+    void* ret = atomic_load_explicit(&this->current, memory_order_relaxed);
+    void* new_bottom;
+    do
+    {
+        //  Check if it overflows, which leaves current as it was, so that smaller allocations may still succeed
+        if (size > (uintptr_t)this->max - (uintptr_t)ret)
+        {
+            return NULL;
+        }
+        new_bottom = (void*)((uintptr_t)ret + size);
+    } while (!atomic_compare_exchange_weak_explicit(&this->current, &ret, new_bottom, memory_order_relaxed, memory_order_relaxed));
+#ifndef NDEBUG
+    memset(ret, 0xCC, size);
+#endif
+    return ret;
+}
+
+void lin_allocator_reset(lin_allocator* allocator)
+{
+    lin_allocator* this = (lin_allocator*)allocator;
+    while (this->blocks)
+    {
+        pop_block(this);
+    }
+    this->current = this->base;
+    decommit_memory(this);
+}
+
 void lin_jfree(lin_allocator* allocator, void* ptr)
 {
     if (!ptr) return;
     lin_allocator* this = (lin_allocator*)allocator;
+    if ((this->flags & LIN_ALLOCATOR_CHAINED) && !pop_blocks_to(this, ptr))
+    {
+        assert(0);
+        return;
+    }
     if (this->base <= ptr && this->max > ptr)
     {
         //  ptr is from the allocator
@@ -78,6 +365,7 @@ void lin_jfree(lin_allocator* allocator, void* ptr)
         memset(ptr, 0xCC, (uintptr_t)this->current - (uintptr_t)ptr);
 #endif
             this->current = ptr;
+            decommit_memory(this);
         }
         else
         {
@@ -105,6 +393,22 @@ void* lin_jrealloc(lin_allocator* allocator, void* ptr, uint_fast64_t new_size)
         void* new_bottom = (void*)(new_size + (uintptr_t)ptr);
         if (new_bottom > this->max)
         {
+            if (this->flags & LIN_ALLOCATOR_CHAINED)
+            {
+                //  Block is moved to a new block of the chain, which leaves the space it used in the old one free
+                assert(ptr < this->current);
+                const uint_fast64_t old_size = (uintptr_t)this->current - (uintptr_t)ptr;
+                void* const previous = this->current;
+                this->current = ptr;
+                void* const new_ptr = push_block(this, new_size, 8);
+                if (!new_ptr)
+                {
+                    this->current = previous;
+                    return NULL;
+                }
+                memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+                return new_ptr;
+            }
 //            //  Overflow would happen, so use malloc
 //            void* new_ptr = malloc(new_size);
 //            if (!new_ptr) return NULL;
@@ -115,6 +419,10 @@ void* lin_jrealloc(lin_allocator* allocator, void* ptr, uint_fast64_t new_size)
 //            return new_ptr;
             return NULL;
         }
+        if (!commit_memory(this, new_bottom))
+        {
+            return NULL;
+        }
         //  return ptr if no overflow, but update bottom of stack position
 #ifndef NDEBUG
         if (new_bottom > this->current)
@@ -127,6 +435,7 @@ void* lin_jrealloc(lin_allocator* allocator, void* ptr, uint_fast64_t new_size)
         }
 #endif
         this->current = new_bottom;
+        decommit_memory(this);
 
         if (this->current > this->peek)
         {
@@ -139,18 +448,6 @@ void* lin_jrealloc(lin_allocator* allocator, void* ptr, uint_fast64_t new_size)
     return NULL;
 }
 
-static uint64_t PAGE_SIZE = 0;
-
-static inline uint_fast64_t round_to_nearest_page_up(uint_fast64_t v)
-{
-    uint_fast64_t excess = v & (PAGE_SIZE - 1); //  Works BC PAGE_SIZE is a multiple of two
-    if (excess)
-    {
-        v += PAGE_SIZE - excess;
-    }
-    return v;
-}
-
 void* lin_allocator_save_state(lin_allocator* allocator)
 {
     const lin_allocator* const this = (lin_allocator*)allocator;
@@ -160,8 +457,27 @@ void* lin_allocator_save_state(lin_allocator* allocator)
 void lin_allocator_restore_current(lin_allocator* allocator, void* ptr)
 {
     lin_allocator* const this = (lin_allocator*)allocator;
-    assert(ptr >= this->base && ptr < this->max);
+    if ((this->flags & LIN_ALLOCATOR_CHAINED) && !pop_blocks_to(this, ptr))
+    {
+        assert(0);
+        return;
+    }
+    assert(ptr >= this->base && ptr <= this->max);
+    if (!commit_memory(this, ptr))
+    {
+        //  Memory which was committed when the state was saved was decommitted since and can not be committed again
+        assert(0);
+        return;
+    }
     this->current = ptr;
+    decommit_memory(this);
+}
+
+void lin_allocator_set_decommit_watermark(lin_allocator* allocator, uint_fast64_t watermark)
+{
+    lin_allocator* const this = (lin_allocator*)allocator;
+    this->decommit_watermark = watermark;
+    decommit_memory(this);
 }
 
 static uint_fast64_t lin_allocator_get_size(const lin_allocator* lin_allocator)
@@ -170,7 +486,53 @@ static uint_fast64_t lin_allocator_get_size(const lin_allocator* lin_allocator)
 }
 
 
+static lin_allocator* create_reserved(uint_fast64_t total_size, uint_fast32_t flags)
+{
+    const uint_fast64_t reserved_size = round_to_nearest_page_up(sizeof(lin_allocator) + total_size);
+    //  Only the page with the allocator itself is committed at first
+#ifndef _WIN32
+    lin_allocator* this = mmap(NULL, reserved_size, PROT_NONE, MAP_ANONYMOUS|MAP_PRIVATE|MAP_NORESERVE, -1, 0);
+    if (this == MAP_FAILED) return NULL;
+    if (mprotect(this, PAGE_SIZE, PROT_READ|PROT_WRITE) != 0)
+    {
+        munmap(this, reserved_size);
+        return NULL;
+    }
+    if (flags & LIN_ALLOCATOR_HUGE_PAGES)
+    {
+        madvise(this, reserved_size, MADV_HUGEPAGE);
+    }
+#else
+    lin_allocator* this = VirtualAlloc(0, reserved_size, MEM_RESERVE, PAGE_NOACCESS);
+    if (this == NULL)
+    {
+        return NULL;
+    }
+    if (!VirtualAlloc(this, PAGE_SIZE, MEM_COMMIT, PAGE_READWRITE))
+    {
+        VirtualFree(this, 0, MEM_RELEASE);
+        return NULL;
+    }
+#endif
+    this->base = (void*)((uintptr_t)this + sizeof(*this));
+    this->current = (void*)((uintptr_t)this + sizeof(*this));
+    this->peek = (void*)((uintptr_t)this + sizeof(*this));
+    this->max = (void*)((uintptr_t)this + sizeof(*this) + total_size);
+    this->committed = (void*)((uintptr_t)this + PAGE_SIZE);
+    this->decommit_watermark = UINT64_MAX;
+    this->flags = flags;
+    this->blocks = NULL;
+    this->spare = NULL;
+    this->next_block_size = round_to_nearest_page_up(2 * total_size);
+    return this;
+}
+
 lin_allocator* lin_allocator_create(uint_fast64_t total_size)
+{
+    return lin_allocator_create_with_flags(total_size, 0);
+}
+
+lin_allocator* lin_allocator_create_with_flags(uint_fast64_t total_size, uint_fast32_t flags)
 {
     if (!PAGE_SIZE)
     {
@@ -183,10 +545,31 @@ lin_allocator* lin_allocator_create(uint_fast64_t total_size)
 #endif
     }
     total_size = round_to_nearest_page_up(total_size);
+    if (flags & LIN_ALLOCATOR_COMMIT_ON_DEMAND)
+    {
+        return create_reserved(total_size, flags);
+    }
 #ifndef _WIN32
-    lin_allocator* this = mmap(NULL, round_to_nearest_page_up(sizeof(lin_allocator) + total_size), PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
-    if (this == MAP_FAILED) return NULL;
+    lin_allocator* this = MAP_FAILED;
+    if (flags & LIN_ALLOCATOR_HUGE_PAGES)
+    {
+        //  Whole mapping must be a multiple of the huge page size, so that it can be unmapped
+        total_size = ((sizeof(lin_allocator) + total_size + HUGE_PAGE_SIZE - 1) & ~(uint_fast64_t)(HUGE_PAGE_SIZE - 1)) - sizeof(lin_allocator);
+        this = mmap(NULL, sizeof(lin_allocator) + total_size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE|MAP_HUGETLB, -1, 0);
+    }
+    if (this == MAP_FAILED)
+    {
+        this = mmap(NULL, round_to_nearest_page_up(sizeof(lin_allocator) + total_size), PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+        if (this == MAP_FAILED) return NULL;
+        if (flags & LIN_ALLOCATOR_HUGE_PAGES)
+        {
+            //  No explicit huge pages are available, so ask for transparent ones instead
+            madvise(this, sizeof(lin_allocator) + total_size, MADV_HUGEPAGE);
+        }
+    }
 #else
+    //  Large pages need special privileges on Windows, so flags are ignored
+    (void)flags;
     lin_allocator* this = VirtualAlloc(0, round_to_nearest_page_up(sizeof(lin_allocator) + total_size), MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
     if (this == NULL)
     {
@@ -197,6 +580,12 @@ lin_allocator* lin_allocator_create(uint_fast64_t total_size)
     this->current = (void*)((uintptr_t)this + sizeof(*this));
     this->peek = (void*)((uintptr_t)this + sizeof(*this));
     this->max = (void*)((uintptr_t)this + sizeof(*this) + total_size);
+    this->committed = (void*)round_to_nearest_page_up((uintptr_t)this->max);
+    this->decommit_watermark = UINT64_MAX;
+    this->flags = flags;
+    this->blocks = NULL;
+    this->spare = NULL;
+    this->next_block_size = round_to_nearest_page_up(2 * total_size);
 
     return this;
 }
@@ -0,0 +1,252 @@
+//
+// Created by jan on 17.10.2026.
+//
+
+#include "include/jmem/shm_block_pool.h"
+#include <assert.h>
+#include <string.h>
+#include <stdatomic.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//  Segment k holds twice as many blocks as segment k - 1, so a fixed number of them covers every possible block index
+enum {SEGMENT_COUNT = 32};
+//  Smallest number of blocks in the first segment
+enum {MIN_FIRST_SEGMENT_LOG2 = 4};
+//  Blocks are referred to by their index plus one in 32 bits, where 0 means no block
+#define MAX_BLOCK_COUNT 0xFFFFFFFFllu
+
+struct shm_block_pool_struct
+{
+    //  Top of the free stack. Low half is the index of the top block plus one (0 when the stack is empty) and the high
+    //  half is a tag, which changes with every push and pop, so that a compare-and-swap made with a head read before the
+    //  block was popped and pushed back again fails (ABA problem).
+    uint64_t head;
+    //  Number of blocks ever handed out from segments. Those past it were never used, so new segments need no
+    //  initialization.
+    uint64_t carved;
+    uint_fast64_t block_size;
+    //  First segment holds 1 << first_segment_log2 blocks
+    uint_fast32_t first_segment_log2;
+    //  Offset of the parent allocator back from the pool and offsets of segments from the pool (0 if not yet
+    //  allocated). Pool holds no absolute addresses, so it works in any process the parent is mapped in.
+    uint_fast64_t parent;
+    uint_fast64_t segments[SEGMENT_COUNT];
+};
+
+static inline uint_fast32_t bit_scan_reverse(uint_fast64_t v)
+{
+    assert(v);
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanReverse64(&idx, v);
+    return idx;
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+static inline shm_ill_allocator* pool_parent(const shm_block_pool* this)
+{
+    return (shm_ill_allocator*)((uintptr_t)this - this->parent);
+}
+
+static inline uint_fast64_t segment_block_count(const shm_block_pool* this, uint_fast32_t segment)
+{
+    return (uint_fast64_t)1 << (this->first_segment_log2 + segment);
+}
+
+static inline uint_fast32_t segment_of(const shm_block_pool* this, uint_fast64_t index)
+{
+    //  Segment k starts at index (1 << first_segment_log2) * (2^k - 1)
+    return bit_scan_reverse(index + ((uint_fast64_t)1 << this->first_segment_log2)) - this->first_segment_log2;
+}
+
+static inline void* block_at(const shm_block_pool* this, uint_fast64_t index)
+{
+    const uint_fast64_t shifted = index + ((uint_fast64_t)1 << this->first_segment_log2);
+    const uint_fast32_t segment = bit_scan_reverse(shifted) - this->first_segment_log2;
+    const uint_fast64_t slot = shifted - segment_block_count(this, segment);
+    const uint_fast64_t offset = atomic_load_explicit(&this->segments[segment], memory_order_relaxed);
+    assert(offset);
+    return (void*)((uintptr_t)this + offset + slot * this->block_size);
+}
+
+static uint_fast64_t block_index(const shm_block_pool* this, const void* ptr)
+{
+    //  Returns MAX_BLOCK_COUNT if the block is not from the pool
+    for (uint_fast32_t i = 0; i < SEGMENT_COUNT; ++i)
+    {
+        const uint_fast64_t offset = atomic_load_explicit(&this->segments[i], memory_order_relaxed);
+        if (!offset)
+        {
+            break;
+        }
+        const uint_fast64_t count = segment_block_count(this, i);
+        const uint_fast64_t position = (uintptr_t)ptr - ((uintptr_t)this + offset);
+        if (position < count * this->block_size)
+        {
+            assert(position % this->block_size == 0);
+            return count - segment_block_count(this, 0) + position / this->block_size;
+        }
+    }
+    return MAX_BLOCK_COUNT;
+}
+
+static int ensure_segment(shm_block_pool* this, uint_fast32_t segment)
+{
+    //  Any number of threads may find the segment missing at once. All of them allocate it, but only the first one to
+    //  publish it gets to keep it.
+    if (atomic_load(&this->segments[segment]))
+    {
+        return 1;
+    }
+    //  Later segments of pools with large blocks may be too large to even have a size
+    const uint_fast64_t count = segment_block_count(this, segment);
+    if (this->block_size > UINT64_MAX / count)
+    {
+        return 0;
+    }
+    shm_ill_allocator* const parent = pool_parent(this);
+    void* const ptr = shm_ill_alloc(parent, count * this->block_size);
+    if (!ptr)
+    {
+        return 0;
+    }
+    uint_fast64_t expected = 0;
+    if (!atomic_compare_exchange_strong(&this->segments[segment], &expected, (uintptr_t)ptr - (uintptr_t)this))
+    {
+        shm_ill_jfree(parent, ptr);
+    }
+    return 1;
+}
+
+static void* carve_block(shm_block_pool* this)
+{
+    //  Segment of the next block is made sure to exist before the block is claimed, so a failed allocation of the
+    //  segment does not lose any blocks
+    uint64_t carved = atomic_load(&this->carved);
+    for (;;)
+    {
+        if (carved >= MAX_BLOCK_COUNT - 1 || !ensure_segment(this, segment_of(this, carved)))
+        {
+            return NULL;
+        }
+        if (atomic_compare_exchange_weak(&this->carved, &carved, carved + 1))
+        {
+            return block_at(this, carved);
+        }
+    }
+}
+
+shm_block_pool* shm_block_pool_create(shm_ill_allocator* parent, uint_fast64_t block_size, uint_fast64_t initial_block_count)
+{
+    if (!block_size || block_size > UINT64_MAX - 7 || initial_block_count >= MAX_BLOCK_COUNT / 2)
+    {
+        return NULL;
+    }
+    //  Free blocks hold the index of the next one
+    block_size = (block_size + 7) & ~(uint_fast64_t)7;
+    uint_fast32_t first_segment_log2 = MIN_FIRST_SEGMENT_LOG2;
+    while (((uint_fast64_t)1 << first_segment_log2) < initial_block_count)
+    {
+        first_segment_log2 += 1;
+    }
+
+    shm_block_pool* const this = shm_ill_alloc(parent, sizeof(*this));
+    if (!this)
+    {
+        return NULL;
+    }
+    memset(this, 0, sizeof(*this));
+    this->block_size = block_size;
+    this->first_segment_log2 = first_segment_log2;
+    this->parent = (uintptr_t)this - (uintptr_t)parent;
+    if (!ensure_segment(this, 0))
+    {
+        shm_ill_jfree(parent, this);
+        return NULL;
+    }
+    return this;
+}
+
+void shm_block_pool_destroy(shm_block_pool* pool)
+{
+    shm_block_pool* this = (shm_block_pool*)pool;
+    shm_ill_allocator* const parent = pool_parent(this);
+    for (uint_fast32_t i = 0; i < SEGMENT_COUNT && this->segments[i]; ++i)
+    {
+        shm_ill_jfree(parent, (void*)((uintptr_t)this + this->segments[i]));
+    }
+    memset(this, 0, sizeof(*this));
+    shm_ill_jfree(parent, this);
+}
+
+void* shm_block_alloc(shm_block_pool* pool)
+{
+    shm_block_pool* this = (shm_block_pool*)pool;
+    uint64_t head = atomic_load_explicit(&this->head, memory_order_acquire);
+    while ((uint32_t)head)
+    {
+        uint32_t* const block = block_at(this, (uint32_t)head - 1);
+        //  Block may have been popped and written to by someone else since the head was read, so the link could be
+        //  anything, but then the tag has changed as well and the exchange fails
+        const uint32_t next = atomic_load_explicit(block, memory_order_relaxed);
+        const uint64_t new_head = (((head >> 32) + 1) << 32) | next;
+        if (atomic_compare_exchange_weak_explicit(&this->head, &head, new_head, memory_order_acquire, memory_order_acquire))
+        {
+            return block;
+        }
+    }
+    return carve_block(this);
+}
+
+void shm_block_free(shm_block_pool* pool, void* ptr)
+{
+    shm_block_pool* this = (shm_block_pool*)pool;
+    if (!ptr) return;
+    const uint_fast64_t index = block_index(this, ptr);
+    if (index == MAX_BLOCK_COUNT)
+    {
+        assert(0);
+        return;
+    }
+    uint32_t* const block = ptr;
+    uint64_t head = atomic_load_explicit(&this->head, memory_order_relaxed);
+    uint64_t new_head;
+    do
+    {
+        atomic_store_explicit(block, (uint32_t)head, memory_order_relaxed);
+        new_head = (((head >> 32) + 1) << 32) | (index + 1);
+    } while (!atomic_compare_exchange_weak_explicit(&this->head, &head, new_head, memory_order_release, memory_order_relaxed));
+}
+
+int shm_block_pool_verify(shm_block_pool* pool)
+{
+    shm_block_pool* this = (shm_block_pool*)pool;
+#ifndef NDEBUG
+#define VERIFICATION_CHECK(x) assert(x)
+#else
+#define VERIFICATION_CHECK(x) if (!(x)) { return -1;} (void)0
+#endif
+    VERIFICATION_CHECK(this->segments[0] != 0);
+    VERIFICATION_CHECK(this->carved < MAX_BLOCK_COUNT);
+    //  Segments are allocated in order, and every carved block must have one
+    const uint_fast32_t needed = this->carved ? segment_of(this, this->carved - 1) + 1 : 1;
+    for (uint_fast32_t i = 1; i < SEGMENT_COUNT; ++i)
+    {
+        VERIFICATION_CHECK(i < needed ? this->segments[i] != 0 : !this->segments[i] || this->segments[i - 1]);
+    }
+    //  Free stack holds only carved blocks, none of them twice
+    uint_fast64_t free_count = 0;
+    for (uint32_t link = (uint32_t)this->head; link; link = *(const uint32_t*)block_at(this, link - 1))
+    {
+        VERIFICATION_CHECK(link - 1 < this->carved);
+        VERIFICATION_CHECK(block_index(this, block_at(this, link - 1)) == link - 1);
+        free_count += 1;
+        VERIFICATION_CHECK(free_count <= this->carved);
+    }
+#undef VERIFICATION_CHECK
+    return 0;
+}
@@ -0,0 +1,319 @@
+//
+// Created by jan on 17.10.2026.
+//
+
+#include "include/jmem/shm_channel.h"
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+//  Head and tail are each kept in a cache line of their own, so producers and consumers do not slow each other down
+enum {CACHE_LINE_SIZE = 64};
+
+typedef struct channel_slot_struct channel_slot;
+//  Slot at position p of the ring (index p & mask) is free for the producer which claims position p when its sequence
+//  is p, and holds a value for the consumer which claims position p when its sequence is p + 1. Once the value is taken
+//  out, the sequence becomes p + capacity, which frees the slot for the next time around the ring.
+struct channel_slot_struct
+{
+    uint64_t sequence;
+    uint_fast64_t offset;
+};
+
+struct shm_channel_struct
+{
+    //  Next position to send to
+    uint64_t tail;
+    char tail_padding[CACHE_LINE_SIZE - sizeof(uint64_t)];
+    //  Next position to receive from
+    uint64_t head;
+    char head_padding[CACHE_LINE_SIZE - sizeof(uint64_t)];
+    //  Futex words which are bumped whenever a value is sent or received while someone waits for it, along with the
+    //  number of those waiting, so that nobody makes a system call when there is no one to wake
+    uint32_t recv_futex;
+    uint32_t recv_waiters;
+    uint32_t send_futex;
+    uint32_t send_waiters;
+    uint32_t closed;
+    uint_fast32_t flags;
+    uint_fast64_t mask;
+    //  Offset of the parent allocator back from the channel, so that the channel works in any process the parent is
+    //  mapped in
+    uint_fast64_t parent;
+    channel_slot slots[];
+};
+
+static inline shm_ill_allocator* channel_parent(const shm_channel* this)
+{
+    return (shm_ill_allocator*)((uintptr_t)this - this->parent);
+}
+
+static void wake_waiters(uint32_t* p_futex, uint32_t* p_waiters, int count)
+{
+    //  Fence orders the value being sent or received before the check, pairing with the increment of waiters in
+    //  wait_for_change, so either the waiter sees the new value, or this sees the waiter
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(p_waiters, memory_order_relaxed))
+    {
+        atomic_fetch_add(p_futex, 1);
+        syscall(
+                SYS_futex,
+                p_futex,
+                FUTEX_WAKE,
+                count,  // how many to wake
+                NULL,
+                0,
+                0
+                );
+    }
+}
+
+static void wait_for_change(uint32_t* p_futex, uint32_t seen)
+{
+    //  Returns right away if the futex was bumped since seen was read
+    const long res = syscall(
+            SYS_futex,  //  Syscall code
+            p_futex,  //  Address in question
+            FUTEX_WAIT,  //  futex_op
+            seen,  //  val
+            NULL,  //  timeout
+            0,  //  uaddr2
+            0//  val3
+                            );
+    assert(res == 0 || errno == EAGAIN || errno == EINTR);
+    (void)res;
+}
+
+static int push_value(shm_channel* this, uint_fast64_t offset)
+{
+    uint64_t position = atomic_load_explicit(&this->tail, memory_order_relaxed);
+    channel_slot* slot;
+    for (;;)
+    {
+        slot = this->slots + (position & this->mask);
+        const uint64_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        const int64_t difference = (int64_t)(sequence - position);
+        if (difference == 0)
+        {
+            if (this->flags & SHM_CHANNEL_SINGLE_PRODUCER)
+            {
+                atomic_store_explicit(&this->tail, position + 1, memory_order_relaxed);
+                break;
+            }
+            if (atomic_compare_exchange_weak_explicit(&this->tail, &position, position + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            //  Slot still holds the value from the last time around the ring
+            return 0;
+        }
+        else
+        {
+            //  Someone else sent to this position already
+            position = atomic_load_explicit(&this->tail, memory_order_relaxed);
+        }
+    }
+    slot->offset = offset;
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+    return 1;
+}
+
+static uint_fast32_t take_values(shm_channel* this, uint_fast32_t max_count, void** out_ptrs)
+{
+    //  Values which are ready in consecutive slots are claimed all at once. Once a slot holds a value, it keeps it
+    //  until whoever claims its position takes it out, so if head did not move, all counted slots are still ready.
+    uint64_t position = atomic_load_explicit(&this->head, memory_order_relaxed);
+    uint_fast32_t count;
+    for (;;)
+    {
+        count = 0;
+        while (count < max_count && count <= this->mask)
+        {
+            const channel_slot* const slot = this->slots + ((position + count) & this->mask);
+            if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != position + count + 1)
+            {
+                break;
+            }
+            count += 1;
+        }
+        if (!count)
+        {
+            const uint64_t current = atomic_load_explicit(&this->head, memory_order_relaxed);
+            if (current == position)
+            {
+                return 0;
+            }
+            //  Someone else received from this position already
+            position = current;
+            continue;
+        }
+        if (this->flags & SHM_CHANNEL_SINGLE_CONSUMER)
+        {
+            atomic_store_explicit(&this->head, position + count, memory_order_relaxed);
+            break;
+        }
+        if (atomic_compare_exchange_weak_explicit(&this->head, &position, position + count, memory_order_relaxed, memory_order_relaxed))
+        {
+            break;
+        }
+    }
+    shm_ill_allocator* const parent = channel_parent(this);
+    for (uint_fast32_t i = 0; i < count; ++i)
+    {
+        channel_slot* const slot = this->slots + ((position + i) & this->mask);
+        out_ptrs[i] = shm_ill_allocator_from_offset(parent, slot->offset);
+        atomic_store_explicit(&slot->sequence, position + i + this->mask + 1, memory_order_release);
+    }
+    return count;
+}
+
+shm_channel* shm_channel_create(shm_ill_allocator* parent, uint_fast32_t capacity, uint_fast32_t flags)
+{
+    if (!capacity || capacity > (1u << 31))
+    {
+        return NULL;
+    }
+    uint_fast64_t slot_count = 2;
+    while (slot_count < capacity)
+    {
+        slot_count <<= 1;
+    }
+    shm_channel* const this = shm_ill_alloc_aligned(parent, sizeof(*this) + slot_count * sizeof(channel_slot), CACHE_LINE_SIZE);
+    if (!this)
+    {
+        return NULL;
+    }
+    memset(this, 0, sizeof(*this));
+    this->flags = flags;
+    this->mask = slot_count - 1;
+    this->parent = (uintptr_t)this - (uintptr_t)parent;
+    for (uint_fast64_t i = 0; i < slot_count; ++i)
+    {
+        this->slots[i].sequence = i;
+        this->slots[i].offset = 0;
+    }
+    return this;
+}
+
+void shm_channel_destroy(shm_channel* channel)
+{
+    shm_channel* this = (shm_channel*)channel;
+    shm_ill_allocator* const parent = channel_parent(this);
+    memset(this, 0, sizeof(*this));
+    shm_ill_jfree(parent, this);
+}
+
+void shm_channel_close(shm_channel* channel)
+{
+    shm_channel* this = (shm_channel*)channel;
+    atomic_store(&this->closed, 1);
+    wake_waiters(&this->recv_futex, &this->recv_waiters, INT_MAX);
+    wake_waiters(&this->send_futex, &this->send_waiters, INT_MAX);
+}
+
+int shm_channel_try_send(shm_channel* channel, void* ptr)
+{
+    shm_channel* this = (shm_channel*)channel;
+    if (atomic_load_explicit(&this->closed, memory_order_relaxed)
+        || !push_value(this, shm_ill_allocator_to_offset(channel_parent(this), ptr)))
+    {
+        return -1;
+    }
+    wake_waiters(&this->recv_futex, &this->recv_waiters, 1);
+    return 0;
+}
+
+int shm_channel_send(shm_channel* channel, void* ptr)
+{
+    shm_channel* this = (shm_channel*)channel;
+    const uint_fast64_t offset = shm_ill_allocator_to_offset(channel_parent(this), ptr);
+    for (;;)
+    {
+        if (atomic_load(&this->closed))
+        {
+            return -1;
+        }
+        if (push_value(this, offset))
+        {
+            break;
+        }
+        //  Waiter is announced before checking again, so that a receiver either frees a slot before the check, or sees
+        //  the waiter and bumps the futex
+        const uint32_t seen = atomic_load(&this->send_futex);
+        atomic_fetch_add(&this->send_waiters, 1);
+        if (!atomic_load(&this->closed) && push_value(this, offset))
+        {
+            atomic_fetch_sub(&this->send_waiters, 1);
+            break;
+        }
+        if (!atomic_load(&this->closed))
+        {
+            wait_for_change(&this->send_futex, seen);
+        }
+        atomic_fetch_sub(&this->send_waiters, 1);
+    }
+    wake_waiters(&this->recv_futex, &this->recv_waiters, 1);
+    return 0;
+}
+
+int shm_channel_try_recv(shm_channel* channel, void** p_ptr)
+{
+    shm_channel* this = (shm_channel*)channel;
+    if (!take_values(this, 1, p_ptr))
+    {
+        return -1;
+    }
+    wake_waiters(&this->send_futex, &this->send_waiters, 1);
+    return 0;
+}
+
+int shm_channel_recv(shm_channel* channel, void** p_ptr)
+{
+    return shm_channel_recv_batch(channel, 1, p_ptr) == 1 ? 0 : -1;
+}
+
+uint_fast32_t shm_channel_recv_batch(shm_channel* channel, uint_fast32_t max_count, void** out_ptrs)
+{
+    shm_channel* this = (shm_channel*)channel;
+    if (!max_count)
+    {
+        return 0;
+    }
+    uint_fast32_t count;
+    for (;;)
+    {
+        count = take_values(this, max_count, out_ptrs);
+        if (count)
+        {
+            break;
+        }
+        if (atomic_load(&this->closed))
+        {
+            return 0;
+        }
+        //  Same as with sending, the waiter is announced before checking again
+        const uint32_t seen = atomic_load(&this->recv_futex);
+        atomic_fetch_add(&this->recv_waiters, 1);
+        count = take_values(this, max_count, out_ptrs);
+        if (count)
+        {
+            atomic_fetch_sub(&this->recv_waiters, 1);
+            break;
+        }
+        if (!atomic_load(&this->closed))
+        {
+            wait_for_change(&this->recv_futex, seen);
+        }
+        atomic_fetch_sub(&this->recv_waiters, 1);
+    }
+    wake_waiters(&this->send_futex, &this->send_waiters, count > INT_MAX ? INT_MAX : (int)count);
+    return count;
+}
@@ -6,16 +6,23 @@
 #include <errno.h>
 #include <assert.h>
 #include <string.h>
+#include <stdlib.h>
 #ifndef _WIN32
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <stddef.h>
 #include <linux/futex.h>
 #include <sys/syscall.h>
 #include <stdatomic.h>
+#include <pthread.h>
 #else
 #include <windows.h>
 #endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 typedef struct mem_chunk_struct mem_chunk;
 struct mem_chunk_struct
 {
@@ -23,24 +30,58 @@ struct mem_chunk_struct
     uint_fast64_t size:48;
     uint_fast64_t idx:13;
 #else
-    uint_fast64_t size:63;
+    uint_fast64_t size:62;
 #endif
+    uint_fast64_t prev_used:1;
     uint_fast64_t used:1;
-    mem_chunk* next;
-    mem_chunk* prev;
+    //  Links of free chunks are offsets from the start of their pool, so they are valid wherever the pool is mapped. Pool
+    //  header is at offset 0, where no chunk can be, so 0 stands for no chunk.
+    uint_fast64_t next;
+    uint_fast64_t prev;
 };
 #if __STDC_VERSION__ == 201112L
 static_assert(offsetof(mem_chunk, next) == 8);
 #endif
+//  Free chunks also end with a boundary tag holding their size, which lets the chunk physically following them find
+//  them in constant time when its prev_used bit is not set. Chunks must therefore have room for the tag.
+enum {MIN_CHUNK_SIZE = sizeof(mem_chunk) + sizeof(uint_fast64_t)};
+
+//  Free chunks of each pool are kept in a two-level segregated fit index (TLSF). The first level splits sizes by
+//  powers of two, the second level splits each power of two range linearly into SL_INDEX_COUNT bins. Bitmaps of
+//  non-empty bins allow finding a fitting bin with a couple of bit scans, instead of walking a list of chunks.
+enum
+{
+    ALIGN_SIZE_LOG2 = 3,
+    ALIGN_SIZE = (1 << ALIGN_SIZE_LOG2),
+    SL_INDEX_LOG2 = 4,
+    SL_INDEX_COUNT = (1 << SL_INDEX_LOG2),
+    FL_INDEX_SHIFT = (SL_INDEX_LOG2 + ALIGN_SIZE_LOG2),
+    SMALL_BLOCK_SIZE = (1 << FL_INDEX_SHIFT),
+    FL_INDEX_COUNT = (64 - FL_INDEX_SHIFT + 1),
+};
+
 typedef struct mem_pool_struct mem_pool;
+//  Pool control block, which is placed at the very beginning of the pool's memory, followed by its free chunk bins
+//  and then by the chunks themselves
 struct mem_pool_struct
 {
     uint_fast64_t size;
     uint_fast64_t free;
     uint_fast64_t used;
-    mem_chunk* largest;
-    mem_chunk* smallest;
-    void* base;
+    uint_fast64_t fl_bitmap;
+    uint_fast32_t fl_count;
+    //  Value of the allocator's free counter when the pool last became empty, and when its pages were last released
+    uint_fast64_t empty_since;
+    uint_fast64_t trimmed_at;
+    //  Futex guarding the pool when the allocator uses SHM_ILL_ALLOCATOR_POOL_LOCKS, and its spin estimate
+    uint32_t lock;
+    uint32_t lock_spins;
+    //  Blocks allocated from and freed to the pool, when the allocator uses SHM_ILL_ALLOCATOR_POOL_LOCKS
+    uint_fast64_t op_counts[2];
+    uint32_t sl_bitmap[FL_INDEX_COUNT];
+    //  Offset of the first chunk and offsets of the first chunk in each bin, in the same way as chunk links
+    uint_fast64_t base;
+    uint_fast64_t bins[];
 };
 
 /**
@@ -48,16 +89,24 @@ struct mem_pool_struct
  */
 typedef struct shm_ill_allocator_struct shm_ill_allocator;
 
+//  Longest name of a named allocator's shared memory object, including the terminating null
+enum {NAMED_ALLOCATOR_NAME_LENGTH = 64};
+//  Written into a named allocator's header once it is fully set up, so that processes attaching to it can tell
+enum {NAMED_ALLOCATOR_MAGIC = 0x6A6D656D};
+
 struct shm_ill_allocator_struct
 {
 #ifndef NDEBUG
     const char* futex_acquired_in;
 #endif
-    uint32_t futex_waiter_count;
     uint32_t access_futex_value;
+    //  Running estimate of how long the mutex is spun on before it is acquired
+    uint32_t access_futex_spins;
     uint_fast64_t pool_size;
     uint_fast64_t capacity;
     uint_fast64_t count;
+    uint_fast64_t id;
+    uint_fast32_t flags;
 #ifdef JMEM_ALLOC_TRACKING
     uint_fast64_t allocator_index;
     uint_fast64_t total_allocated;
@@ -71,9 +120,35 @@ struct shm_ill_allocator_struct
     void(* trap_callbacks[JMEM_ALLOC_TRAP_COUNT])(uint32_t idx, void* param);
     void* trap_params[JMEM_ALLOC_TRAP_COUNT];
 #endif
-    mem_pool* pools;
+    //  Offset of the pool table from the allocator, and in the table offsets of pools from the allocator. Offsets wrap
+    //  around, so memory mapped below the allocator works as well. Since nothing in the shared memory refers to an
+    //  absolute address, processes may map it anywhere.
+    uint_fast64_t pools;
     uint_fast64_t pool_buffer_size;
+    //  Named and reserved allocators live in a single region of reserved_size bytes. The allocator is at its start,
+    //  followed by the pool table and then the pools, which are appended as the region is used up. Last pool added ends
+    //  at segment_size. For named allocators the region is a shared memory object, which each process maps on its own,
+    //  otherwise it is mapped once before any fork, so every process already sees all of it.
+    char name[NAMED_ALLOCATOR_NAME_LENGTH];
+    uint32_t initialized;
+    uint_fast64_t reserved_size;
+    uint_fast64_t segment_size;
+    //  Statistics, which are always kept and updated atomically, so that they can be read at any time without locking.
+    //  They describe the shared heap, so blocks held by thread caches count as used.
+    uint_fast64_t bytes_in_use;
+    uint_fast64_t peak_bytes_in_use;
+    uint_fast64_t op_counts[2];
+    uint_fast64_t reallocation_count;
+    //  Trimming policy: number of empty pools of the default size to keep, and the number of frees a pool must have
+    //  been empty for before its pages are released automatically
+    uint_fast64_t free_count;
+    uint_fast64_t spare_pools;
+    uint_fast64_t trim_delay;
+    uint_fast64_t next_trim;
+    int auto_trim;
 
+    //  Callbacks are only kept here for allocators which are not named. Named allocators are shared with unrelated
+    //  processes, where these addresses mean nothing, so each process keeps its own in its segment_mapping.
     void (* bad_alloc_callback)(shm_ill_allocator* allocator, void* param);
     void* bad_alloc_param;
 
@@ -83,6 +158,112 @@ struct shm_ill_allocator_struct
 
 static uint_fast64_t PAGE_SIZE = 0;
 
+//  Most times a lock is spun on before waiting in the kernel. Spinning can only help if the holder runs at the same
+//  time, so it is not done on a single CPU.
+enum {FUTEX_MAX_SPINS = 1 << 10};
+static uint32_t FUTEX_SPIN_LIMIT = 0;
+
+//  Size of huge pages used with SHM_ILL_ALLOCATOR_HUGE_PAGES
+enum {HUGE_PAGE_SIZE = 1 << 21};
+
+//  Kinds of operations counted in op_counts
+enum {OP_COUNT_ALLOCATION, OP_COUNT_RELEASE};
+
+//  Number of entries reserved for the pool table with SHM_ILL_ALLOCATOR_POOL_LOCKS. Pools are looked up without holding
+//  the allocator's lock, so the table can never be moved to grow it.
+enum {POOL_TABLE_CAPACITY = 1 << 16};
+
+//  Allocators are given unique ids, so that thread caches can tell a new allocator from a destroyed one at the same
+//  address
+static uint_fast64_t ALLOCATOR_ID_COUNTER = 0;
+
+//  Thread caches keep magazines of small blocks, which were taken out of the shared heap in batches, so that most small
+//  allocations and frees never touch the allocator mutex. Each class holds chunks of at least (class + 1) *
+//  THREAD_CACHE_CLASS_SIZE bytes.
+enum
+{
+    THREAD_CACHE_CLASS_SIZE = 32,
+    THREAD_CACHE_CLASS_COUNT = 16,
+    THREAD_CACHE_MAGAZINE_SIZE = 16,
+    THREAD_CACHE_BATCH = THREAD_CACHE_MAGAZINE_SIZE / 2,
+    THREAD_CACHE_SLOTS = 4,
+};
+
+typedef struct thread_cache_struct thread_cache;
+struct thread_cache_struct
+{
+    shm_ill_allocator* allocator;
+    uint_fast64_t allocator_id;
+    uint32_t counts[THREAD_CACHE_CLASS_COUNT];
+    void* magazines[THREAD_CACHE_CLASS_COUNT][THREAD_CACHE_MAGAZINE_SIZE];
+};
+
+#ifdef _MSC_VER
+static __declspec(thread) thread_cache THREAD_CACHES[THREAD_CACHE_SLOTS];
+#else
+static __thread thread_cache THREAD_CACHES[THREAD_CACHE_SLOTS];
+#endif
+
+#ifndef _WIN32
+static pthread_once_t FORK_HANDLER_ONCE = PTHREAD_ONCE_INIT;
+
+static void forget_thread_caches(void)
+{
+    //  Child only has a copy of the forking thread's caches. Blocks in them are still used by the shared heap and owned
+    //  by that thread in the parent, so handing them out here would give the same block to both processes. They are
+    //  dropped, which leaves them to the parent.
+    memset(THREAD_CACHES, 0, sizeof(THREAD_CACHES));
+}
+
+static void register_fork_handler(void)
+{
+    const int res = pthread_atfork(NULL, NULL, forget_thread_caches);
+    assert(res == 0);
+    (void)res;
+}
+#endif
+
+//  Blocks in a magazine stay marked as used, so their first two words hold a tag instead, which lets freeing one again
+//  be caught from any thread. Tag is cleared whenever the block leaves the magazine, so no block in the heap has one.
+static const uint_fast64_t CACHED_BLOCK_TAG = 0x6A6D656D63616368;
+
+static inline void tag_cached_block(const shm_ill_allocator* this, void* ptr)
+{
+    uint_fast64_t* const words = ptr;
+    words[0] = CACHED_BLOCK_TAG;
+    words[1] = this->id;
+}
+
+static inline void untag_cached_block(void* ptr)
+{
+    uint_fast64_t* const words = ptr;
+    words[0] = 0;
+}
+
+static inline int is_cached_block(const shm_ill_allocator* this, const void* ptr)
+{
+    const uint_fast64_t* const words = ptr;
+    return words[0] == CACHED_BLOCK_TAG && words[1] == this->id;
+}
+
+//  Each process keeps its own descriptor of every named allocator it uses, along with how much of the shared memory
+//  object it has mapped so far
+enum {SEGMENT_MAPPING_SLOTS = 16};
+
+typedef struct segment_mapping_struct segment_mapping;
+struct segment_mapping_struct
+{
+    shm_ill_allocator* allocator;
+    int fd;
+    uint_fast64_t mapped_size;
+    void (* bad_alloc_callback)(shm_ill_allocator* allocator, void* param);
+    void* bad_alloc_param;
+    void (* double_free_callback)(shm_ill_allocator* allocator, void* param);
+    void* double_free_param;
+};
+
+static segment_mapping SEGMENT_MAPPINGS[SEGMENT_MAPPING_SLOTS];
+
 static const char* const ILL_ALLOCATOR_TYPE_STRING = "Shared implicit linked list allocator";
 
 static inline uint_fast64_t round_to_nearest_page_up(uint_fast64_t v)
@@ -95,43 +276,189 @@ static inline uint_fast64_t round_to_nearest_page_up(uint_fast64_t v)
     return v;
 }
 
+static inline uint_fast32_t bit_scan_forward(uint_fast64_t v)
+{
+    assert(v);
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward64(&idx, v);
+    return idx;
+#else
+    return __builtin_ctzll(v);
+#endif
+}
+
+static inline uint_fast32_t bit_scan_reverse(uint_fast64_t v)
+{
+    assert(v);
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanReverse64(&idx, v);
+    return idx;
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+static inline void mapping_insert(uint_fast64_t size, uint_fast32_t* p_fl, uint_fast32_t* p_sl)
+{
+    if (size < SMALL_BLOCK_SIZE)
+    {
+        //  Small chunks are split linearly into the first level
+        *p_fl = 0;
+        *p_sl = size >> ALIGN_SIZE_LOG2;
+    }
+    else
+    {
+        const uint_fast32_t msb = bit_scan_reverse(size);
+        *p_sl = (size >> (msb - SL_INDEX_LOG2)) ^ SL_INDEX_COUNT;
+        *p_fl = msb - (FL_INDEX_SHIFT - 1);
+    }
+}
+
+static inline void mapping_search(uint_fast64_t size, uint_fast32_t* p_fl, uint_fast32_t* p_sl)
+{
+    //  Round the size up to the next bin, so that any chunk in the bin found is large enough
+    if (size >= SMALL_BLOCK_SIZE)
+    {
+        size += (1llu << (bit_scan_reverse(size) - SL_INDEX_LOG2)) - 1;
+    }
+    mapping_insert(size, p_fl, p_sl);
+}
+
+static inline uint_fast32_t pool_fl_count(uint_fast64_t pool_size)
+{
+    //  No chunk can be larger than the pool itself, which bounds the number of first level bins it needs
+    uint_fast32_t fl, sl;
+    mapping_insert(pool_size, &fl, &sl);
+    return fl + 1;
+}
+
+static inline uint_fast64_t pool_header_size(uint_fast64_t pool_size)
+{
+    const uint_fast64_t size = sizeof(mem_pool) + pool_fl_count(pool_size) * SL_INDEX_COUNT * sizeof(uint_fast64_t);
+    return (size + 7) & ~(uint_fast64_t)7;
+}
+
+//  Locks are futexes with three states: free, used by someone with nobody waiting, and used with possible waiters. Only
+//  the last one makes the holder wake anyone up, so an uncontended lock never enters the kernel.
 enum shm_allocator_futex_values
 {
     FUTEX_FREE,
     FUTEX_USED,
+    FUTEX_CONTENDED,
     FUTEX_DIE,
 };
 
-static inline int acquire_allocator_mutex(shm_ill_allocator* const this, const char* fn)
+static inline void cpu_relax(void)
+{
+#if defined(_MSC_VER)
+    _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static inline int lock_futex(uint32_t* p_futex, uint32_t* p_spins)
 {
-    uint32_t fv = atomic_exchange(&this->access_futex_value, FUTEX_USED);
-    atomic_fetch_add(&this->futex_waiter_count, 1);
-    while (fv != FUTEX_FREE)
+    uint32_t fv = FUTEX_FREE;
+    if (atomic_compare_exchange_strong(p_futex, &fv, FUTEX_USED))
+    {
+        return 1;
+    }
+    //  Holder is likely to be done soon, so spin for a while first. How long is adapted to how long it took before, so
+    //  locks held for long quickly stop wasting time spinning.
+    const uint32_t estimate = atomic_load_explicit(p_spins, memory_order_relaxed);
+    const uint32_t max_spins = 2 * estimate + 16 < FUTEX_SPIN_LIMIT ? 2 * estimate + 16 : FUTEX_SPIN_LIMIT;
+    for (uint32_t i = 0; i < max_spins; ++i)
+    {
+        cpu_relax();
+        fv = atomic_load_explicit(p_futex, memory_order_relaxed);
+        if (fv == FUTEX_FREE && atomic_compare_exchange_weak(p_futex, &fv, FUTEX_USED))
+        {
+            atomic_store_explicit(p_spins, estimate + ((int32_t)(i - estimate) / 8), memory_order_relaxed);
+            return 1;
+        }
+        if (fv != FUTEX_USED)
+        {
+            //  Someone is already waiting in the kernel, so there is no point in spinning
+            break;
+        }
+    }
+    if (max_spins)
     {
+        atomic_store_explicit(p_spins, estimate + ((int32_t)(max_spins - estimate) / 8), memory_order_relaxed);
+    }
+
+    //  Lock is marked as contended while waiting, so the holder knows to wake someone. Since others may still be waiting
+    //  once this one takes it, it stays marked as contended.
+    for (;;)
+    {
+        fv = atomic_load(p_futex);
+        if (fv == FUTEX_DIE)
+        {
+            return 0;
+        }
+        if (fv == FUTEX_FREE)
+        {
+            if (atomic_compare_exchange_weak(p_futex, &fv, FUTEX_CONTENDED))
+            {
+                return 1;
+            }
+            continue;
+        }
+        if (fv == FUTEX_USED && !atomic_compare_exchange_weak(p_futex, &fv, FUTEX_CONTENDED))
+        {
+            continue;
+        }
         const long res = syscall(
                 SYS_futex,  //  Syscall code
-                &this->access_futex_value,  //  Address in question
+                p_futex,  //  Address in question
                 FUTEX_WAIT,  //  futex_op
-                FUTEX_USED,  //  val
+                FUTEX_CONTENDED,  //  val
                 NULL,  //  timeout
                 0,  //  uaddr2
                 0//  val3
                                 );
-        if (res == -1 && errno != EAGAIN)
-        {
-            atomic_fetch_sub(&this->futex_waiter_count, 1);
-            return 0;
-        }
-        //  Futex value changed
-        fv = atomic_exchange(&this->access_futex_value, FUTEX_USED);
-        if (fv == FUTEX_DIE)
+        if (res == -1 && errno != EAGAIN && errno != EINTR)
         {
-            atomic_fetch_sub(&this->futex_waiter_count, 1);
             return 0;
         }
     }
-    assert(fv == FUTEX_FREE);
-    atomic_fetch_sub(&this->futex_waiter_count, 1);
+}
+
+static inline int try_lock_futex(uint32_t* p_futex)
+{
+    uint32_t expected = FUTEX_FREE;
+    return atomic_compare_exchange_strong(p_futex, &expected, FUTEX_USED);
+}
+
+static inline void unlock_futex(uint32_t* p_futex)
+{
+    const uint32_t fv = atomic_exchange(p_futex, FUTEX_FREE);
+    assert(fv == FUTEX_USED || fv == FUTEX_CONTENDED);
+    if (fv == FUTEX_CONTENDED)
+    {
+        syscall(
+                SYS_futex,
+                p_futex,
+                FUTEX_WAKE,
+                1,  // how many to wake
+                NULL,
+                0,
+                0
+                );
+    }
+}
+
+static inline int acquire_allocator_mutex(shm_ill_allocator* const this, const char* fn)
+{
+    if (!lock_futex(&this->access_futex_value, &this->access_futex_spins))
+    {
+        return 0;
+    }
 #ifndef NDEBUG
     assert(this->futex_acquired_in == NULL);
     this->futex_acquired_in = fn;
@@ -143,128 +470,179 @@ static inline int acquire_allocator_mutex(shm_ill_allocator* const this, const c
 
 static void release_allocator_mutex(shm_ill_allocator* const this, const char* fn)
 {
-    assert(this->access_futex_value == FUTEX_USED);
 #ifndef NDEBUG
     assert(strcmp(this->futex_acquired_in, fn) == 0);
     this->futex_acquired_in = NULL;
 #else
     (void)fn;
 #endif
-    this->access_futex_value = FUTEX_FREE;
-    syscall(
-            SYS_futex,
-            &this->access_futex_value,
-            FUTEX_WAKE,
-            INT32_MAX,  // how many to wake
-            NULL,
-            0,
-            0
-            );
+    unlock_futex(&this->access_futex_value);
 }
 
+//  Without SHM_ILL_ALLOCATOR_POOL_LOCKS the allocator mutex is held for the whole of every operation, so pool locks and
+//  the pool table lock do nothing. With it, the allocator mutex is only held as the pool table lock, which is always
+//  taken before any pool lock and never while one is held.
+static inline int has_pool_locks(const shm_ill_allocator* this)
+{
+    return (this->flags & SHM_ILL_ALLOCATOR_POOL_LOCKS) != 0;
+}
 
-void shm_ill_allocator_destroy(shm_ill_allocator* allocator)
+static inline int lock_allocator(shm_ill_allocator* this, const char* fn)
 {
-    shm_ill_allocator* this = (shm_ill_allocator*)allocator;
-    assert(this->futex_waiter_count == 0);
-    for (uint_fast32_t i = 0; i < this->count; ++i)
+    return has_pool_locks(this) ? 1 : acquire_allocator_mutex(this, fn);
+}
+
+static inline void unlock_allocator(shm_ill_allocator* this, const char* fn)
+{
+    if (!has_pool_locks(this))
     {
-#ifndef _WIN32
-        munmap(this->pools[i].base, this->pool_size);
-#else
-        BOOL res = VirtualFree(allocator->pools[i].base, 0, MEM_RELEASE);
-        assert(res != 0);
-#endif
+        release_allocator_mutex(this, fn);
     }
-    for (uint_fast64_t i = 0; i < this->count; ++i)
+}
+
+static inline int lock_table(shm_ill_allocator* this, const char* fn)
+{
+    return has_pool_locks(this) ? acquire_allocator_mutex(this, fn) : 1;
+}
+
+static inline void unlock_table(shm_ill_allocator* this, const char* fn)
+{
+    if (has_pool_locks(this))
     {
-        this->pools[i] = (mem_pool){0};
+        release_allocator_mutex(this, fn);
     }
-#ifndef _WIN32
-    munmap(this->pools, this->pool_buffer_size);
-#else
-    VirtualFree(this->pools, 0, MEM_RELEASE);
-#endif
-    *this = (shm_ill_allocator){0};
-#ifndef _WIN32
-    munmap(this, round_to_nearest_page_up(sizeof(*this)));
-#else
-    VirtualFree(this, 0, MEM_RELEASE);
-#endif
 }
 
-static inline uint_fast64_t round_up_size(uint_fast64_t size)
+static inline void lock_pool(const shm_ill_allocator* this, mem_pool* pool)
 {
-    uint_fast64_t remainder = 8 - (size & 7);
-    size += remainder;
-    size += offsetof(mem_chunk, next);
-    if (size < sizeof(mem_chunk))
+    if (has_pool_locks(this))
     {
-        return sizeof(mem_chunk);
+        //  Pool locks are never torn down, so acquiring them can only fail with a broken futex
+        const int res = lock_futex(&pool->lock, &pool->lock_spins);
+        assert(res);
+        (void)res;
     }
-    return size;
 }
 
-static inline mem_pool* find_supporting_pool(shm_ill_allocator* allocator, uint_fast64_t size)
+static inline int try_lock_pool(const shm_ill_allocator* this, mem_pool* pool)
 {
-    for (uint_fast32_t i = 0; i < allocator->count; ++i)
+    return has_pool_locks(this) ? try_lock_futex(&pool->lock) : 1;
+}
+
+static inline void unlock_pool(const shm_ill_allocator* this, mem_pool* pool)
+{
+    if (has_pool_locks(this))
     {
-        mem_pool* pool = allocator->pools + i;
-        if (pool->largest && size <= pool->largest->size)
-        {
-            return pool;
-        }
+        unlock_futex(&pool->lock);
     }
-    return NULL;
 }
 
-static inline mem_chunk* find_ge_chunk_from_largest(mem_pool* pool, uint_fast64_t size)
+
+static inline mem_chunk* chunk_at(const mem_pool* pool, uint_fast64_t offset)
+{
+    return offset ? (mem_chunk*)((uintptr_t)pool + offset) : NULL;
+}
+
+static inline uint_fast64_t chunk_offset(const mem_pool* pool, const mem_chunk* chunk)
+{
+    return chunk ? (uintptr_t)chunk - (uintptr_t)pool : 0;
+}
+
+static inline uint_fast64_t* pool_table(const shm_ill_allocator* this)
+{
+    return (uint_fast64_t*)((uintptr_t)this + this->pools);
+}
+
+static inline mem_pool* pool_at(const shm_ill_allocator* this, uint_fast64_t i)
+{
+    return (mem_pool*)((uintptr_t)this + pool_table(this)[i]);
+}
+
+static inline uint_fast64_t pool_offset(const shm_ill_allocator* this, const void* ptr)
 {
-    mem_chunk* current;
-    for (current = pool->largest; current; current = current->prev)
+    return (uintptr_t)ptr - (uintptr_t)this;
+}
+
+static inline mem_chunk* next_chunk(const mem_pool* pool, const mem_chunk* chunk)
+{
+    const uintptr_t next = (uintptr_t)chunk + chunk->size;
+    return next < (uintptr_t)pool + pool->size ? (mem_chunk*)next : NULL;
+}
+
+static inline mem_chunk* previous_free_chunk(const mem_chunk* chunk)
+{
+    assert(!chunk->prev_used);
+    const uint_fast64_t prev_size = *(const uint_fast64_t*)((uintptr_t)chunk - sizeof(uint_fast64_t));
+    return (mem_chunk*)((uintptr_t)chunk - prev_size);
+}
+
+static inline void mark_chunk_used(const mem_pool* pool, mem_chunk* chunk)
+{
+    chunk->used = 1;
+    mem_chunk* const next = next_chunk(pool, chunk);
+    if (next)
     {
-        if (current->size >= size)
-        {
-            return current;
-        }
+        next->prev_used = 1;
     }
-    return NULL;
 }
 
-static inline mem_chunk* find_ge_chunk_from_smallest(mem_pool* pool, uint_fast64_t size)
+static inline void insert_chunk_into_bins(mem_pool* pool, mem_chunk* chunk)
 {
-    mem_chunk* current;
-    for (current = pool->smallest; current; current = current->next)
+    assert(chunk->used == 0);
+    //  Write the boundary tag and let the following chunk know this one is free
+    *(uint_fast64_t*)((uintptr_t)chunk + chunk->size - sizeof(uint_fast64_t)) = chunk->size;
+    mem_chunk* const next = next_chunk(pool, chunk);
+    if (next)
     {
-        if (current->size >= size)
-        {
-            return current;
-        }
+        assert(next->used);
+        next->prev_used = 0;
     }
-    return NULL;
+    uint_fast32_t fl, sl;
+    mapping_insert(chunk->size, &fl, &sl);
+    assert(fl < pool->fl_count);
+    uint_fast64_t* const p_head = pool->bins + fl * SL_INDEX_COUNT + sl;
+    const uint_fast64_t offset = chunk_offset(pool, chunk);
+    chunk->prev = 0;
+    chunk->next = *p_head;
+    if (*p_head)
+    {
+        chunk_at(pool, *p_head)->prev = offset;
+    }
+    *p_head = offset;
+    pool->fl_bitmap |= (uint_fast64_t)1 << fl;
+    pool->sl_bitmap[fl] |= (uint32_t)1 << sl;
+    pool->free += chunk->size;
+    pool->used -= chunk->size;
 }
 
 static inline void remove_chunk_from_pool(mem_pool* pool, mem_chunk* chunk)
 {
+    uint_fast32_t fl, sl;
+    mapping_insert(chunk->size, &fl, &sl);
+    uint_fast64_t* const p_head = pool->bins + fl * SL_INDEX_COUNT + sl;
     if (chunk->next)
     {
-        assert(chunk->next->prev == chunk);
-        (chunk->next)->prev = chunk->prev;
-    }
-    else
-    {
-//        assert(pool->largest == chunk);
-        pool->largest = chunk->prev;
+        assert(chunk_at(pool, chunk->next)->prev == chunk_offset(pool, chunk));
+        chunk_at(pool, chunk->next)->prev = chunk->prev;
     }
     if (chunk->prev)
     {
-        assert(chunk->prev->next == chunk);
-        (chunk->prev)->next = chunk->next;
+        assert(chunk_at(pool, chunk->prev)->next == chunk_offset(pool, chunk));
+        chunk_at(pool, chunk->prev)->next = chunk->next;
     }
     else
     {
-        assert(pool->smallest == chunk);
-        pool->smallest = chunk->next;
+        assert(*p_head == chunk_offset(pool, chunk));
+        *p_head = chunk->next;
+        //  Check if the bin is now empty
+        if (!*p_head)
+        {
+            pool->sl_bitmap[fl] &= ~((uint32_t)1 << sl);
+            if (!pool->sl_bitmap[fl])
+            {
+                pool->fl_bitmap &= ~((uint_fast64_t)1 << fl);
+            }
+        }
     }
     pool->free -= chunk->size;
     pool->used += chunk->size;
@@ -272,201 +650,687 @@ static inline void remove_chunk_from_pool(mem_pool* pool, mem_chunk* chunk)
 
 static inline void insert_chunk_into_pool(mem_pool* pool, mem_chunk* chunk)
 {
-beginning_of_fn:
     assert(chunk->used == 0);
-    //  Check if pool has other chunks
-    if (pool->free == 0)
+    //  Check if the chunk directly following is free
+    mem_chunk* const next = next_chunk(pool, chunk);
+    if (next && next->used == 0)
     {
-        assert(!pool->smallest && !pool->largest);
-        pool->smallest = chunk;
-        pool->largest = chunk;
-        chunk->next = NULL;
-        chunk->prev = NULL;
+        //  Pull it from the pool and merge chunk with it
+        remove_chunk_from_pool(pool, next);
+        chunk->size += next->size;
     }
-    else
-    {
-        mem_chunk* ge_chunk = NULL;
-        for (mem_chunk* current = pool->smallest; current; current = current->next)
-        {
-            //  Check if the current directly follows chunk
-            if (((uintptr_t)chunk) + chunk->size == (uintptr_t)current)
-            {
-                //  Pull the current from the pool
-                remove_chunk_from_pool(pool, current);
-                //  Merge chunk with current
-                chunk->size += current->size;
-                goto beginning_of_fn;
-            }
 
-            //  Check if the current directly precedes chunk
-            if (((uintptr_t)current) + current->size == (uintptr_t)chunk)
-            {
-                //  Pull the current from the pool
-                remove_chunk_from_pool(pool, current);
-                //  Merge chunk with current
-                current->size += chunk->size;
-                chunk = current;
-                goto beginning_of_fn;
-            }
+    //  Check if the chunk directly preceding is free
+    if (!chunk->prev_used)
+    {
+        //  Pull it from the pool and merge it with chunk
+        mem_chunk* const prev = previous_free_chunk(chunk);
+        assert(prev->used == 0 && prev->prev_used);
+        remove_chunk_from_pool(pool, prev);
+        prev->size += chunk->size;
+        chunk = prev;
+    }
 
-            //  Check if current->size is greater than or equal chunk->size
-            if (!ge_chunk && current->size >= chunk->size)
-            {
-                ge_chunk = current;
-            }
-        }
+    insert_chunk_into_bins(pool, chunk);
+}
 
-        //  Find first larger or equally sized chunk
-//        mem_chunk* ge_chunk = find_ge_chunk_from_smallest(pool, chunk->size);
-        if (!ge_chunk)
-        {
-            //  No others are larger or of equal size, so this is the new largest
-            assert(pool->largest->size < chunk->size);
-            pool->largest->next = chunk;
-            chunk->prev = pool->largest;
-            chunk->next = NULL;
-            pool->largest = chunk;
-        }
-        else
+static inline mem_chunk* find_good_fit_chunk(const mem_pool* pool, uint_fast64_t size)
+{
+    //  Search from the bin after the one size would be put in, since all chunks there are guaranteed to be large enough
+    uint_fast32_t fl, sl;
+    mapping_search(size, &fl, &sl);
+    if (fl >= pool->fl_count)
+    {
+        return NULL;
+    }
+    uint_fast32_t sl_map = pool->sl_bitmap[fl] & (~(uint32_t)0 << sl);
+    if (!sl_map)
+    {
+        //  No bins in this first level, so move to the first larger non-empty one
+        const uint_fast64_t fl_map = pool->fl_bitmap & (~(uint_fast64_t)0 << (fl + 1));
+        if (!fl_map)
         {
-            //  Chunk belongs after the ge_chunk in the list
-            chunk->prev = ge_chunk->prev;
-            chunk->next = ge_chunk;
-            assert(!chunk->prev || chunk->prev->size <= chunk->size);
-            assert(!chunk->next || chunk->next->size >= chunk->size);
-            //  Check if ge_chunk was smallest in pool
-            if (ge_chunk->prev)
-            {
-                (ge_chunk->prev)->next = chunk;
-            }
-            else
-            {
-                assert(ge_chunk == pool->smallest);
-                pool->smallest = chunk;
-            }
-            ge_chunk->prev = chunk;
+            return NULL;
         }
+        fl = bit_scan_forward(fl_map);
+        sl_map = pool->sl_bitmap[fl];
+        assert(sl_map);
     }
-    pool->free += chunk->size;
-    pool->used -= chunk->size;
+    sl = bit_scan_forward(sl_map);
+    assert(pool->bins[fl * SL_INDEX_COUNT + sl]);
+    return chunk_at(pool, pool->bins[fl * SL_INDEX_COUNT + sl]);
 }
 
-static inline mem_pool* find_chunk_pool(shm_ill_allocator* allocator, void* ptr)
+static inline mem_chunk* find_exact_fit_chunk(const mem_pool* pool, uint_fast64_t size)
 {
-    for (uint_fast32_t i = 0; i < allocator->count; ++i)
+    //  Chunks which fit, but were skipped by find_good_fit_chunk, can only be in the bin size itself would be put in
+    uint_fast32_t fl, sl;
+    mapping_insert(size, &fl, &sl);
+    if (fl >= pool->fl_count)
+    {
+        return NULL;
+    }
+    for (mem_chunk* current = chunk_at(pool, pool->bins[fl * SL_INDEX_COUNT + sl]); current; current = chunk_at(pool, current->next))
     {
-        mem_pool* pool = allocator->pools + i;
-        if (pool->base <= ptr && (uintptr_t)pool->base + (pool->used + pool->free) > (uintptr_t)ptr)
+        if (current->size >= size)
         {
-            return pool;
+            return current;
         }
     }
     return NULL;
 }
 
-void* shm_ill_alloc(shm_ill_allocator* allocator, uint_fast64_t size)
+static void init_pool(mem_pool* pool, uint_fast64_t pool_size);
+
+static mem_pool* map_pool(uint_fast64_t pool_size, int huge_pages)
 {
-    shm_ill_allocator* this = (shm_ill_allocator*)allocator;
-    void* ptr = NULL;
-    //  Round up size to 8 bytes
-    size = round_up_size(size);
-    const int mtx_res = acquire_allocator_mutex(this, __func__);
-    if (mtx_res == 0) return NULL;
-    //  Check there's a pool that can support the allocation
-    mem_pool* pool = find_supporting_pool(this, size);
-    if (!pool)
+    assert((pool_size & (PAGE_SIZE - 1)) == 0);
+#ifndef _WIN32
+    mem_pool* pool = MAP_FAILED;
+    if (huge_pages)
     {
-        //  Create a new pool
-        if (this->count == this->capacity)
+        assert((pool_size & (HUGE_PAGE_SIZE - 1)) == 0);
+        pool = mmap(NULL, pool_size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_SHARED|MAP_HUGETLB, -1, 0);
+    }
+    if (pool == MAP_FAILED)
+    {
+        pool = mmap(NULL, pool_size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_SHARED, -1, 0);
+        if (pool != MAP_FAILED && huge_pages)
+        {
+            //  No explicit huge pages are available, so ask for transparent ones instead
+            madvise(pool, pool_size, MADV_HUGEPAGE);
+        }
+    }
+    if (pool == MAP_FAILED)
+#else
+    //  Large pages need special privileges on Windows, so huge_pages is ignored
+    (void)huge_pages;
+    mem_pool* pool = VirtualAlloc(NULL, pool_size, MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
+    if (pool == NULL)
+#endif
+    {
+        return NULL;
+    }
+    init_pool(pool, pool_size);
+    return pool;
+}
+
+static void init_pool(mem_pool* pool, uint_fast64_t pool_size)
+{
+    //  Memory is zeroed when it is mapped, so bitmaps and bins are already empty
+    const uint_fast64_t header_size = pool_header_size(pool_size);
+    pool->size = pool_size;
+    pool->fl_count = pool_fl_count(pool_size);
+    //  Pages of a new pool have never been touched, so there is nothing to release until it is used
+    pool->empty_since = 0;
+    pool->trimmed_at = 0;
+    pool->base = header_size;
+    pool->used = pool_size - header_size;
+    pool->free = 0;
+    mem_chunk* base_chunk = chunk_at(pool, pool->base);
+    base_chunk->size = pool_size - header_size;
+    base_chunk->used = 0;
+    base_chunk->prev_used = 1;
+    insert_chunk_into_bins(pool, base_chunk);
+}
+
+static inline uint_fast64_t pool_granularity(const shm_ill_allocator* this)
+{
+    //  Pool sizes are multiples of this
+    return (this->flags & SHM_ILL_ALLOCATOR_HUGE_PAGES) ? HUGE_PAGE_SIZE : PAGE_SIZE;
+}
+
+static void unmap_pool(mem_pool* pool)
+{
+#ifndef _WIN32
+    munmap(pool, pool->size);
+#else
+    BOOL res = VirtualFree(pool, 0, MEM_RELEASE);
+    assert(res != 0);
+#endif
+}
+
+#ifndef _WIN32
+static segment_mapping* find_segment_mapping(const shm_ill_allocator* this)
+{
+    for (uint_fast32_t i = 0; i < SEGMENT_MAPPING_SLOTS; ++i)
+    {
+        if (atomic_load(&SEGMENT_MAPPINGS[i].allocator) == this)
+        {
+            return SEGMENT_MAPPINGS + i;
+        }
+    }
+    return NULL;
+}
+
+static segment_mapping* claim_segment_mapping(shm_ill_allocator* this, int fd, uint_fast64_t mapped_size)
+{
+    //  Nobody else in the process knows of the allocator yet, so the slot can be filled in after it is claimed
+    for (uint_fast32_t i = 0; i < SEGMENT_MAPPING_SLOTS; ++i)
+    {
+        shm_ill_allocator* expected = NULL;
+        if (atomic_compare_exchange_strong(&SEGMENT_MAPPINGS[i].allocator, &expected, this))
+        {
+            SEGMENT_MAPPINGS[i].fd = fd;
+            SEGMENT_MAPPINGS[i].mapped_size = mapped_size;
+            SEGMENT_MAPPINGS[i].bad_alloc_callback = NULL;
+            SEGMENT_MAPPINGS[i].bad_alloc_param = NULL;
+            SEGMENT_MAPPINGS[i].double_free_callback = NULL;
+            SEGMENT_MAPPINGS[i].double_free_param = NULL;
+            return SEGMENT_MAPPINGS + i;
+        }
+    }
+    return NULL;
+}
+
+static void release_segment_mapping(segment_mapping* mapping)
+{
+    mapping->fd = -1;
+    mapping->mapped_size = 0;
+    atomic_store(&mapping->allocator, NULL);
+}
+
+static int map_new_segments(shm_ill_allocator* this)
+{
+    //  Pools added by other processes since this one last looked follow each other in the object, so they are all
+    //  mapped at once. Doing it again for the same range in another thread just replaces the mapping with the same one.
+    segment_mapping* const mapping = find_segment_mapping(this);
+    if (!mapping)
+    {
+        return -1;
+    }
+    const uint_fast64_t size = atomic_load(&this->segment_size);
+    uint_fast64_t mapped = atomic_load(&mapping->mapped_size);
+    if (mapped >= size)
+    {
+        return 0;
+    }
+    void* const ptr = mmap((void*)((uintptr_t)this + mapped), size - mapped, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, mapping->fd, (off_t)mapped);
+    if (ptr == MAP_FAILED)
+    {
+        return -1;
+    }
+    if (this->flags & SHM_ILL_ALLOCATOR_HUGE_PAGES)
+    {
+        madvise(ptr, size - mapped, MADV_HUGEPAGE);
+    }
+    while (mapped < size && !atomic_compare_exchange_weak(&mapping->mapped_size, &mapped, size))
+    {
+    }
+    return 0;
+}
+
+static mem_pool* map_named_pool(shm_ill_allocator* this, uint_fast64_t pool_size)
+{
+    //  Caller must hold the pool table lock. Pool is appended to the end of the object, which is grown to fit it.
+    segment_mapping* const mapping = find_segment_mapping(this);
+    const uint_fast64_t offset = this->segment_size;
+    if (!mapping || offset + pool_size > this->reserved_size || map_new_segments(this) != 0)
+    {
+        return NULL;
+    }
+    if (ftruncate(mapping->fd, (off_t)(offset + pool_size)) != 0)
+    {
+        return NULL;
+    }
+    mem_pool* const pool = mmap((void*)((uintptr_t)this + offset), pool_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, mapping->fd, (off_t)offset);
+    if (pool == MAP_FAILED)
+    {
+        return NULL;
+    }
+    if (this->flags & SHM_ILL_ALLOCATOR_HUGE_PAGES)
+    {
+        //  Shared memory objects can not use explicit huge pages
+        madvise(pool, pool_size, MADV_HUGEPAGE);
+    }
+    init_pool(pool, pool_size);
+    atomic_store(&mapping->mapped_size, offset + pool_size);
+    //  Other processes may map the pool from now on, but only use it once it is added to the table
+    atomic_store(&this->segment_size, offset + pool_size);
+    return pool;
+}
+#endif
+
+static void report_bad_alloc(shm_ill_allocator* this)
+{
+#ifndef _WIN32
+    if (this->name[0])
+    {
+        const segment_mapping* const mapping = find_segment_mapping(this);
+        if (mapping && mapping->bad_alloc_callback)
+        {
+            mapping->bad_alloc_callback(this, mapping->bad_alloc_param);
+        }
+        return;
+    }
+#endif
+    if (this->bad_alloc_callback)
+    {
+        this->bad_alloc_callback(this, this->bad_alloc_param);
+    }
+}
+
+static void report_double_free(shm_ill_allocator* this)
+{
+#ifndef _WIN32
+    if (this->name[0])
+    {
+        const segment_mapping* const mapping = find_segment_mapping(this);
+        if (mapping && mapping->double_free_callback)
+        {
+            mapping->double_free_callback(this, mapping->double_free_param);
+        }
+        return;
+    }
+#endif
+    if (this->double_free_callback)
+    {
+        this->double_free_callback(this, this->double_free_param);
+    }
+}
+
+static mem_pool* carve_reserved_pool(shm_ill_allocator* this, uint_fast64_t pool_size)
+{
+    //  Caller must hold the pool table lock. Pages of the region are only backed once they are touched, so no system
+    //  call is needed on Linux.
+    const uint_fast64_t offset = this->segment_size;
+    if (offset + pool_size > this->reserved_size)
+    {
+        return NULL;
+    }
+    mem_pool* const pool = (mem_pool*)((uintptr_t)this + offset);
+#ifndef _WIN32
+    if (this->flags & SHM_ILL_ALLOCATOR_HUGE_PAGES)
+    {
+        madvise(pool, pool_size, MADV_HUGEPAGE);
+    }
+#else
+    if (!VirtualAlloc(pool, pool_size, MEM_COMMIT, PAGE_READWRITE))
+    {
+        return NULL;
+    }
+#endif
+    init_pool(pool, pool_size);
+    atomic_store(&this->segment_size, offset + pool_size);
+    return pool;
+}
+
+static mem_pool* add_pool_memory(shm_ill_allocator* this, uint_fast64_t pool_size)
+{
+#ifndef _WIN32
+    if (this->name[0])
+    {
+        return map_named_pool(this, pool_size);
+    }
+#endif
+    if (this->reserved_size)
+    {
+        return carve_reserved_pool(this, pool_size);
+    }
+    return map_pool(pool_size, (this->flags & SHM_ILL_ALLOCATOR_HUGE_PAGES) != 0);
+}
+
+static inline uint_fast64_t visible_pool_count(shm_ill_allocator* this)
+{
+    //  Number of pools this process can use. Pools of named allocators which were added by other processes are mapped
+    //  first, which needs count to be loaded before the size of the object.
+    uint_fast64_t count = atomic_load(&this->count);
+#ifndef _WIN32
+    if (this->name[0] && map_new_segments(this) != 0)
+    {
+        //  Only pools which were mapped before can be used
+        const segment_mapping* const mapping = find_segment_mapping(this);
+        const uintptr_t end = (uintptr_t)this + (mapping ? atomic_load(&mapping->mapped_size) : 0);
+        while (count && (uintptr_t)pool_at(this, count - 1) >= end)
+        {
+            count -= 1;
+        }
+    }
+#endif
+    return count;
+}
+
+static thread_cache* find_thread_cache(shm_ill_allocator* this, int claim)
+{
+    //  Both the address and the id must match, as a destroyed allocator's address may be reused by a new one
+    thread_cache* empty = NULL;
+    for (uint_fast32_t i = 0; i < THREAD_CACHE_SLOTS; ++i)
+    {
+        thread_cache* const cache = THREAD_CACHES + i;
+        if (cache->allocator == this && cache->allocator_id == this->id)
+        {
+            return cache;
+        }
+        if (!empty && !cache->allocator)
+        {
+            empty = cache;
+        }
+    }
+    if (!claim || !empty)
+    {
+        return NULL;
+    }
+#ifndef _WIN32
+    //  Caches must be dropped in a forked child before anything is put into them
+    pthread_once(&FORK_HANDLER_ONCE, register_fork_handler);
+#endif
+    memset(empty, 0, sizeof(*empty));
+    empty->allocator = this;
+    empty->allocator_id = this->id;
+    return empty;
+}
+
+void shm_ill_allocator_destroy(shm_ill_allocator* allocator)
+{
+    shm_ill_allocator* this = (shm_ill_allocator*)allocator;
+    assert(this->access_futex_value == FUTEX_FREE);
+    //  Blocks cached by the calling thread go away with the pools, so only its slot needs to be released
+    thread_cache* const cache = find_thread_cache(this, 0);
+    if (cache)
+    {
+        cache->allocator = NULL;
+        cache->allocator_id = 0;
+    }
+#ifndef _WIN32
+    if (this->name[0])
+    {
+        //  Pools, the pool table and the allocator itself all go away with the shared memory object. Processes still
+        //  attached keep their mappings until they detach.
+        segment_mapping* const mapping = find_segment_mapping(this);
+        assert(mapping);
+        char name[NAMED_ALLOCATOR_NAME_LENGTH];
+        memcpy(name, this->name, sizeof(name));
+        const int fd = mapping->fd;
+        release_segment_mapping(mapping);
+        munmap(this, this->reserved_size);
+        close(fd);
+        shm_unlink(name);
+        return;
+    }
+#endif
+    if (this->reserved_size)
+    {
+        //  Pools and the pool table are all part of the region
+#ifndef _WIN32
+        munmap(this, this->reserved_size);
+#else
+        VirtualFree(this, 0, MEM_RELEASE);
+#endif
+        return;
+    }
+    for (uint_fast32_t i = 0; i < this->count; ++i)
+    {
+        unmap_pool(pool_at(this, i));
+        pool_table(this)[i] = 0;
+    }
+#ifndef _WIN32
+    munmap(pool_table(this), this->pool_buffer_size);
+#else
+    VirtualFree(pool_table(this), 0, MEM_RELEASE);
+#endif
+    *this = (shm_ill_allocator){0};
+#ifndef _WIN32
+    munmap(this, round_to_nearest_page_up(sizeof(*this)));
+#else
+    VirtualFree(this, 0, MEM_RELEASE);
+#endif
+}
+
+static inline uint_fast64_t round_up_size(uint_fast64_t size)
+{
+    uint_fast64_t remainder = 8 - (size & 7);
+    size += remainder;
+    size += offsetof(mem_chunk, next);
+    if (size < MIN_CHUNK_SIZE)
+    {
+        return MIN_CHUNK_SIZE;
+    }
+    return size;
+}
+
+static inline mem_pool* find_supporting_pool(shm_ill_allocator* allocator, uint_fast64_t size, mem_chunk** p_chunk)
+{
+    //  Pool which is returned is left locked. Pools locked by someone else are skipped at first, as there is a good
+    //  chance another pool can support the allocation just as well.
+    const uint_fast64_t count = visible_pool_count(allocator);
+    for (uint_fast32_t i = 0; i < count; ++i)
+    {
+        mem_pool* pool = pool_at(allocator, i);
+        if (!try_lock_pool(allocator, pool))
+        {
+            continue;
+        }
+        mem_chunk* chunk = find_good_fit_chunk(pool, size);
+        if (chunk)
+        {
+            *p_chunk = chunk;
+            return pool;
+        }
+        unlock_pool(allocator, pool);
+    }
+    //  No pool has a chunk which certainly fits, so wait for the skipped ones and check for exact fits before giving up
+    for (uint_fast32_t i = 0; i < count; ++i)
+    {
+        mem_pool* pool = pool_at(allocator, i);
+        lock_pool(allocator, pool);
+        mem_chunk* chunk = has_pool_locks(allocator) ? find_good_fit_chunk(pool, size) : NULL;
+        if (!chunk)
+        {
+            chunk = find_exact_fit_chunk(pool, size);
+        }
+        if (chunk)
+        {
+            *p_chunk = chunk;
+            return pool;
+        }
+        unlock_pool(allocator, pool);
+    }
+    return NULL;
+}
+
+static inline mem_pool* find_chunk_pool(shm_ill_allocator* allocator, void* ptr)
+{
+    const uint_fast64_t count = visible_pool_count(allocator);
+    for (uint_fast32_t i = 0; i < count; ++i)
+    {
+        mem_pool* pool = pool_at(allocator, i);
+        if ((void*)pool <= ptr && (uintptr_t)pool + pool->size > (uintptr_t)ptr)
+        {
+            return pool;
+        }
+    }
+    return NULL;
+}
+
+static inline uint_fast64_t aligned_padding(const mem_chunk* chunk, uint_fast64_t alignment)
+{
+    //  Padding in front of the chunk needed to align its memory, which must be large enough to become a free chunk
+    const uintptr_t ptr = (uintptr_t)&chunk->next;
+    uint_fast64_t padding = (alignment - (ptr & (alignment - 1))) & (alignment - 1);
+    while (padding && padding < MIN_CHUNK_SIZE)
+    {
+        padding += alignment;
+    }
+    return padding;
+}
+
+static mem_chunk* take_chunk(shm_ill_allocator* this, uint_fast64_t size, uint_fast64_t alignment, mem_pool** p_pool)
+{
+    //  Caller must hold the allocator mutex and have already rounded up the size. Pool the chunk is taken from is
+    //  returned through p_pool still locked, so the caller must unlock it once done with the chunk. For alignments
+    //  above the natural one, look for a chunk with enough extra space for any padding that might be needed
+    const uint_fast64_t search_size = alignment > ALIGN_SIZE ? size + alignment + MIN_CHUNK_SIZE : size;
+    //  Check there's a pool that can support the allocation
+    mem_chunk* chunk = NULL;
+    mem_pool* pool = find_supporting_pool(this, search_size, &chunk);
+    if (!pool)
+    {
+        //  Create a new pool
+        if (!lock_table(this, __func__))
+        {
+            return NULL;
+        }
+        if (this->count == this->capacity && (has_pool_locks(this) || this->reserved_size))
+        {
+            //  Table can not be moved while others may be reading it, nor can it leave the reserved region
+            unlock_table(this, __func__);
+            report_bad_alloc(this);
+            return NULL;
+        }
+        if (this->count == this->capacity)
         {
             uint_fast64_t new_memory_size = this->pool_buffer_size + PAGE_SIZE;
 #ifndef _WIN32
-            mem_pool* new_ptr;
-//            new_ptr = mremap(this->pools, this->pool_buffer_size, new_memory_size, MREMAP_MAYMOVE);
+            uint_fast64_t* new_ptr;
+//            new_ptr = mremap(pool_table(this), this->pool_buffer_size, new_memory_size, MREMAP_MAYMOVE);
 //            if (new_ptr == MAP_FAILED)
 //            {
                 new_ptr = mmap(NULL, new_memory_size, PROT_WRITE|PROT_READ, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
                 if (new_ptr == MAP_FAILED)
                 {
-                    ptr = NULL;
-                    goto end;
+                    unlock_table(this, __func__);
+                    return NULL;
                 }
+                //  Entries are relative to the allocator, not the table, so they are copied as they are
                 for (uint_fast64_t i = 0; i < this->count; ++i)
                 {
-                    new_ptr[i] = this->pools[i];
+                    new_ptr[i] = pool_table(this)[i];
                 }
-                munmap(this->pools, this->pool_buffer_size);
+                munmap(pool_table(this), this->pool_buffer_size);
 //            }
 #else
-            mem_pool* new_ptr = VirtualAlloc(NULL, new_memory_size, MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
+            uint_fast64_t* new_ptr = VirtualAlloc(NULL, new_memory_size, MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
             if (new_ptr == NULL)
             {
-                ptr = NULL;
-                goto end;
+                unlock_table(this, __func__);
+                return NULL;
             }
             for (uint_fast64_t i = 0; i < this->count; ++i)
             {
-                new_ptr[i] = this->pools[i];
+                new_ptr[i] = pool_table(this)[i];
             }
-            VirtualFree(this->pools, 0, MEM_RELEASE);
+            VirtualFree(pool_table(this), 0, MEM_RELEASE);
 #endif
             memset((void*)((uintptr_t)new_ptr + this->pool_buffer_size), 0, PAGE_SIZE);
             this->pool_buffer_size = new_memory_size;
-            this->pools = new_ptr;
+            this->pools = pool_offset(this, new_ptr);
+            this->capacity = new_memory_size / sizeof(*new_ptr);
         }
 
-        const uint_fast64_t pool_size = round_to_nearest_page_up(this->pool_size > size + sizeof(mem_chunk) ? this->pool_size : size + sizeof(mem_chunk));
-#ifndef _WIN32
-        mem_chunk* base_chunk = mmap(NULL, pool_size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_SHARED, -1, 0);
-        if (base_chunk == MAP_FAILED)
-#else
-        mem_chunk* base_chunk = VirtualAlloc(NULL, pool_size, MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
-        if (base_chunk == NULL)
-#endif
+        uint_fast64_t pool_size = this->pool_size;
+        if (pool_size - pool_header_size(pool_size) < search_size)
         {
-            if (allocator->bad_alloc_callback)
+            //  Pool dedicated to this allocation
+            const uint_fast64_t granularity = pool_granularity(this);
+            pool_size = (search_size + pool_header_size(search_size) + granularity - 1) & ~(granularity - 1);
+            while (pool_size - pool_header_size(pool_size) < search_size)
             {
-                allocator->bad_alloc_callback(allocator, allocator->bad_alloc_param);
+                pool_size += granularity;
             }
-            ptr = NULL;
-            goto end;
-        }
-        base_chunk->size = pool_size;
-        base_chunk->used = 0;
-        base_chunk->next = NULL;
-        base_chunk->prev = NULL;
-        mem_pool new_pool =
-                {
-                .base = base_chunk,
-                .largest = base_chunk,
-                .smallest = base_chunk,
-                .used = 0,
-                .free = pool_size,
-                .size = pool_size,
-                };
-        pool = this->pools + this->count;
-        this->pools[this->count++] = new_pool;
-    }
-
-    //  Find the smallest block which fits
-    mem_chunk* chunk = find_ge_chunk_from_largest(pool, size);
+        }
+        pool = add_pool_memory(this, pool_size);
+        if (!pool)
+        {
+            unlock_table(this, __func__);
+            report_bad_alloc(this);
+            return NULL;
+        }
+        //  Pool is locked before it is published, so nobody else can take the chunk meant for this allocation
+        lock_pool(this, pool);
+        pool_table(this)[this->count] = pool_offset(this, pool);
+        atomic_store(&this->count, this->count + 1);
+        unlock_table(this, __func__);
+        chunk = find_good_fit_chunk(pool, search_size);
+        if (!chunk)
+        {
+            chunk = find_exact_fit_chunk(pool, search_size);
+        }
+    }
+
+    //  Use the chunk which was found to fit
     assert(chunk);
     remove_chunk_from_pool(pool, chunk);
 
+    if (alignment > ALIGN_SIZE)
+    {
+        const uint_fast64_t padding = aligned_padding(chunk, alignment);
+        if (padding)
+        {
+            //  Padding is split off into a free chunk of its own, so it can still be used by other allocations. The
+            //  chunk was free, so the one before it is used and no merging is needed.
+            mem_chunk* const aligned_chunk = (void*)((uintptr_t)chunk + padding);
+            aligned_chunk->size = chunk->size - padding;
+            aligned_chunk->used = 1;
+            chunk->size = padding;
+            insert_chunk_into_bins(pool, chunk);
+            aligned_chunk->used = 0;
+            chunk = aligned_chunk;
+        }
+        assert(((uintptr_t)&chunk->next & (alignment - 1)) == 0);
+    }
+
     //  Check if chunk can be split
     uint_fast64_t remaining = chunk->size - size;
-    if (remaining >= sizeof(mem_chunk))
+    if (remaining >= MIN_CHUNK_SIZE)
     {
         mem_chunk* new_chunk = (void*)(((uintptr_t)chunk) + size);
         new_chunk->used = 0;
+        new_chunk->prev_used = 1;
         new_chunk->size = remaining;
         chunk->size = size;
-        insert_chunk_into_pool(pool, new_chunk);
+        //  Chunk was free, so its neighbours were not, thus no merging is needed
+        insert_chunk_into_bins(pool, new_chunk);
+    }
+
+    mark_chunk_used(pool, chunk);
+    *p_pool = pool;
+    return chunk;
+}
+
+static inline uint_fast64_t add_to_counter(const shm_ill_allocator* this, uint_fast64_t* p_counter, uint_fast64_t value)
+{
+    //  Without pool locks, counters are only ever updated under the allocator mutex, so no locked instruction is needed
+    //  to keep them exact. Subtracting is done by adding the negated value.
+    if (has_pool_locks(this))
+    {
+        return atomic_fetch_add_explicit(p_counter, value, memory_order_relaxed) + value;
+    }
+    const uint_fast64_t new_value = atomic_load_explicit(p_counter, memory_order_relaxed) + value;
+    atomic_store_explicit(p_counter, new_value, memory_order_relaxed);
+    return new_value;
+}
+
+static inline void add_bytes_in_use(shm_ill_allocator* this, uint_fast64_t size)
+{
+    const uint_fast64_t in_use = add_to_counter(this, &this->bytes_in_use, size);
+    uint_fast64_t peak = atomic_load_explicit(&this->peak_bytes_in_use, memory_order_relaxed);
+    while (in_use > peak && !atomic_compare_exchange_weak_explicit(&this->peak_bytes_in_use, &peak, in_use, memory_order_relaxed, memory_order_relaxed))
+    {
     }
+}
+
+static inline void count_operation(shm_ill_allocator* this, mem_pool* pool, uint_fast32_t op)
+{
+    //  Caller must hold the pool's lock. With pool locks, operations are counted by each pool, so that threads using
+    //  different pools do not keep taking the counter from each other, otherwise the allocator mutex is held as well.
+    uint_fast64_t* const p_count = has_pool_locks(this) ? pool->op_counts + op : this->op_counts + op;
+    atomic_store_explicit(p_count, atomic_load_explicit(p_count, memory_order_relaxed) + 1, memory_order_relaxed);
+}
 
-    chunk->used = 1;
+static inline void record_release(shm_ill_allocator* this, mem_pool* pool, const mem_chunk* chunk)
+{
+    add_to_counter(this, &this->bytes_in_use, -(uint_fast64_t)chunk->size);
+    count_operation(this, pool, OP_COUNT_RELEASE);
+}
+
+static inline void record_allocation(shm_ill_allocator* this, mem_pool* pool, mem_chunk* chunk)
+{
+    add_bytes_in_use(this, chunk->size);
+    count_operation(this, pool, OP_COUNT_ALLOCATION);
 #ifdef JMEM_ALLOC_TRACKING
-    chunk->idx = ++this->allocator_index;
+    //  With pool locks, several allocations may be recorded at once, so counters are updated atomically. Maximums may
+    //  still miss a concurrent update, which is fine for statistics.
+    chunk->idx = atomic_fetch_add(&this->allocator_index, 1) + 1;
 #ifdef JMEM_ALLOC_TRAP_COUNT
     for (uint32_t i = 0; i < this->trap_counts; ++i)
     {
@@ -485,69 +1349,552 @@ void* shm_ill_alloc(shm_ill_allocator* allocator, uint_fast64_t size)
         }
     }
 #endif
-    this->total_allocated += chunk->size;
+    atomic_fetch_add(&this->total_allocated, chunk->size);
     if (this->max_allocated < chunk->size)
     {
         this->max_allocated = chunk->size;
     }
-    this->current_allocated += chunk->size;
-    if (this->current_allocated > this->max_allocated)
+    const uint_fast64_t current_allocated = atomic_fetch_add(&this->current_allocated, chunk->size) + chunk->size;
+    if (current_allocated > this->max_allocated)
     {
-        this->max_allocated = this->current_allocated;
+        this->max_allocated = current_allocated;
     }
 #endif
-    ptr = &chunk->next;
-end:
-    release_allocator_mutex(this, __func__);
-    return ptr;
 }
 
-void shm_ill_jfree(shm_ill_allocator* allocator, void* ptr)
+static void* allocate_chunk(shm_ill_allocator* this, uint_fast64_t size, uint_fast64_t alignment)
 {
-    shm_ill_allocator* this = (shm_ill_allocator*)allocator;
-    //  Check for null
-    if (!ptr) return;
+    //  Caller must hold the allocator mutex and have already rounded up the size
+    mem_pool* pool;
+    mem_chunk* const chunk = take_chunk(this, size, alignment, &pool);
+    if (!chunk)
+    {
+        return NULL;
+    }
+    record_allocation(this, pool, chunk);
+    unlock_pool(this, pool);
+    return &chunk->next;
+}
+
+static uint_fast64_t release_pool_pages(mem_pool* pool, uint_fast64_t granularity)
+{
+    //  Pool stays mapped, since other processes may still refer to it, but the pages of its only free chunk are given
+    //  back. Chunk's header and boundary tag must remain intact.
+    assert(pool->used == 0);
+    const uintptr_t begin = ((uintptr_t)pool + pool->base + sizeof(mem_chunk) + granularity - 1) & ~(uintptr_t)(granularity - 1);
+    const uintptr_t end = ((uintptr_t)pool + pool->size - sizeof(uint_fast64_t)) & ~(uintptr_t)(granularity - 1);
+    pool->trimmed_at = pool->empty_since;
+    if (end <= begin)
+    {
+        return 0;
+    }
+#ifndef _WIN32
+    //  Memory is shared, so MADV_REMOVE is needed for the pages to actually be freed, rather than just unmapped here
+    if (madvise((void*)begin, end - begin, MADV_REMOVE) != 0 && madvise((void*)begin, end - begin, MADV_DONTNEED) != 0)
+    {
+        return 0;
+    }
+#else
+    if (!VirtualAlloc((void*)begin, end - begin, MEM_RESET, PAGE_READWRITE))
+    {
+        return 0;
+    }
+#endif
+    return end - begin;
+}
+
+static uint_fast64_t trim_pools(shm_ill_allocator* this, uint_fast64_t delay)
+{
+    //  Caller must hold the allocator mutex, or the pool table lock, but no pool lock. Pools which have not been empty for
+    //  long enough or were already released are kept, and count towards the spare pools
+    const uint_fast64_t count = visible_pool_count(this);
+    uint_fast64_t kept = 0;
+    for (uint_fast64_t i = 0; i < count; ++i)
+    {
+        mem_pool* const pool = pool_at(this, i);
+        lock_pool(this, pool);
+        if (pool->used == 0 && pool->size == this->pool_size && pool->trimmed_at != pool->empty_since && atomic_load(&this->free_count) - pool->empty_since < delay)
+        {
+            kept += 1;
+        }
+        unlock_pool(this, pool);
+    }
+    uint_fast64_t released = 0;
+    for (uint_fast64_t i = 0; i < count; ++i)
+    {
+        mem_pool* const pool = pool_at(this, i);
+        lock_pool(this, pool);
+        if (pool->used != 0 || pool->trimmed_at == pool->empty_since || atomic_load(&this->free_count) - pool->empty_since < delay)
+        {
+            unlock_pool(this, pool);
+            continue;
+        }
+        if (pool->size == this->pool_size && kept < this->spare_pools)
+        {
+            unlock_pool(this, pool);
+            kept += 1;
+            continue;
+        }
+        released += release_pool_pages(pool, pool_granularity(this));
+        unlock_pool(this, pool);
+    }
+    return released;
+}
+
+static int count_frees(shm_ill_allocator* this, mem_pool* pool, uint_fast64_t freed)
+{
+    //  Caller must hold the pool's lock. Returns non-zero when pools are due to be trimmed, which the caller must do with
+    //  trim_pools_if_due once the pool is unlocked.
+    const uint_fast64_t free_count = atomic_fetch_add(&this->free_count, freed) + freed;
+    if (pool->used == 0)
+    {
+        pool->empty_since = free_count;
+        //  Pool that was just emptied is not old enough to be released, unless there is no delay
+        return this->auto_trim && free_count >= atomic_load(&this->next_trim);
+    }
+    return 0;
+}
+
+static void trim_pools_if_due(shm_ill_allocator* this)
+{
+    //  Caller must hold the allocator mutex, but no pool lock
+    if (!lock_table(this, __func__))
+    {
+        return;
+    }
+    //  Someone else may have trimmed in the meantime
+    if (atomic_load(&this->free_count) >= this->next_trim)
+    {
+        trim_pools(this, this->trim_delay);
+        atomic_store(&this->next_trim, atomic_load(&this->free_count) + this->trim_delay);
+    }
+    unlock_table(this, __func__);
+}
+
+static void free_chunk(shm_ill_allocator* this, void* ptr)
+{
+    //  Caller must hold the allocator mutex, but no pool lock
     //  Check what pool this is from
-    const int mutex = acquire_allocator_mutex(this, __func__);
-    if (mutex == 0) return;
     mem_pool* pool = find_chunk_pool(this, ptr);
     mem_chunk* chunk = (void*)((uintptr_t)ptr - offsetof(mem_chunk, next));
-#ifdef JMEM_ALLOC_TRACKING
-    this->current_allocated -= chunk->size;
-#endif
     if (!pool)
     {
         goto end;
     }
+    lock_pool(this, pool);
+#ifdef JMEM_ALLOC_TRACKING
+    atomic_fetch_sub(&this->current_allocated, chunk->size);
+#endif
 
     if (chunk->used == 0)
     {
+        unlock_pool(this, pool);
         //  Double free
-        if (allocator->double_free_callback)
-        {
-            allocator->double_free_callback(allocator, allocator->double_free_param);
-        }
+        report_double_free(this);
         goto end;
     }
 
     //  Mark chunk as no longer used, then return it back to the pool
+    record_release(this, pool, chunk);
     chunk->used = 0;
     insert_chunk_into_pool(pool, chunk);
+    const int trim_due = count_frees(this, pool, 1);
+    unlock_pool(this, pool);
+    if (trim_due)
+    {
+        trim_pools_if_due(this);
+    }
 end:
-    release_allocator_mutex(this, __func__);
+    return;
 }
 
-void* shm_ill_jrealloc(shm_ill_allocator* allocator, void* ptr, uint_fast64_t new_size)
+static int compare_pointers(const void* a, const void* b)
+{
+    const uintptr_t pa = (uintptr_t)*(void* const*)a;
+    const uintptr_t pb = (uintptr_t)*(void* const*)b;
+    return (pa > pb) - (pa < pb);
+}
+
+static void free_batch(shm_ill_allocator* this, uint_fast64_t count, void** ptrs)
+{
+    //  Caller must hold the allocator mutex and have sorted the pointers, so that blocks from the same pool are next to
+    //  each other, as are blocks which are physically adjacent. Each pool is locked once for all of its blocks.
+    mem_pool* pool = NULL;
+    int trim_due = 0;
+    uint_fast64_t i = 0;
+    while (i < count)
+    {
+        void* const ptr = ptrs[i++];
+        if (!ptr) continue;
+        if (i > 1 && ptrs[i - 2] == ptr)
+        {
+            //  Same block given more than once, which sorting put right after the first one
+            report_double_free(this);
+            continue;
+        }
+        mem_chunk* const chunk = (void*)((uintptr_t)ptr - offsetof(mem_chunk, next));
+        if (!pool || (uintptr_t)ptr < (uintptr_t)pool || (uintptr_t)ptr >= (uintptr_t)pool + pool->size)
+        {
+            if (pool)
+            {
+                unlock_pool(this, pool);
+            }
+            pool = find_chunk_pool(this, ptr);
+            if (!pool)
+            {
+                continue;
+            }
+            lock_pool(this, pool);
+        }
+        if (chunk->used == 0 || ((this->flags & SHM_ILL_ALLOCATOR_THREAD_CACHE) && is_cached_block(this, ptr)))
+        {
+            //  Double free
+            report_double_free(this);
+            continue;
+        }
+#ifdef JMEM_ALLOC_TRACKING
+        atomic_fetch_sub(&this->current_allocated, chunk->size);
+#endif
+        record_release(this, pool, chunk);
+        //  Blocks directly following this one are merged into it, so that the whole run is inserted only once
+        uint_fast64_t freed = 1;
+        mem_chunk* next;
+        while (i < count && (next = next_chunk(pool, chunk)) && ptrs[i] == (void*)&next->next && next->used)
+        {
+#ifdef JMEM_ALLOC_TRACKING
+            atomic_fetch_sub(&this->current_allocated, next->size);
+#endif
+            record_release(this, pool, next);
+            //  Header of the merged block is left marked as free, so that freeing it again is caught as a double free
+            next->used = 0;
+            chunk->size += next->size;
+            i += 1;
+            freed += 1;
+        }
+        chunk->used = 0;
+        insert_chunk_into_pool(pool, chunk);
+        trim_due |= count_frees(this, pool, freed);
+    }
+    if (pool)
+    {
+        unlock_pool(this, pool);
+    }
+    if (trim_due)
+    {
+        trim_pools_if_due(this);
+    }
+}
+
+static int allocate_batch(shm_ill_allocator* this, uint_fast64_t count, const uint_fast64_t* sizes, uint_fast64_t uniform_size, void** out_ptrs)
+{
+    //  Caller must hold the allocator mutex. Blocks are gathered into groups, each of which is taken from the pools as a
+    //  single chunk and then carved up. Groups are kept well below the pool size, so that they fit into existing pools
+    //  instead of dedicated ones.
+    const uint_fast64_t group_limit = this->pool_size / 4;
+    uint_fast64_t i = 0;
+    while (i < count)
+    {
+        uint_fast64_t total = round_up_size(sizes ? sizes[i] : uniform_size);
+        uint_fast64_t j;
+        for (j = i + 1; j < count; ++j)
+        {
+            const uint_fast64_t size = round_up_size(sizes ? sizes[j] : uniform_size);
+            if (total + size > group_limit)
+            {
+                break;
+            }
+            total += size;
+        }
+
+        mem_pool* pool;
+        mem_chunk* const group = take_chunk(this, total, ALIGN_SIZE, &pool);
+        if (!group)
+        {
+            goto failed;
+        }
+        //  Group chunk is used, as is the one before each block carved from it, so only the sizes need to be set up.
+        //  Last block also gets any space left over, which was too small to be split off as a free chunk.
+        const uint_fast64_t available = group->size;
+        uint_fast64_t offset = 0;
+        for (; i < j; ++i)
+        {
+            const uint_fast64_t size = round_up_size(sizes ? sizes[i] : uniform_size);
+            mem_chunk* const chunk = (void*)((uintptr_t)group + offset);
+            if (offset)
+            {
+                chunk->prev_used = 1;
+                chunk->used = 1;
+            }
+            chunk->size = i + 1 == j ? available - offset : size;
+            offset += size;
+            record_allocation(this, pool, chunk);
+            out_ptrs[i] = &chunk->next;
+        }
+        unlock_pool(this, pool);
+    }
+    return 0;
+
+failed:
+    //  Batch either succeeds as a whole or leaves nothing allocated
+    for (uint_fast64_t k = 0; k < i; ++k)
+    {
+        free_chunk(this, out_ptrs[k]);
+        out_ptrs[k] = NULL;
+    }
+    for (uint_fast64_t k = i; k < count; ++k)
+    {
+        out_ptrs[k] = NULL;
+    }
+    return -1;
+}
+
+static void refill_magazine(shm_ill_allocator* this, thread_cache* cache, uint_fast32_t class)
+{
+    assert(cache->counts[class] == 0);
+    const int mtx_res = lock_allocator(this, __func__);
+    if (mtx_res == 0) return;
+    const uint_fast64_t size = (class + 1) * THREAD_CACHE_CLASS_SIZE;
+    void** const magazine = cache->magazines[class];
+    uint_fast32_t count = THREAD_CACHE_BATCH;
+    if (allocate_batch(this, THREAD_CACHE_BATCH, NULL, size, magazine) != 0)
+    {
+        //  Memory is short, so take as many blocks as possible one by one
+        for (count = 0; count < THREAD_CACHE_BATCH; ++count)
+        {
+            void* const ptr = allocate_chunk(this, size, ALIGN_SIZE);
+            if (!ptr)
+            {
+                break;
+            }
+            magazine[count] = ptr;
+        }
+    }
+    //  Blocks are handed out from the back, so reverse them to hand out the lowest addresses first
+    for (uint_fast32_t i = 0; i < count / 2; ++i)
+    {
+        void* const tmp = magazine[i];
+        magazine[i] = magazine[count - 1 - i];
+        magazine[count - 1 - i] = tmp;
+    }
+    for (uint_fast32_t i = 0; i < count; ++i)
+    {
+        tag_cached_block(this, magazine[i]);
+    }
+    cache->counts[class] = count;
+    unlock_allocator(this, __func__);
+}
+
+static void flush_magazine(shm_ill_allocator* this, thread_cache* cache, uint_fast32_t class, uint_fast32_t count)
+{
+    assert(count <= cache->counts[class]);
+    const int mtx_res = lock_allocator(this, __func__);
+    if (mtx_res == 0) return;
+    void** const magazine = cache->magazines[class];
+    //  Return the oldest blocks, as the newest are the most likely to still be in the cache
+    for (uint_fast32_t i = 0; i < count; ++i)
+    {
+        untag_cached_block(magazine[i]);
+        free_chunk(this, magazine[i]);
+    }
+    cache->counts[class] -= count;
+    memmove(magazine, magazine + count, cache->counts[class] * sizeof(*magazine));
+    unlock_allocator(this, __func__);
+}
+
+void* shm_ill_alloc(shm_ill_allocator* allocator, uint_fast64_t size)
 {
     shm_ill_allocator* this = (shm_ill_allocator*)allocator;
-    if (!ptr)
+    //  Round up size to 8 bytes
+    size = round_up_size(size);
+    if (this->flags & SHM_ILL_ALLOCATOR_THREAD_CACHE)
     {
-        return shm_ill_alloc(allocator, new_size);
+        const uint_fast64_t class = (size - 1) / THREAD_CACHE_CLASS_SIZE;
+        thread_cache* cache;
+        if (class < THREAD_CACHE_CLASS_COUNT && (cache = find_thread_cache(this, 1)))
+        {
+            if (!cache->counts[class])
+            {
+                refill_magazine(this, cache, class);
+            }
+            if (cache->counts[class])
+            {
+                void* const ptr = cache->magazines[class][--cache->counts[class]];
+                untag_cached_block(ptr);
+                return ptr;
+            }
+        }
     }
-    new_size = round_up_size(new_size);
+    const int mtx_res = lock_allocator(this, __func__);
+    if (mtx_res == 0) return NULL;
+    void* const ptr = allocate_chunk(this, size, ALIGN_SIZE);
+    unlock_allocator(this, __func__);
+    return ptr;
+}
 
-    const int mtx_res = acquire_allocator_mutex(this, __func__);
+void* shm_ill_alloc_aligned(shm_ill_allocator* allocator, uint_fast64_t size, uint_fast64_t alignment)
+{
+    shm_ill_allocator* this = (shm_ill_allocator*)allocator;
+    if (alignment & (alignment - 1))
+    {
+        return NULL;
+    }
+    if (alignment <= ALIGN_SIZE)
+    {
+        return shm_ill_alloc(allocator, size);
+    }
+    //  Thread caches only hold blocks with the natural alignment, so aligned blocks always come from the shared heap
+    size = round_up_size(size);
+    const int mtx_res = lock_allocator(this, __func__);
     if (mtx_res == 0) return NULL;
+    void* const ptr = allocate_chunk(this, size, alignment);
+    unlock_allocator(this, __func__);
+    return ptr;
+}
+
+int shm_ill_alloc_batch(shm_ill_allocator* allocator, uint_fast64_t count, const uint_fast64_t* sizes, void** out_ptrs)
+{
+    shm_ill_allocator* this = (shm_ill_allocator*)allocator;
+    const int mtx_res = lock_allocator(this, __func__);
+    if (mtx_res == 0) return -1;
+    const int res = allocate_batch(this, count, sizes, 0, out_ptrs);
+    unlock_allocator(this, __func__);
+    return res;
+}
+
+int shm_ill_alloc_batch_uniform(shm_ill_allocator* allocator, uint_fast64_t count, uint_fast64_t size, void** out_ptrs)
+{
+    shm_ill_allocator* this = (shm_ill_allocator*)allocator;
+    const int mtx_res = lock_allocator(this, __func__);
+    if (mtx_res == 0) return -1;
+    const int res = allocate_batch(this, count, NULL, size, out_ptrs);
+    unlock_allocator(this, __func__);
+    return res;
+}
+
+void shm_ill_jfree_batch(shm_ill_allocator* allocator, uint_fast64_t count, void** ptrs)
+{
+    shm_ill_allocator* this = (shm_ill_allocator*)allocator;
+    //  Sorting needs no lock, so it is done before taking it
+    qsort(ptrs, count, sizeof(*ptrs), compare_pointers);
+    const int mtx_res = lock_allocator(this, __func__);
+    if (mtx_res == 0) return;
+    free_batch(this, count, ptrs);
+    unlock_allocator(this, __func__);
+}
+
+void shm_ill_jfree(shm_ill_allocator* allocator, void* ptr)
+{
+    shm_ill_allocator* this = (shm_ill_allocator*)allocator;
+    //  Check for null
+    if (!ptr) return;
+    if (this->flags & SHM_ILL_ALLOCATOR_THREAD_CACHE)
+    {
+#ifndef _WIN32
+        //  Block's header is read right away, but it may be in a pool another process added and this one did not map yet
+        if (this->name[0])
+        {
+            map_new_segments(this);
+        }
+#endif
+        //  Block stays marked as used while in the magazine, so the shared heap sees no change
+        const mem_chunk* const chunk = (void*)((uintptr_t)ptr - offsetof(mem_chunk, next));
+        if (chunk->used && is_cached_block(this, ptr))
+        {
+            //  Double free of a block which is already in this or another thread's magazine
+            report_double_free(this);
+            return;
+        }
+        const uint_fast64_t class = chunk->size / THREAD_CACHE_CLASS_SIZE - 1;
+        thread_cache* cache;
+        if (chunk->used && class < THREAD_CACHE_CLASS_COUNT && (cache = find_thread_cache(this, 1)))
+        {
+            if (cache->counts[class] == THREAD_CACHE_MAGAZINE_SIZE)
+            {
+                flush_magazine(this, cache, class, THREAD_CACHE_BATCH);
+            }
+            if (cache->counts[class] < THREAD_CACHE_MAGAZINE_SIZE)
+            {
+                tag_cached_block(this, ptr);
+                cache->magazines[class][cache->counts[class]++] = ptr;
+                return;
+            }
+        }
+    }
+    const int mutex = lock_allocator(this, __func__);
+    if (mutex == 0) return;
+    free_chunk(this, ptr);
+    unlock_allocator(this, __func__);
+}
+
+void shm_ill_allocator_thread_flush(shm_ill_allocator* allocator)
+{
+    shm_ill_allocator* this = (shm_ill_allocator*)allocator;
+    thread_cache* const cache = find_thread_cache(this, 0);
+    if (!cache)
+    {
+        return;
+    }
+    const int mtx_res = lock_allocator(this, __func__);
+    if (mtx_res == 0) return;
+    for (uint_fast32_t class = 0; class < THREAD_CACHE_CLASS_COUNT; ++class)
+    {
+        for (uint_fast32_t i = 0; i < cache->counts[class]; ++i)
+        {
+            untag_cached_block(cache->magazines[class][i]);
+            free_chunk(this, cache->magazines[class][i]);
+        }
+        cache->counts[class] = 0;
+    }
+    unlock_allocator(this, __func__);
+    //  Release the slot, so that the thread may cache blocks of another allocator
+    cache->allocator = NULL;
+    cache->allocator_id = 0;
+}
+
+static mem_chunk* absorb_previous_chunk(mem_pool* pool, mem_chunk* chunk, uint_fast64_t new_size, uint_fast64_t alignment)
+{
+    //  Free chunk before this one, together with the one after it if needed, may be large enough once the block is
+    //  moved down to its start
+    if (chunk->prev_used)
+    {
+        return NULL;
+    }
+    mem_chunk* const prev = previous_free_chunk(chunk);
+    if ((uintptr_t)&prev->next & (alignment - 1))
+    {
+        return NULL;
+    }
+    mem_chunk* const next = next_chunk(pool, chunk);
+    const uint_fast64_t size = prev->size + chunk->size;
+    const int use_next = size < new_size;
+    if (use_next && !(next && next->used == 0 && size + next->size >= new_size))
+    {
+        return NULL;
+    }
+    //  Free chunks are pulled from the pool before the block is moved over their links
+    remove_chunk_from_pool(pool, prev);
+    uint_fast64_t total = size;
+    if (use_next)
+    {
+        remove_chunk_from_pool(pool, next);
+        total += next->size;
+    }
+#ifdef JMEM_ALLOC_TRACKING
+    const uint_fast64_t idx = chunk->idx;
+#endif
+    memmove(&prev->next, &chunk->next, chunk->size - offsetof(mem_chunk, next));
+    prev->size = total;
+    prev->used = 1;
+#ifdef JMEM_ALLOC_TRACKING
+    prev->idx = idx;
+#endif
+    mark_chunk_used(pool, prev);
+    return prev;
+}
+
+static void* reallocate_chunk(shm_ill_allocator* this, void* ptr, uint_fast64_t new_size, uint_fast64_t alignment)
+{
+    //  Caller must hold the allocator mutex, but no pool lock, and have already rounded up the size
     void* ret_v = NULL;
 
     mem_chunk* chunk = (void*)((uintptr_t)ptr - offsetof(mem_chunk, next));
@@ -557,41 +1904,48 @@ void* shm_ill_jrealloc(shm_ill_allocator* allocator, void* ptr, uint_fast64_t ne
     if (!pool)
     {
         //  It did not come from a pool
-        if (allocator->bad_alloc_callback)
-        {
-            allocator->bad_alloc_callback(allocator, allocator->bad_alloc_param);
-        }
+        report_bad_alloc(this);
         ret_v = NULL;
         goto end;
     }
+    lock_pool(this, pool);
+
+    const uint_fast64_t old_size = chunk->size;
+    //  Resizing in place keeps the address, so the alignment only needs to be considered when the block is moved
+    if ((uintptr_t)ptr & (alignment - 1))
+    {
+        //  Block was not allocated with this alignment, so it has to be moved
+        goto move;
+    }
 
     //  Since this dereferences chunk, this can cause SIGSEGV
     if (new_size == chunk->size)
     {
         ret_v = ptr;
-        goto end;
+        goto unlock;
     }
 
 
-    const uint_fast64_t old_size = chunk->size;
     //  Check if increasing or decreasing the chunk's size
     if (new_size > chunk->size)
     {
         //  Increasing
         //  Check if current block can be expanded so that there's no moving it
         //  Location of potential candidate
-        mem_chunk* possible_chunk = (void*)(((uintptr_t)chunk) + chunk->size);
-        if (!((void*)possible_chunk >= pool->base                              //  Is the pointer in range?
-            && (uintptr_t)possible_chunk < (uintptr_t)pool->base + pool->free + pool->used //  Is the pointer in range?
+        mem_chunk* possible_chunk = next_chunk(pool, chunk);
+        if (!(possible_chunk                                                     //  Is the pointer in range?
             && possible_chunk->used == 0                                         //  Is the other chunk in use
             && possible_chunk->size + chunk->size >= new_size))               //  Is the other chunk large enough to accommodate us
         {
-            //  Can not make use of any adjacent chunks, so allocate a new block, copy memory to it, free current block, then return the new block
-            release_allocator_mutex(this, __func__);
-            void* new_ptr = shm_ill_alloc(allocator, new_size - offsetof(mem_chunk, next));
-            memcpy(new_ptr, ptr, chunk->size - offsetof(mem_chunk, next));
-            shm_ill_jfree(allocator, ptr);
-            return new_ptr;
+            mem_chunk* const merged = absorb_previous_chunk(pool, chunk, new_size, alignment);
+            if (merged)
+            {
+                chunk = merged;
+                ptr = &chunk->next;
+                goto size_check;
+            }
+            //  Can not make use of any adjacent chunks
+            goto move;
         }
 
         //  All requirements met
@@ -599,6 +1953,7 @@ void* shm_ill_jrealloc(shm_ill_allocator* allocator, void* ptr, uint_fast64_t ne
         remove_chunk_from_pool(pool, possible_chunk);
         //  Join the two chunks together
         chunk->size += possible_chunk->size;
+        mark_chunk_used(pool, chunk);
         //  Redo size check
         goto size_check;
     }
@@ -609,50 +1964,177 @@ void* shm_ill_jrealloc(shm_ill_allocator* allocator, void* ptr, uint_fast64_t ne
         //  Decreasing
         //  Check if block can be split in two
         const uint_fast64_t remainder = chunk->size - new_size;
-        if (remainder < sizeof(mem_chunk))
+        if (remainder < MIN_CHUNK_SIZE)
         {
             //  Can not be split, return the original pointer
             ret_v = ptr;
-            goto end;
+            goto unlock;
         }
         //  Split the chunk
         mem_chunk* new_chunk = (void*)(((uintptr_t)chunk) + new_size);
         chunk->size = new_size;
         new_chunk->size = remainder;
         new_chunk->used = 0;
+        new_chunk->prev_used = 1;
         //  Put the split chunk into the pool
         insert_chunk_into_pool(pool, new_chunk);
     }
 
 
-#ifdef JMEM_ALLOC_TRACKING
-    this->current_allocated -= old_size;
-    this->current_allocated += new_size;
-    this->total_allocated += new_size > old_size ? new_size - old_size : 0;
-    if (this->current_allocated > this->max_allocated)
+#ifdef JMEM_ALLOC_TRACKING
+    const uint_fast64_t current_allocated = atomic_fetch_add(&this->current_allocated, new_size - old_size) + (new_size - old_size);
+    atomic_fetch_add(&this->total_allocated, new_size > old_size ? new_size - old_size : 0);
+    if (current_allocated > this->max_allocated)
+    {
+        this->max_allocated = current_allocated;
+    }
+    if (new_size > this->biggest_allocation)
+    {
+        this->biggest_allocation = new_size;
+    }
+#endif
+    ret_v = &chunk->next;
+unlock:
+    //  Block may have grown or shrunk in place, possibly by less or more than asked for
+    if (chunk->size > old_size)
+    {
+        add_bytes_in_use(this, chunk->size - old_size);
+    }
+    else
+    {
+        add_to_counter(this, &this->bytes_in_use, chunk->size - old_size);
+    }
+    add_to_counter(this, &this->reallocation_count, 1);
+    unlock_pool(this, pool);
+end:
+    return ret_v;
+
+move:
+    //  Pool is unlocked first, since the new block may come from the same pool, and freeing the old one locks it again
+    unlock_pool(this, pool);
+    //  Allocate a new block, copy memory to it, free current block, then return the new block
+    ret_v = allocate_chunk(this, new_size, alignment);
+    if (ret_v)
+    {
+        const uint_fast64_t copy_size = old_size < new_size ? old_size : new_size;
+        memcpy(ret_v, ptr, copy_size - offsetof(mem_chunk, next));
+        free_chunk(this, ptr);
+        add_to_counter(this, &this->reallocation_count, 1);
+    }
+    return ret_v;
+}
+
+void* shm_ill_jrealloc(shm_ill_allocator* allocator, void* ptr, uint_fast64_t new_size)
+{
+    shm_ill_allocator* this = (shm_ill_allocator*)allocator;
+    if (!ptr)
+    {
+        return shm_ill_alloc(allocator, new_size);
+    }
+    new_size = round_up_size(new_size);
+
+    const int mtx_res = lock_allocator(this, __func__);
+    if (mtx_res == 0) return NULL;
+    void* const ret_v = reallocate_chunk(this, ptr, new_size, ALIGN_SIZE);
+    unlock_allocator(this, __func__);
+    return ret_v;
+}
+
+void* shm_ill_jrealloc_aligned(shm_ill_allocator* allocator, void* ptr, uint_fast64_t new_size, uint_fast64_t alignment)
+{
+    shm_ill_allocator* this = (shm_ill_allocator*)allocator;
+    if (!ptr)
     {
-        this->max_allocated = this->current_allocated;
+        return shm_ill_alloc_aligned(allocator, new_size, alignment);
     }
-    if (new_size > this->biggest_allocation)
+    if (alignment & (alignment - 1))
     {
-        this->biggest_allocation = new_size;
+        return NULL;
     }
-#endif
-    ret_v = &chunk->next;
-end:
-    release_allocator_mutex(this, __func__);
+    new_size = round_up_size(new_size);
+
+    const int mtx_res = lock_allocator(this, __func__);
+    if (mtx_res == 0) return NULL;
+    void* const ret_v = reallocate_chunk(this, ptr, new_size, alignment > ALIGN_SIZE ? alignment : ALIGN_SIZE);
+    unlock_allocator(this, __func__);
     return ret_v;
 }
 
-int shm_ill_allocator_verify(shm_ill_allocator* allocator, int_fast32_t* i_pool, int_fast32_t* i_block)
+static int verify_pool(const mem_pool* pool, int_fast32_t* i_block)
 {
-    shm_ill_allocator* this = (shm_ill_allocator*)allocator;
+    //  Caller must hold the pool's lock (or the allocator mutex without pool locks)
 #ifndef NDEBUG
 #define VERIFICATION_CHECK(x) (assert(x))
 #else
-#define VERIFICATION_CHECK(x) if (!(x)) { if (i_pool) *i_pool = i; if (i_block) *i_block = j; release_allocator_mutex(this, __func__); return -1;} (void)0
+#define VERIFICATION_CHECK(x) if (!(x)) { *i_block = j; return -1;} (void)0
 #endif
-    const int mtx_res = acquire_allocator_mutex(this, __func__);
+    int_fast32_t j = -1;
+    uint_fast64_t accounted_free_space = 0, accounted_used_space = 0;
+    VERIFICATION_CHECK(pool->fl_count == pool_fl_count(pool->size));
+    VERIFICATION_CHECK(pool->base == pool_header_size(pool->size));
+    VERIFICATION_CHECK(pool->used + pool->free == pool->size - pool_header_size(pool->size));
+    VERIFICATION_CHECK((pool->fl_bitmap >> pool->fl_count) == 0);
+    //  Loop through every bin to verify the links, bitmaps and free space
+    j = 0;
+    for (uint_fast32_t fl = 0; fl < pool->fl_count; ++fl)
+    {
+        VERIFICATION_CHECK(((pool->fl_bitmap >> fl) & 1) == (pool->sl_bitmap[fl] != 0));
+        for (uint_fast32_t sl = 0; sl < SL_INDEX_COUNT; ++sl)
+        {
+            const mem_chunk* const head = chunk_at(pool, pool->bins[fl * SL_INDEX_COUNT + sl]);
+            VERIFICATION_CHECK(((pool->sl_bitmap[fl] >> sl) & 1) == (head != NULL));
+            for (const mem_chunk* current = head; current; current = chunk_at(pool, current->next), ++j)
+            {
+                VERIFICATION_CHECK(current->prev || current == head);
+                VERIFICATION_CHECK(current->next < pool->size && current->prev < pool->size);
+                VERIFICATION_CHECK(!current->next || chunk_at(pool, current->next)->prev == chunk_offset(pool, current));
+                VERIFICATION_CHECK(current->used == 0);
+                VERIFICATION_CHECK(current->size >= MIN_CHUNK_SIZE);
+                uint_fast32_t chunk_fl, chunk_sl;
+                mapping_insert(current->size, &chunk_fl, &chunk_sl);
+                VERIFICATION_CHECK(chunk_fl == fl && chunk_sl == sl);
+                accounted_free_space += current->size;
+            }
+        }
+    }
+    VERIFICATION_CHECK(accounted_free_space == pool->free);
+
+    accounted_free_space = 0;
+    j = 0;
+    //  Do a full walk through the whole block, checking the boundary tags on the way
+    uint_fast32_t previous_used = 1;
+    for (void* current = chunk_at(pool, pool->base); (uintptr_t)current < (uintptr_t)pool + pool->size; current = (void*)((uintptr_t)current + ((mem_chunk*)current)->size), j -= 1)
+    {
+        mem_chunk* chunk = current;
+        VERIFICATION_CHECK(chunk->size >= MIN_CHUNK_SIZE);
+        VERIFICATION_CHECK((uintptr_t)current + chunk->size <= (uintptr_t)pool + pool->size);
+        VERIFICATION_CHECK(chunk->prev_used == previous_used);
+        if (chunk->used)
+        {
+            accounted_used_space += chunk->size;
+        }
+        else
+        {
+            //  Free chunks are always merged, so two can never be adjacent
+            VERIFICATION_CHECK(previous_used);
+            VERIFICATION_CHECK(*(const uint_fast64_t*)((uintptr_t)chunk + chunk->size - sizeof(uint_fast64_t)) == chunk->size);
+            accounted_free_space += chunk->size;
+        }
+        previous_used = chunk->used;
+    }
+    VERIFICATION_CHECK(accounted_free_space == pool->free);
+    VERIFICATION_CHECK(accounted_used_space == pool->used);
+#undef VERIFICATION_CHECK
+    (void)j;
+    (void)i_block;
+    return 0;
+}
+
+int shm_ill_allocator_verify(shm_ill_allocator* allocator, int_fast32_t* i_pool, int_fast32_t* i_block)
+{
+    shm_ill_allocator* this = (shm_ill_allocator*)allocator;
+    //  With pool locks, pools are checked one at a time, so only the pool being checked is kept from being used
+    const int mtx_res = lock_allocator(this, __func__);
     if (mtx_res == 0)
     {
         if (i_pool) *i_pool = -1;
@@ -660,71 +2142,97 @@ int shm_ill_allocator_verify(shm_ill_allocator* allocator, int_fast32_t* i_pool,
         return -1;
     }
 
-    for (int_fast32_t i = 0, j = 0; i < this->count; ++i, j = -1)
+    const uint_fast64_t count = visible_pool_count(this);
+    for (uint_fast64_t i = 0; i < count; ++i)
     {
-        const mem_pool* pool = this->pools + i;
-        uint_fast32_t accounted_free_space = 0, accounted_used_space = 0;
-        //  Loop forward to verify forward links and free space
-        j = 0;
-        for (const mem_chunk* current = pool->smallest; current; current = current->next, ++j)
+        mem_pool* pool = pool_at(this, i);
+        int_fast32_t j;
+        lock_pool(this, pool);
+        const int res = verify_pool(pool, &j);
+        unlock_pool(this, pool);
+        if (res != 0)
         {
-            VERIFICATION_CHECK(current->prev || current == pool->smallest);
-            VERIFICATION_CHECK(!current->prev || current->size >= current->prev->size);
-            VERIFICATION_CHECK(!current->next || current->next->prev == current);
-            VERIFICATION_CHECK(current->used == 0);
-            VERIFICATION_CHECK(current->size >= sizeof(mem_chunk));
-            accounted_free_space += current->size;
+            if (i_pool) *i_pool = (int_fast32_t)i;
+            if (i_block) *i_block = j;
+            unlock_allocator(this, __func__);
+            return -1;
         }
-        VERIFICATION_CHECK(accounted_free_space == pool->free);
+    }
 
-        accounted_free_space = 0;
-        //  Loop forward to verify backwards links and free space
-        j = 0;
-        for (const mem_chunk* current = pool->largest; current; current = current->prev, ++j)
+    unlock_allocator(this, __func__);
+    return 0;
+}
+
+int shm_ill_allocator_verify_incremental(shm_ill_allocator* allocator, int_fast32_t* i_pool, int_fast32_t* i_block)
+{
+    shm_ill_allocator* this = (shm_ill_allocator*)allocator;
+    //  Only one pool is kept from being used at a time. Without pool locks, the allocator mutex is taken for each pool
+    //  instead, so others get to allocate in between. With them, the pool table is never moved, so it can be read
+    //  without taking its lock, same as when allocating.
+    for (uint_fast64_t i = 0;; ++i)
+    {
+        if (!has_pool_locks(this) && !lock_allocator(this, __func__))
         {
-            VERIFICATION_CHECK(current->next || current == pool->largest);
-            VERIFICATION_CHECK(!current->next || current->size <= current->next->size);
-            VERIFICATION_CHECK(!current->prev || current->prev->next == current);
-            VERIFICATION_CHECK(current->used == 0);
-            VERIFICATION_CHECK(current->size >= sizeof(mem_chunk));
-            accounted_free_space += current->size;
+            if (i_pool) *i_pool = -1;
+            if (i_block) *i_block = -1;
+            return -1;
         }
-        VERIFICATION_CHECK(accounted_free_space == pool->free);
-
-        accounted_free_space = 0;
-        j = 0;
-        //  Do a full walk through the whole block
-        for (void* current = pool->base; (uintptr_t)current < (uintptr_t)pool->base + this->pool_size; current = (void*)((uintptr_t)current + ((mem_chunk*)current)->size), j -= 1)
+        if (i >= visible_pool_count(this))
         {
-            mem_chunk* chunk = current;
-            VERIFICATION_CHECK(chunk->size >= sizeof(mem_chunk));
-            VERIFICATION_CHECK((uintptr_t)current < (uintptr_t)pool->base + this->pool_size);
-            if (chunk->used)
-            {
-                accounted_used_space += chunk->size;
-            }
-            else
-            {
-                accounted_free_space += chunk->size;
-            }
-            if (chunk->used == 0)
+            if (!has_pool_locks(this))
             {
-                if (chunk->next)
-                {
-                    VERIFICATION_CHECK(chunk->next->prev == chunk && chunk->size <= chunk->next->size);
-                }
-                if (chunk->prev)
-                {
-                    VERIFICATION_CHECK(chunk->prev->next == chunk && chunk->size >= chunk->prev->size);
-                }
+                unlock_allocator(this, __func__);
             }
+            break;
+        }
+        mem_pool* pool = pool_at(this, i);
+        int_fast32_t j;
+        lock_pool(this, pool);
+        const int res = verify_pool(pool, &j);
+        unlock_pool(this, pool);
+        if (!has_pool_locks(this))
+        {
+            unlock_allocator(this, __func__);
+        }
+        if (res != 0)
+        {
+            if (i_pool) *i_pool = (int_fast32_t)i;
+            if (i_block) *i_block = j;
+            return -1;
         }
     }
-
-    release_allocator_mutex(this, __func__);
     return 0;
 }
 
+void shm_ill_allocator_counters(
+        shm_ill_allocator* allocator, uint_fast64_t* p_bytes_in_use, uint_fast64_t* p_peak_bytes_in_use,
+        uint_fast64_t* p_allocation_count, uint_fast64_t* p_free_count, uint_fast64_t* p_reallocation_count)
+{
+    shm_ill_allocator* this = (shm_ill_allocator*)allocator;
+    //  Counters are read one at a time, so they need not be consistent with each other while others are using the
+    //  allocator
+    if (p_bytes_in_use) *p_bytes_in_use = atomic_load_explicit(&this->bytes_in_use, memory_order_relaxed);
+    if (p_peak_bytes_in_use) *p_peak_bytes_in_use = atomic_load_explicit(&this->peak_bytes_in_use, memory_order_relaxed);
+    uint_fast64_t op_counts[2] = {
+            atomic_load_explicit(&this->op_counts[OP_COUNT_ALLOCATION], memory_order_relaxed),
+            atomic_load_explicit(&this->op_counts[OP_COUNT_RELEASE], memory_order_relaxed),
+    };
+    if (has_pool_locks(this) && (p_allocation_count || p_free_count))
+    {
+        //  Pool table is never moved with pool locks, so it is safe to read without locking
+        const uint_fast64_t count = visible_pool_count(this);
+        for (uint_fast64_t i = 0; i < count; ++i)
+        {
+            const mem_pool* const pool = pool_at(this, i);
+            op_counts[OP_COUNT_ALLOCATION] += atomic_load_explicit(&pool->op_counts[OP_COUNT_ALLOCATION], memory_order_relaxed);
+            op_counts[OP_COUNT_RELEASE] += atomic_load_explicit(&pool->op_counts[OP_COUNT_RELEASE], memory_order_relaxed);
+        }
+    }
+    if (p_allocation_count) *p_allocation_count = op_counts[OP_COUNT_ALLOCATION];
+    if (p_free_count) *p_free_count = op_counts[OP_COUNT_RELEASE];
+    if (p_reallocation_count) *p_reallocation_count = atomic_load_explicit(&this->reallocation_count, memory_order_relaxed);
+}
+
 
 uint_fast32_t shm_ill_allocator_count_used_blocks(shm_ill_allocator* allocator, uint_fast32_t size_out_buffer, uint_fast32_t* out_buffer)
 {
@@ -733,13 +2241,15 @@ uint_fast32_t shm_ill_allocator_count_used_blocks(shm_ill_allocator* allocator,
     return 0;
 #else
     uint_fast32_t found = 0;
-    for (uint_fast64_t i = 0; i < this->count; ++i)
+    const uint_fast64_t count = visible_pool_count(this);
+    for (uint_fast64_t i = 0; i < count; ++i)
     {
-        const mem_pool* pool = this->pools + i;
-        const void* pos = pool->base;
-        while (pos != pool->base + pool->used + pool->free)
+        const mem_pool* pool = pool_at(this, i);
+        const void* pos = chunk_at(pool, pool->base);
+        const void* const end = (const void*)((uintptr_t)pos + pool->used + pool->free);
+        while (pos != end)
         {
-            if (pos > pool->base + pool->used + pool->free)
+            if (pos > end)
             {
                 return -1;
             }
@@ -799,33 +2309,34 @@ int shm_ill_allocator_set_debug_trap(shm_ill_allocator* allocator, uint32_t inde
     return 1;
 }
 
-static inline uint_fast64_t check_for_aligned_size(mem_chunk* chunk, uint_fast64_t alignment, uint_fast64_t size)
+shm_ill_allocator* shm_ill_allocator_create(uint_fast64_t pool_size, uint_fast64_t initial_pool_count)
 {
-    void* ptr = (void*)&chunk->next;
-    uintptr_t extra = (uintptr_t)ptr & (alignment - 1);
-    if (!extra)
-    {
-        return size;
-    }
-    return size + (alignment - extra);
+    return shm_ill_allocator_create_with_flags(pool_size, initial_pool_count, 0);
 }
 
-shm_ill_allocator* shm_ill_allocator_create(uint_fast64_t pool_size, uint_fast64_t initial_pool_count)
+static int query_system_info(void)
 {
     if (!PAGE_SIZE)
     {
 #ifndef _WIN32
         PAGE_SIZE = sysconf(_SC_PAGESIZE);
+        FUTEX_SPIN_LIMIT = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? FUTEX_MAX_SPINS : 0;
 #else
         SYSTEM_INFO sys_info;
         GetSystemInfo(&sys_info);
         PAGE_SIZE = (long) sys_info.dwPageSize;
+        FUTEX_SPIN_LIMIT = sys_info.dwNumberOfProcessors > 1 ? FUTEX_MAX_SPINS : 0;
 #endif
-        //  Check that we have the page size
-        if (!PAGE_SIZE)
-        {
-            return NULL;
-        }
+    }
+    //  Check that we have the page size
+    return PAGE_SIZE != 0;
+}
+
+shm_ill_allocator* shm_ill_allocator_create_with_flags(uint_fast64_t pool_size, uint_fast64_t initial_pool_count, uint_fast32_t flags)
+{
+    if (!query_system_info())
+    {
+        return NULL;
     }
 #ifndef _WIN32
     shm_ill_allocator* this = mmap(NULL, round_to_nearest_page_up(sizeof(*this)), PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_SHARED, -1, 0);
@@ -842,66 +2353,54 @@ shm_ill_allocator* shm_ill_allocator_create(uint_fast64_t pool_size, uint_fast64
 #endif
     *this = (shm_ill_allocator){0};
     this->capacity = initial_pool_count < 32 ? 32 : initial_pool_count;
-    this->pool_buffer_size = round_to_nearest_page_up(this->capacity * sizeof(*this->pools));
-    this->capacity = this->pool_buffer_size / sizeof(*this->pools);
-    this->futex_waiter_count = 0;
-    this->access_futex_value = 0;
+    if ((flags & SHM_ILL_ALLOCATOR_POOL_LOCKS) && this->capacity < POOL_TABLE_CAPACITY)
+    {
+        this->capacity = POOL_TABLE_CAPACITY;
+    }
+    this->pool_buffer_size = round_to_nearest_page_up(this->capacity * sizeof(uint_fast64_t));
+    this->capacity = this->pool_buffer_size / sizeof(uint_fast64_t);
+    this->access_futex_value = FUTEX_FREE;
+    this->access_futex_spins = 0;
 #ifndef _WIN32
-    this->pools = mmap(0, this->pool_buffer_size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_SHARED, -1, 0);
-    if (this->pools == MAP_FAILED)
+    //  Pages of the table are only backed once pools are added to them
+    uint_fast64_t* const table = mmap(0, this->pool_buffer_size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_SHARED|MAP_NORESERVE, -1, 0);
+    if (table == MAP_FAILED)
     {
         munmap(this, round_to_nearest_page_up(sizeof(*this)));
         return NULL;
     }
 #else
-    this->pools = VirtualAlloc(NULL, this->pool_buffer_size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
-    if (this->pools == NULL)
+    uint_fast64_t* const table = VirtualAlloc(NULL, this->pool_buffer_size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+    if (table == NULL)
     {
         VirtualFree(this, 0, MEM_RELEASE);
         return NULL;
     }
 #endif
+    this->pools = pool_offset(this, table);
 
-    this->pool_size = round_to_nearest_page_up(pool_size);
+    this->flags = flags;
+    this->id = atomic_fetch_add(&ALLOCATOR_ID_COUNTER, 1) + 1;
+    this->pool_size = (pool_size + pool_granularity(this) - 1) & ~(pool_granularity(this) - 1);
     for (uint_fast32_t i = 0; i < initial_pool_count; ++i)
     {
-        mem_pool* p = this->pools + i;
-#ifndef _WIN32
-        p->base = mmap(NULL, pool_size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_SHARED, -1, 0);
-        if (p->base == MAP_FAILED)
-#else
-            p->base = VirtualAlloc(NULL, pool_size, MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
-        if (p->base == NULL)
-#endif
+        mem_pool* const p = map_pool(this->pool_size, (flags & SHM_ILL_ALLOCATOR_HUGE_PAGES) != 0);
+        if (!p)
         {
             for (uint_fast32_t j = 0; j < i; ++j)
             {
-#ifndef _WIN32
-                munmap(this->pools[i].base, pool_size);
-#else
-                BOOL res = VirtualFree(this->pools[i].base, 0, MEM_RELEASE);
-                assert(res != 0);
-#endif
+                unmap_pool(pool_at(this, j));
             }
 #ifndef _WIN32
-            munmap(this->pools, this->pool_buffer_size);
+            munmap(table, this->pool_buffer_size);
             munmap(this, round_to_nearest_page_up(sizeof(*this)));
 #else
-            VirtualFree(this->pools, 0, MEM_RELEASE);
+            VirtualFree(table, 0, MEM_RELEASE);
             VirtualFree(this, 0, MEM_RELEASE);
 #endif
             return NULL;
         }
-        p->size = this->pool_size;
-        p->used = 0;
-        p->free = this->pool_size;
-        mem_chunk* c = p->base;
-        p->smallest = c;
-        p->largest = c;
-        c->used = 0;
-        c->prev = NULL;
-        c->next = NULL;
-        c->size = this->pool_size;
+        table[i] = pool_offset(this, p);
     }
     this->count = initial_pool_count;
 #ifdef JMEM_ALLOC_TRACKING
@@ -915,9 +2414,339 @@ shm_ill_allocator* shm_ill_allocator_create(uint_fast64_t pool_size, uint_fast64
     return this;
 }
 
+shm_ill_allocator* shm_ill_allocator_create_reserved(
+        uint_fast64_t pool_size, uint_fast64_t initial_pool_count, uint_fast32_t flags, uint_fast64_t max_size)
+{
+    if (!query_system_info())
+    {
+        return NULL;
+    }
+    const uint_fast64_t granularity = (flags & SHM_ILL_ALLOCATOR_HUGE_PAGES) ? HUGE_PAGE_SIZE : PAGE_SIZE;
+    const uint_fast64_t header_size = round_to_nearest_page_up(sizeof(shm_ill_allocator));
+    const uint_fast64_t table_size = round_to_nearest_page_up(POOL_TABLE_CAPACITY * sizeof(uint_fast64_t));
+    //  Same layout as a named allocator
+    const uint_fast64_t data_offset = (header_size + table_size + granularity - 1) & ~(granularity - 1);
+    pool_size = (pool_size + granularity - 1) & ~(granularity - 1);
+    max_size = (max_size + granularity - 1) & ~(granularity - 1);
+    if (max_size < data_offset + initial_pool_count * pool_size)
+    {
+        return NULL;
+    }
+
+#ifndef _WIN32
+    //  Whole region is mapped as shared right away, so processes forked at any point see pools added later. With
+    //  MAP_NORESERVE nothing is committed until pages are touched. Extra is mapped to align it.
+    void* const region = mmap(NULL, max_size + granularity, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED)
+    {
+        return NULL;
+    }
+    const uintptr_t base = ((uintptr_t)region + granularity - 1) & ~(uintptr_t)(granularity - 1);
+    if (base != (uintptr_t)region)
+    {
+        munmap(region, base - (uintptr_t)region);
+    }
+    munmap((void*)(base + max_size), (uintptr_t)region + granularity - base);
+#else
+    //  There is no fork on Windows, but the region still saves a system call per pool. Pages are committed per pool.
+    const uintptr_t base = (uintptr_t)VirtualAlloc(NULL, max_size, MEM_RESERVE, PAGE_READWRITE);
+    if (!base || !VirtualAlloc((void*)base, data_offset, MEM_COMMIT, PAGE_READWRITE))
+    {
+        if (base)
+        {
+            VirtualFree((void*)base, 0, MEM_RELEASE);
+        }
+        return NULL;
+    }
+#endif
+
+    shm_ill_allocator* const this = (shm_ill_allocator*)base;
+    *this = (shm_ill_allocator){0};
+    this->access_futex_value = FUTEX_FREE;
+    this->access_futex_spins = 0;
+    this->pools = header_size;
+    this->pool_buffer_size = table_size;
+    this->capacity = table_size / sizeof(uint_fast64_t);
+    this->flags = flags;
+    this->id = atomic_fetch_add(&ALLOCATOR_ID_COUNTER, 1) + 1;
+    this->pool_size = pool_size;
+    this->reserved_size = max_size;
+    this->segment_size = data_offset;
+    for (uint_fast32_t i = 0; i < initial_pool_count; ++i)
+    {
+        mem_pool* const p = carve_reserved_pool(this, pool_size);
+        if (!p)
+        {
+#ifndef _WIN32
+            munmap(this, max_size);
+#else
+            VirtualFree(this, 0, MEM_RELEASE);
+#endif
+            return NULL;
+        }
+        pool_table(this)[i] = pool_offset(this, p);
+        this->count = i + 1;
+    }
+    return this;
+}
+
+shm_ill_allocator* shm_ill_allocator_create_named(
+        const char* name, uint_fast64_t pool_size, uint_fast64_t initial_pool_count, uint_fast32_t flags,
+        uint_fast64_t max_size)
+{
+#ifndef _WIN32
+    if (!query_system_info() || strlen(name) >= NAMED_ALLOCATOR_NAME_LENGTH)
+    {
+        return NULL;
+    }
+    const uint_fast64_t granularity = (flags & SHM_ILL_ALLOCATOR_HUGE_PAGES) ? HUGE_PAGE_SIZE : PAGE_SIZE;
+    const uint_fast64_t header_size = round_to_nearest_page_up(sizeof(shm_ill_allocator));
+    const uint_fast64_t table_size = round_to_nearest_page_up(POOL_TABLE_CAPACITY * sizeof(uint_fast64_t));
+    //  Pools start at a multiple of the granularity, so that huge pages can back them
+    const uint_fast64_t data_offset = (header_size + table_size + granularity - 1) & ~(granularity - 1);
+    pool_size = (pool_size + granularity - 1) & ~(granularity - 1);
+    max_size = (max_size + granularity - 1) & ~(granularity - 1);
+    if (max_size < data_offset + initial_pool_count * pool_size)
+    {
+        return NULL;
+    }
+
+    const int fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, 0600);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    //  Address range is reserved for the whole object, so that it can grow in place. Extra is reserved to align it.
+    void* const reservation = mmap(NULL, max_size + granularity, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (reservation == MAP_FAILED)
+    {
+        goto failed_reservation;
+    }
+    const uintptr_t base = ((uintptr_t)reservation + granularity - 1) & ~(uintptr_t)(granularity - 1);
+    if (base != (uintptr_t)reservation)
+    {
+        munmap(reservation, base - (uintptr_t)reservation);
+    }
+    munmap((void*)(base + max_size), (uintptr_t)reservation + granularity - base);
+    if (ftruncate(fd, (off_t)data_offset) != 0
+        || mmap((void*)base, data_offset, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        goto failed_mapping;
+    }
+
+    shm_ill_allocator* const this = (shm_ill_allocator*)base;
+    *this = (shm_ill_allocator){0};
+    this->access_futex_value = FUTEX_FREE;
+    this->access_futex_spins = 0;
+    this->pools = header_size;
+    this->pool_buffer_size = table_size;
+    this->capacity = table_size / sizeof(uint_fast64_t);
+    this->flags = flags;
+    this->id = atomic_fetch_add(&ALLOCATOR_ID_COUNTER, 1) + 1;
+    this->pool_size = pool_size;
+    memcpy(this->name, name, strlen(name) + 1);
+    this->reserved_size = max_size;
+    this->segment_size = data_offset;
+    segment_mapping* const mapping = claim_segment_mapping(this, fd, data_offset);
+    if (!mapping)
+    {
+        goto failed_mapping;
+    }
+    for (uint_fast32_t i = 0; i < initial_pool_count; ++i)
+    {
+        mem_pool* const p = map_named_pool(this, pool_size);
+        if (!p)
+        {
+            release_segment_mapping(mapping);
+            goto failed_mapping;
+        }
+        pool_table(this)[i] = pool_offset(this, p);
+        this->count = i + 1;
+    }
+    //  Processes attaching only use the allocator once everything above is visible to them
+    atomic_store_explicit(&this->initialized, NAMED_ALLOCATOR_MAGIC, memory_order_release);
+    return this;
+
+failed_mapping:
+    munmap((void*)base, max_size);
+failed_reservation:
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+#else
+    (void)name;
+    (void)pool_size;
+    (void)initial_pool_count;
+    (void)flags;
+    (void)max_size;
+    return NULL;
+#endif
+}
+
+shm_ill_allocator* shm_ill_allocator_attach(const char* name)
+{
+#ifndef _WIN32
+    if (!query_system_info())
+    {
+        return NULL;
+    }
+    const int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    //  Creator may not have sized the object yet, in which case reading the header would fault
+    const uint_fast64_t header_size = round_to_nearest_page_up(sizeof(shm_ill_allocator));
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint_fast64_t)st.st_size < header_size)
+    {
+        close(fd);
+        return NULL;
+    }
+    const shm_ill_allocator* const peek = mmap(NULL, header_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (peek == MAP_FAILED)
+    {
+        close(fd);
+        return NULL;
+    }
+    //  Nor may the header be written yet
+    if (atomic_load_explicit(&peek->initialized, memory_order_acquire) != NAMED_ALLOCATOR_MAGIC)
+    {
+        munmap((void*)peek, header_size);
+        close(fd);
+        return NULL;
+    }
+    const uint_fast64_t granularity = (peek->flags & SHM_ILL_ALLOCATOR_HUGE_PAGES) ? HUGE_PAGE_SIZE : PAGE_SIZE;
+    const uint_fast64_t reserved_size = peek->reserved_size;
+    const uint_fast64_t segment_size = atomic_load(&peek->segment_size);
+    munmap((void*)peek, header_size);
+
+    //  Object holds no absolute addresses, so it can go anywhere, as long as it is aligned the same way
+    void* const reservation = mmap(NULL, reserved_size + granularity, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (reservation == MAP_FAILED)
+    {
+        close(fd);
+        return NULL;
+    }
+    const uintptr_t base = ((uintptr_t)reservation + granularity - 1) & ~(uintptr_t)(granularity - 1);
+    if (base != (uintptr_t)reservation)
+    {
+        munmap(reservation, base - (uintptr_t)reservation);
+    }
+    munmap((void*)(base + reserved_size), (uintptr_t)reservation + granularity - base);
+    shm_ill_allocator* const this = (shm_ill_allocator*)base;
+    if (mmap((void*)base, segment_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED
+        || !claim_segment_mapping(this, fd, segment_size))
+    {
+        munmap((void*)base, reserved_size);
+        close(fd);
+        return NULL;
+    }
+    //  Pools may have been added since the size was read
+    map_new_segments(this);
+    return this;
+#else
+    (void)name;
+    return NULL;
+#endif
+}
+
+void shm_ill_allocator_detach(shm_ill_allocator* allocator)
+{
+    shm_ill_allocator* this = (shm_ill_allocator*)allocator;
+#ifndef _WIN32
+    if (!this->name[0])
+    {
+        return;
+    }
+    thread_cache* const cache = find_thread_cache(this, 0);
+    if (cache)
+    {
+        cache->allocator = NULL;
+        cache->allocator_id = 0;
+    }
+    segment_mapping* const mapping = find_segment_mapping(this);
+    assert(mapping);
+    const int fd = mapping->fd;
+    release_segment_mapping(mapping);
+    munmap(this, this->reserved_size);
+    close(fd);
+#else
+    (void)this;
+#endif
+}
+
+int shm_ill_allocator_refresh(shm_ill_allocator* allocator)
+{
+    shm_ill_allocator* this = (shm_ill_allocator*)allocator;
+#ifndef _WIN32
+    if (this->name[0])
+    {
+        return map_new_segments(this);
+    }
+#endif
+    (void)this;
+    return 0;
+}
+
+uint_fast64_t shm_ill_allocator_to_offset(const shm_ill_allocator* allocator, const void* ptr)
+{
+    //  Same as offsets used inside the allocator, so it works the same for named allocators and anonymous ones
+    return ptr ? pool_offset(allocator, ptr) : 0;
+}
+
+void* shm_ill_allocator_from_offset(const shm_ill_allocator* allocator, uint_fast64_t offset)
+{
+    return offset ? (void*)((uintptr_t)allocator + offset) : NULL;
+}
+
+void shm_ill_allocator_set_trim_policy(shm_ill_allocator* allocator, uint_fast64_t spare_pools, uint_fast64_t delay)
+{
+    shm_ill_allocator* this = (shm_ill_allocator*)allocator;
+    const int mtx_res = lock_allocator(this, __func__);
+    if (mtx_res == 0) return;
+    if (!lock_table(this, __func__))
+    {
+        unlock_allocator(this, __func__);
+        return;
+    }
+    this->auto_trim = 1;
+    this->spare_pools = spare_pools;
+    this->trim_delay = delay;
+    atomic_store(&this->next_trim, atomic_load(&this->free_count));
+    unlock_table(this, __func__);
+    unlock_allocator(this, __func__);
+}
+
+uint_fast64_t shm_ill_allocator_trim(shm_ill_allocator* allocator)
+{
+    shm_ill_allocator* this = (shm_ill_allocator*)allocator;
+    const int mtx_res = lock_allocator(this, __func__);
+    if (mtx_res == 0) return 0;
+    if (!lock_table(this, __func__))
+    {
+        unlock_allocator(this, __func__);
+        return 0;
+    }
+    const uint_fast64_t released = trim_pools(this, 0);
+    unlock_table(this, __func__);
+    unlock_allocator(this, __func__);
+    return released;
+}
+
 void
 shm_ill_allocator_set_bad_alloc_callback(shm_ill_allocator* allocator, void (* callback)(shm_ill_allocator* allocator, void* param), void* param)
 {
+#ifndef _WIN32
+    if (allocator->name[0])
+    {
+        segment_mapping* const mapping = find_segment_mapping(allocator);
+        assert(mapping);
+        mapping->bad_alloc_callback = callback;
+        mapping->bad_alloc_param = param;
+        return;
+    }
+#endif
     allocator->bad_alloc_callback = callback;
     allocator->bad_alloc_param = param;
 }
@@ -925,6 +2754,16 @@ shm_ill_allocator_set_bad_alloc_callback(shm_ill_allocator* allocator, void (* c
 void shm_ill_allocator_set_double_free_callback(
         shm_ill_allocator* allocator, void (* callback)(shm_ill_allocator* allocator, void* param), void* param)
 {
+#ifndef _WIN32
+    if (allocator->name[0])
+    {
+        segment_mapping* const mapping = find_segment_mapping(allocator);
+        assert(mapping);
+        mapping->double_free_callback = callback;
+        mapping->double_free_param = param;
+        return;
+    }
+#endif
     allocator->double_free_callback = callback;
     allocator->double_free_param = param;
 }
@@ -0,0 +1,108 @@
+//
+// Created by jan on 17.10.2026.
+//
+//  Compares random access over memory from pools backed by normal pages with memory from pools backed by huge pages.
+//  Time is always reported, dTLB misses only when the kernel allows hardware counters to be read.
+#include "../include/jmem/ill_alloc.h"
+#include <time.h>
+#include <string.h>
+#include <assert.h>
+#include <stdio.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef uint8_t u8;
+
+enum {BLOCK_SIZE = 1 << 20, BLOCK_COUNT = 48, ACCESS_COUNT = 1 << 24};
+
+static int open_dtlb_counter(void)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static void run(const char* name, uint_fast32_t flags)
+{
+    ill_allocator* allocator = ill_allocator_create_with_flags(BLOCK_SIZE * 4, 1, flags);
+    assert(allocator);
+    u8* blocks[BLOCK_COUNT];
+    for (u32 i = 0; i < BLOCK_COUNT; ++i)
+    {
+        blocks[i] = ill_alloc(allocator, BLOCK_SIZE);
+        assert(blocks[i]);
+        memset(blocks[i], (int)i, BLOCK_SIZE);
+    }
+
+    const int fd = open_dtlb_counter();
+#ifdef __linux__
+    if (fd >= 0)
+    {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+    const clock_t begin = clock();
+    u64 state = 1;
+    u64 sum = 0;
+    for (u32 i = 0; i < ACCESS_COUNT; ++i)
+    {
+        state = state * 6364136223846793005llu + 1442695040888963407llu;
+        const u64 r = state >> 16;
+        sum += blocks[r % BLOCK_COUNT][(r / BLOCK_COUNT) % BLOCK_SIZE];
+    }
+    const clock_t end = clock();
+    long long misses = -1;
+#ifdef __linux__
+    if (fd >= 0)
+    {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &misses, sizeof(misses)) != sizeof(misses))
+        {
+            misses = -1;
+        }
+        close(fd);
+    }
+#endif
+
+    if (misses >= 0)
+    {
+        printf("%s: %u random reads took %g ms, %lld dTLB read misses (checksum %llu)\n", name, ACCESS_COUNT,
+               (double)(end - begin) / CLOCKS_PER_SEC * 1000.0, misses, (unsigned long long)sum);
+    }
+    else
+    {
+        printf("%s: %u random reads took %g ms, dTLB read misses n/a (checksum %llu)\n", name, ACCESS_COUNT,
+               (double)(end - begin) / CLOCKS_PER_SEC * 1000.0, (unsigned long long)sum);
+    }
+
+    for (u32 i = 0; i < BLOCK_COUNT; ++i)
+    {
+        ill_jfree(allocator, blocks[i]);
+    }
+    assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+    ill_allocator_destroy(allocator);
+}
+
+int main()
+{
+    run("normal pages", 0);
+    run("huge pages", ILL_ALLOCATOR_HUGE_PAGES);
+    return 0;
+}
@@ -7,6 +7,12 @@
 
 typedef uint32_t u32;
 
+static void count_double_free(ill_allocator* allocator, void* param)
+{
+    (void)allocator;
+    *(u32*)param += 1;
+}
+
 int main()
 {
     void* pointer_array[1024] = {0};
@@ -271,5 +277,444 @@ int main()
     ill_allocator_destroy(allocator);
     allocator = NULL;
 
+    allocator = ill_allocator_create(1 << 16, 1);
+    assert(allocator);
+    assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+    {
+        //  Sizes which spread over many different bins
+        for (u32 i = 0; i < 1024; ++i)
+        {
+            const u32 size = 1 + (i * 397) % 3000;
+            pointer_array[i] = ill_alloc(allocator, size);
+            assert(pointer_array[i]);
+            memset(pointer_array[i], 0xCC, size);
+        }
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        for (u32 i = 0; i < 1024; i += 3)
+        {
+            ill_jfree(allocator, pointer_array[i]);
+            pointer_array[i] = NULL;
+        }
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        for (u32 i = 0; i < 1024; i += 3)
+        {
+            const u32 size = 1 + (i * 131) % 2000;
+            pointer_array[i] = ill_alloc(allocator, size);
+            assert(pointer_array[i]);
+            memset(pointer_array[i], 0xCC, size);
+            assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+        }
+
+        for (u32 i = 0; i < 1024; ++i)
+        {
+            ill_jfree(allocator, pointer_array[1023 - i]);
+            pointer_array[1023 - i] = NULL;
+        }
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+    }
+
+    ill_allocator_destroy(allocator);
+    allocator = NULL;
+
+    allocator = ill_allocator_create_with_flags(3 << 12, 1, ILL_ALLOCATOR_ALIGNED_POOLS);
+    assert(allocator);
+    assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+    {
+        //  Mix of blocks which fit into regular pools and those which need oversized ones
+        for (u32 i = 0; i < 1024; ++i)
+        {
+            const u32 size = (i % 64) == 0 ? (1 << 15) + i : 1 + (i * 397) % 2000;
+            pointer_array[i] = ill_alloc(allocator, size);
+            assert(pointer_array[i]);
+            memset(pointer_array[i], 0xCC, size);
+        }
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        for (u32 i = 0; i < 1024; i += 2)
+        {
+            ill_jfree(allocator, pointer_array[i]);
+            pointer_array[i] = NULL;
+        }
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        for (u32 i = 1; i < 1024; i += 2)
+        {
+            void* const ptr = ill_jrealloc(allocator, pointer_array[i], 1 + (i * 131) % 3000);
+            assert(ptr);
+            pointer_array[i] = ptr;
+            assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+        }
+
+        for (u32 i = 1; i < 1024; i += 2)
+        {
+            ill_jfree(allocator, pointer_array[i]);
+            pointer_array[i] = NULL;
+        }
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+    }
+
+    ill_allocator_destroy(allocator);
+    allocator = NULL;
+
+    allocator = ill_allocator_create(1 << 12, 1);
+    assert(allocator);
+
+    {
+        //  Many small pools, so that the pool search has to scan past full ones
+        for (u32 i = 0; i < 256; ++i)
+        {
+            pointer_array[i] = ill_alloc(allocator, 1500 + (i * 37) % 1000);
+            assert(pointer_array[i]);
+        }
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        for (u32 i = 0; i < 256; i += 3)
+        {
+            ill_jfree(allocator, pointer_array[i]);
+            pointer_array[i] = NULL;
+        }
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        for (u32 i = 0; i < 256; i += 3)
+        {
+            pointer_array[i] = ill_alloc(allocator, 1000 + (i * 53) % 1500);
+            assert(pointer_array[i]);
+            assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+        }
+
+        for (u32 i = 0; i < 256; ++i)
+        {
+            ill_jfree(allocator, pointer_array[i]);
+            pointer_array[i] = NULL;
+        }
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+    }
+
+    ill_allocator_destroy(allocator);
+    allocator = NULL;
+
+    allocator = ill_allocator_create(1 << 16, 1);
+    assert(allocator);
+
+    {
+        //  Aligned blocks, with their padding carved into free chunks which later allocations can use
+        for (u32 i = 0; i < 256; ++i)
+        {
+            const uint_fast64_t alignment = (uint_fast64_t)16 << (i % 6);
+            pointer_array[i] = (i & 1) ? ill_alloc(allocator, 8 + i) : ill_alloc_aligned(allocator, 8 + i, alignment);
+            assert(pointer_array[i]);
+            assert((i & 1) || ((uintptr_t)pointer_array[i] & (alignment - 1)) == 0);
+            memset(pointer_array[i], 0xCC, 8 + i);
+        }
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        //  Growing and moving keeps the alignment
+        for (u32 i = 0; i < 256; i += 2)
+        {
+            const uint_fast64_t alignment = (uint_fast64_t)16 << (i % 6);
+            void* const ptr = ill_jrealloc_aligned(allocator, pointer_array[i], 600 + i, alignment);
+            assert(ptr);
+            assert(((uintptr_t)ptr & (alignment - 1)) == 0);
+            assert(*(unsigned char*)ptr == 0xCC);
+            pointer_array[i] = ptr;
+        }
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        //  Block which was not aligned gets moved to an aligned one
+        void* const ptr = ill_jrealloc_aligned(allocator, pointer_array[1], 9, 4096);
+        assert(ptr);
+        assert(((uintptr_t)ptr & 4095) == 0);
+        assert(*(unsigned char*)ptr == 0xCC);
+        pointer_array[1] = ptr;
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        for (u32 i = 0; i < 256; ++i)
+        {
+            ill_jfree(allocator, pointer_array[i]);
+            pointer_array[i] = NULL;
+        }
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+    }
+
+    ill_allocator_destroy(allocator);
+    allocator = NULL;
+
+    allocator = ill_allocator_create(1 << 16, 1);
+    assert(allocator);
+    ill_allocator_set_mmap_threshold(allocator, 1 << 17);
+
+    {
+        //  Blocks over the threshold get their own mappings, which are grown without copying by the caller
+        unsigned char* const small = ill_alloc(allocator, 1000);
+        assert(small);
+        unsigned char* big = ill_alloc(allocator, 1 << 18);
+        assert(big);
+        assert(((uintptr_t)big & 31) == 0);
+        for (u32 i = 0; i < (1 << 18); i += 4096)
+        {
+            big[i] = (unsigned char)(i >> 12);
+        }
+        unsigned char* other = ill_alloc(allocator, 3 << 17);
+        assert(other);
+        memset(other, 0xCC, 3 << 17);
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        big = ill_jrealloc(allocator, big, 1 << 24);
+        assert(big);
+        for (u32 i = 0; i < (1 << 18); i += 4096)
+        {
+            assert(big[i] == (unsigned char)(i >> 12));
+        }
+        memset(big + (1 << 18), 0xCC, (1 << 24) - (1 << 18));
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        //  Shrinking below the threshold moves the block back into a pool
+        big = ill_jrealloc(allocator, big, 1 << 12);
+        assert(big);
+        for (u32 i = 0; i < (1 << 12); i += 4096)
+        {
+            assert(big[i] == (unsigned char)(i >> 12));
+        }
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        ill_jfree(allocator, other);
+        ill_jfree(allocator, big);
+        ill_jfree(allocator, small);
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        //  Mappings still alive are released by the destroy call
+        other = ill_alloc(allocator, 1 << 20);
+        assert(other);
+    }
+
+    ill_allocator_destroy(allocator);
+    allocator = NULL;
+
+    allocator = ill_allocator_create(1 << 14, 1);
+    assert(allocator);
+
+    {
+        //  Empty pools beyond the spare ones are released, both explicitly and when pools become empty
+        for (u32 i = 0; i < 256; ++i)
+        {
+            pointer_array[i] = ill_alloc(allocator, 1000);
+            assert(pointer_array[i]);
+        }
+        for (u32 i = 0; i < 256; ++i)
+        {
+            ill_jfree(allocator, pointer_array[i]);
+            pointer_array[i] = NULL;
+        }
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+        assert(ill_allocator_trim(allocator) > 0);
+        assert(ill_allocator_trim(allocator) == 0);
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        ill_allocator_set_trim_policy(allocator, 1, 0);
+        for (u32 i = 0; i < 256; ++i)
+        {
+            pointer_array[i] = ill_alloc(allocator, 1000 + (i & 3) * (1 << 14));
+            assert(pointer_array[i]);
+        }
+        for (u32 i = 0; i < 256; ++i)
+        {
+            ill_jfree(allocator, pointer_array[(i * 97) & 255]);
+            if ((i & 31) == 0)
+            {
+                assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+            }
+        }
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+        //  Only the spare pool is left
+        assert(ill_allocator_trim(allocator) == 0);
+        ill_allocator_set_trim_policy(allocator, 0, 0);
+        assert(ill_allocator_trim(allocator) == (1 << 14));
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        void* const ptr = ill_alloc(allocator, 100);
+        assert(ptr);
+        ill_jfree(allocator, ptr);
+    }
+
+    ill_allocator_destroy(allocator);
+    allocator = NULL;
+
+    allocator = ill_allocator_create(1 << 16, 1);
+    assert(allocator);
+
+    {
+        //  Batches are carved into separate blocks, which can be freed in any order
+        uint_fast64_t sizes[1024];
+        for (u32 i = 0; i < 1024; ++i)
+        {
+            sizes[i] = 1 + (i * 37) % 300;
+        }
+        //  Make one block large enough to get a group of its own
+        sizes[500] = 1 << 15;
+        assert(ill_alloc_batch(allocator, 1024, sizes, pointer_array) == 0);
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+        for (u32 i = 0; i < 1024; ++i)
+        {
+            assert(pointer_array[i]);
+            memset(pointer_array[i], (int)(i & 0xFF), sizes[i]);
+        }
+        for (u32 i = 0; i < 1024; ++i)
+        {
+            const unsigned char* const p = pointer_array[i];
+            assert(p[0] == (i & 0xFF) && p[sizes[i] - 1] == (i & 0xFF));
+        }
+        for (u32 i = 0; i < 1024; ++i)
+        {
+            ill_jfree(allocator, pointer_array[(i * 97) & 1023]);
+        }
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        assert(ill_alloc_batch_uniform(allocator, 1024, 48, pointer_array) == 0);
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+        for (u32 i = 0; i < 1024; ++i)
+        {
+            assert(pointer_array[i]);
+            memset(pointer_array[i], 0xCC, 48);
+        }
+        for (u32 i = 1024; i != 0; --i)
+        {
+            ill_jfree(allocator, pointer_array[i - 1]);
+            pointer_array[i - 1] = NULL;
+        }
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+    }
+
+    {
+        //  Blocks freed as a batch in any order are merged back into whole pools
+        for (u32 i = 0; i < 1024; ++i)
+        {
+            pointer_array[i] = ill_alloc(allocator, 1 + (i * 13) % 200);
+            assert(pointer_array[i]);
+        }
+        for (u32 i = 0; i < 1024; ++i)
+        {
+            void* const tmp = pointer_array[i];
+            pointer_array[i] = pointer_array[(i * 389) & 1023];
+            pointer_array[(i * 389) & 1023] = tmp;
+        }
+        //  Keep every eighth block, which ends up separating the runs of freed blocks
+        void* kept[128];
+        for (u32 i = 0; i < 128; ++i)
+        {
+            kept[i] = pointer_array[i * 8];
+            pointer_array[i * 8] = NULL;
+        }
+        ill_jfree_batch(allocator, 1024, pointer_array);
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+        ill_jfree_batch(allocator, 128, kept);
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+        for (u32 i = 0; i < 1024; ++i)
+        {
+            pointer_array[i] = NULL;
+        }
+    }
+
+    {
+        //  Block given twice in a batch, or freed again after being merged into the block before it, is a double free
+        u32 double_frees = 0;
+        ill_allocator_set_double_free_callback(allocator, count_double_free, &double_frees);
+        void* const a = ill_alloc(allocator, 64);
+        void* const b = ill_alloc(allocator, 64);
+        void* const c = ill_alloc(allocator, 64);
+        assert(a && b && c);
+        void* batch[4] = {b, a, b, c};
+        ill_jfree_batch(allocator, 4, batch);
+        assert(double_frees == 1);
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+        ill_jfree(allocator, b);
+        assert(double_frees == 2);
+        void* again[2] = {c, a};
+        ill_jfree_batch(allocator, 2, again);
+        assert(double_frees == 4);
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+        ill_allocator_set_double_free_callback(allocator, NULL, NULL);
+    }
+
+    {
+        //  Blocks only grow in place when the memory after them is free
+        unsigned char* const a = ill_alloc(allocator, 100);
+        assert(a);
+        assert(ill_usable_size(allocator, a) >= 100);
+        void* const b = ill_alloc(allocator, 1000);
+        assert(b);
+        void* const c = ill_alloc(allocator, 100);
+        assert(c);
+        memset(a, 0xAB, ill_usable_size(allocator, a));
+        assert(ill_try_expand(allocator, a, 50) == 0);
+        assert(ill_try_expand(allocator, a, 500) == -1);
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+        ill_jfree(allocator, b);
+        assert(ill_try_expand(allocator, a, 500) == 0);
+        assert(ill_usable_size(allocator, a) >= 500);
+        assert(a[99] == 0xAB);
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+        assert(ill_try_expand(allocator, a, 1 << 14) == -1);
+        memset(a, 0xCD, ill_usable_size(allocator, a));
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+        ill_jfree(allocator, c);
+        ill_jfree(allocator, a);
+        assert(ill_usable_size(allocator, NULL) == 0);
+
+        //  Blocks with their own mapping can grow only if the address space after them is free
+        ill_allocator_set_mmap_threshold(allocator, 1 << 17);
+        unsigned char* const m = ill_alloc(allocator, 1 << 17);
+        assert(m);
+        assert(ill_usable_size(allocator, m) >= (1 << 17));
+        if (ill_try_expand(allocator, m, 1 << 18) == 0)
+        {
+            assert(ill_usable_size(allocator, m) >= (1 << 18));
+            memset(m, 0, 1 << 18);
+        }
+        ill_jfree(allocator, m);
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+    }
+
+    {
+        //  Reallocated blocks move down into a free chunk before them, taking the one after them as well if needed
+        void* const a = ill_alloc(allocator, 256);
+        unsigned char* b = ill_alloc(allocator, 256);
+        void* const c = ill_alloc(allocator, 256);
+        unsigned char* const d = ill_alloc(allocator, 256);
+        void* const e = ill_alloc(allocator, 256);
+        void* const f = ill_alloc(allocator, 256);
+        assert(a && b && c && d && e && f);
+        for (u32 i = 0; i < 256; ++i)
+        {
+            b[i] = (unsigned char)i;
+        }
+        ill_jfree(allocator, a);
+        unsigned char* const moved = ill_jrealloc(allocator, b, 400);
+        assert(moved == a);
+        for (u32 i = 0; i < 256; ++i)
+        {
+            assert(moved[i] == (unsigned char)i);
+        }
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+        memset(d, 0xDD, 256);
+        ill_jfree(allocator, c);
+        ill_jfree(allocator, e);
+        //  Chunk after d is not enough on its own, but together with c before it is
+        unsigned char* const grown = ill_jrealloc(allocator, d, 700);
+        assert((uintptr_t)grown < (uintptr_t)d);
+        assert(grown[0] == 0xDD && grown[255] == 0xDD);
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+        ill_jfree(allocator, grown);
+        ill_jfree(allocator, moved);
+        ill_jfree(allocator, f);
+        assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+    }
+
+    ill_allocator_destroy(allocator);
+    allocator = NULL;
+
     return 0;
-}
\ No newline at end of file
+}
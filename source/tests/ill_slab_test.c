@@ -0,0 +1,127 @@
+//
+// Created by jan on 17.10.2026.
+//
+#include "../include/jmem/ill_slab.h"
+#include <assert.h>
+#include <string.h>
+
+typedef uint32_t u32;
+
+static void count_double_free(ill_allocator* allocator, void* param)
+{
+    (void)allocator;
+    *(u32*)param += 1;
+}
+
+int main()
+{
+    static void* pointer_array[4096] = {0};
+    ill_allocator* allocator = ill_allocator_create(1 << 16, 1);
+    assert(allocator);
+
+    ill_slab_cache* cache = ill_slab_cache_create(allocator, 24);
+    assert(cache);
+    assert(ill_slab_cache_verify(cache) == 0);
+
+    for (u32 i = 0; i < 4096; ++i)
+    {
+        pointer_array[i] = ill_slab_alloc(cache);
+        assert(pointer_array[i]);
+        memset(pointer_array[i], (int)i, 24);
+    }
+    assert(ill_slab_cache_verify(cache) == 0);
+    assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+    for (u32 i = 0; i < 4096; ++i)
+    {
+        //  No object was overwritten by another
+        const unsigned char* const bytes = pointer_array[i];
+        for (u32 j = 0; j < 24; ++j)
+        {
+            assert(bytes[j] == (unsigned char)i);
+        }
+    }
+
+    //  Free every other object, then the rest, so slabs go from full to partial to empty
+    for (u32 i = 0; i < 4096; i += 2)
+    {
+        ill_slab_free(cache, pointer_array[i]);
+        pointer_array[i] = NULL;
+    }
+    assert(ill_slab_cache_verify(cache) == 0);
+
+    for (u32 i = 0; i < 4096; i += 2)
+    {
+        pointer_array[i] = ill_slab_alloc(cache);
+        assert(pointer_array[i]);
+    }
+    assert(ill_slab_cache_verify(cache) == 0);
+
+    for (u32 i = 0; i < 4096; ++i)
+    {
+        ill_slab_free(cache, pointer_array[4095 - i]);
+        pointer_array[4095 - i] = NULL;
+        if ((i & 255) == 0)
+        {
+            assert(ill_slab_cache_verify(cache) == 0);
+        }
+    }
+    assert(ill_slab_cache_verify(cache) == 0);
+    assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+    //  Objects larger than a page still get several per slab
+    ill_slab_cache* big_cache = ill_slab_cache_create(allocator, 5000);
+    assert(big_cache);
+    for (u32 i = 0; i < 64; ++i)
+    {
+        pointer_array[i] = ill_slab_alloc(big_cache);
+        assert(pointer_array[i]);
+        memset(pointer_array[i], 0xCC, 5000);
+        //  Interleave with the small cache, so slabs of both share pools
+        pointer_array[64 + i] = ill_slab_alloc(cache);
+        assert(pointer_array[64 + i]);
+    }
+    assert(ill_slab_cache_verify(big_cache) == 0);
+    assert(ill_slab_cache_verify(cache) == 0);
+    for (u32 i = 0; i < 64; ++i)
+    {
+        ill_slab_free(big_cache, pointer_array[(i * 37) & 63]);
+        ill_slab_free(cache, pointer_array[64 + ((i * 37) & 63)]);
+    }
+    assert(ill_slab_cache_verify(big_cache) == 0);
+    assert(ill_slab_cache_verify(cache) == 0);
+
+    //  Objects so large that the slab size would overflow are refused
+    assert(ill_slab_cache_create(allocator, UINT64_MAX) == NULL);
+    assert(ill_slab_cache_create(allocator, UINT64_MAX / 8) == NULL);
+
+    {
+        //  Object freed twice is reported to the parent's callback instead of going on the free list again
+        u32 double_frees = 0;
+        ill_allocator_set_double_free_callback(allocator, count_double_free, &double_frees);
+        void* const a = ill_slab_alloc(big_cache);
+        void* const b = ill_slab_alloc(big_cache);
+        assert(a && b);
+        ill_slab_free(big_cache, a);
+        ill_slab_free(big_cache, a);
+        assert(double_frees == 1);
+        assert(ill_slab_cache_verify(big_cache) == 0);
+        void* const c = ill_slab_alloc(big_cache);
+        void* const d = ill_slab_alloc(big_cache);
+        assert(c == a && d != a);
+        ill_slab_free(big_cache, b);
+        ill_slab_free(big_cache, c);
+        ill_slab_free(big_cache, d);
+        ill_slab_free(big_cache, d);
+        assert(double_frees == 2);
+        assert(ill_slab_cache_verify(big_cache) == 0);
+        ill_allocator_set_double_free_callback(allocator, NULL, NULL);
+    }
+
+    ill_slab_cache_destroy(big_cache);
+    ill_slab_cache_destroy(cache);
+    assert(ill_allocator_verify(allocator, NULL, NULL) == 0);
+    ill_allocator_destroy(allocator);
+
+    return 0;
+}
@@ -160,6 +160,100 @@ int main()
     printf("%lu %lu %lu\n", total_static, total_base, total_comparison);
     printf("malloc time %lu clock ticks\nlin_alloc time %lu clock ticks\n", total_base - total_static, total_comparison - total_static);
 
+    {
+        //  Aligned blocks are freed in reverse order like any others
+        void* const state = lin_allocator_save_state(allocator);
+        void* const small = lin_alloc(allocator, 8);
+        assert(small);
+        void* const aligned = lin_alloc_aligned(allocator, 100, 64);
+        assert(aligned);
+        assert(((uintptr_t)aligned & 63) == 0);
+        void* const grown = lin_jrealloc(allocator, aligned, 1000);
+        assert(grown == aligned);
+        lin_jfree(allocator, aligned);
+        lin_jfree(allocator, small);
+        assert(lin_allocator_save_state(allocator) == state);
+    }
+
     lin_allocator_destroy(allocator);
+
+    {
+        //  Huge page backed allocator is rounded up to whole huge pages
+        allocator = lin_allocator_create_with_flags(1 << 20, LIN_ALLOCATOR_HUGE_PAGES);
+        assert(allocator);
+        u8* const block = lin_alloc(allocator, (1 << 21) - 256);
+        assert(block);
+        memset(block, 0, (1 << 21) - 256);
+        lin_jfree(allocator, block);
+        lin_allocator_destroy(allocator);
+    }
+
+    {
+        //  Reserved allocator may be much larger than the memory actually used
+        allocator = lin_allocator_create_with_flags((u64)1 << 36, LIN_ALLOCATOR_COMMIT_ON_DEMAND);
+        assert(allocator);
+        void* const state = lin_allocator_save_state(allocator);
+        u8* const small = lin_alloc(allocator, 100);
+        assert(small);
+        memset(small, 1, 100);
+        u8* const large = lin_alloc(allocator, 8 << 20);
+        assert(large);
+        memset(large, 2, 8 << 20);
+        u8* const grown = lin_jrealloc(allocator, large, 16 << 20);
+        assert(grown == large);
+        memset(grown, 3, 16 << 20);
+        lin_allocator_set_decommit_watermark(allocator, 1 << 20);
+        lin_jfree(allocator, grown);
+        assert(small[99] == 1);
+        //  Decommitted memory is committed again when it is needed
+        u8* const again = lin_alloc(allocator, 4 << 20);
+        assert(again == large);
+        memset(again, 4, 4 << 20);
+        lin_allocator_restore_current(allocator, state);
+        assert(lin_allocator_save_state(allocator) == state);
+        assert(lin_alloc(allocator, ((u64)1 << 36) + 8) == NULL);
+        lin_allocator_destroy(allocator);
+    }
+
+    {
+        //  Chained allocator links new blocks once it is full, and frees across their boundaries
+        allocator = lin_allocator_create_with_flags(1 << 12, LIN_ALLOCATOR_CHAINED);
+        assert(allocator);
+        void* const state = lin_allocator_save_state(allocator);
+        u64* blocks[64];
+        for (u32 i = 0; i < 64; ++i)
+        {
+            blocks[i] = lin_alloc(allocator, 1000);
+            assert(blocks[i]);
+            blocks[i][0] = i;
+            blocks[i][124] = i;
+        }
+        void* const middle = lin_allocator_save_state(allocator);
+        u8* const aligned = lin_alloc_aligned(allocator, 1 << 16, 4096);
+        assert(aligned);
+        assert(((uintptr_t)aligned & 4095) == 0);
+        memset(aligned, 0, 1 << 16);
+        u8* const grown = lin_jrealloc(allocator, aligned, 1 << 20);
+        assert(grown);
+        assert(grown[(1 << 16) - 1] == 0);
+        memset(grown, 1, 1 << 20);
+        lin_allocator_restore_current(allocator, middle);
+        assert(lin_allocator_save_state(allocator) == middle);
+        for (u32 i = 64; i != 0; --i)
+        {
+            assert(blocks[i - 1][0] == i - 1);
+            assert(blocks[i - 1][124] == i - 1);
+            lin_jfree(allocator, blocks[i - 1]);
+        }
+        assert(lin_allocator_save_state(allocator) == state);
+        //  Blocks are linked again after everything was freed
+        for (u32 i = 0; i < 64; ++i)
+        {
+            blocks[i] = lin_alloc(allocator, 1000);
+            assert(blocks[i]);
+        }
+        lin_allocator_restore_current(allocator, state);
+        lin_allocator_destroy(allocator);
+    }
     return 0;
 }
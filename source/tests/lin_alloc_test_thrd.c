@@ -0,0 +1,127 @@
+//
+// Created by jan on 17.10.2026.
+//
+//  Compares many threads bump allocating from one shared allocator with lin_alloc_atomic against each thread using
+//  its own allocator with lin_alloc.
+#include "../include/jmem/lin_alloc.h"
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+enum {MAX_THREAD_COUNT = 8, ALLOCATION_COUNT = 1 << 18, ALLOCATION_SIZE = 24, ROUNDS = 4};
+
+typedef struct thread_param_struct thread_param;
+struct thread_param_struct
+{
+    lin_allocator* allocator;
+    u64 id;
+    int shared;
+};
+
+static void* test_fn(void* param)
+{
+    const thread_param* const p = param;
+    for (u32 i = 0; i < ALLOCATION_COUNT; ++i)
+    {
+        u64* const ptr = p->shared ? lin_alloc_atomic(p->allocator, ALLOCATION_SIZE) : lin_alloc(p->allocator, ALLOCATION_SIZE);
+        assert(ptr);
+        ptr[0] = p->id;
+        ptr[1] = i;
+        ptr[2] = p->id ^ i;
+    }
+    return NULL;
+}
+
+static double run(lin_allocator** allocators, u32 thread_count, int shared)
+{
+    pthread_t thread_handles[MAX_THREAD_COUNT];
+    thread_param params[MAX_THREAD_COUNT];
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (u32 i = 0; i < thread_count; ++i)
+    {
+        params[i] = (thread_param){.allocator = shared ? allocators[0] : allocators[i], .id = i, .shared = shared};
+        const int create = pthread_create(thread_handles + i, NULL, test_fn, params + i);
+        assert(create == 0);
+    }
+    for (u32 i = 0; i < thread_count; ++i)
+    {
+        const int join = pthread_join(thread_handles[i], NULL);
+        assert(join == 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (double)(end.tv_sec - begin.tv_sec) * 1e3 + (double)(end.tv_nsec - begin.tv_nsec) / 1e6;
+}
+
+int main()
+{
+    lin_allocator* allocators[MAX_THREAD_COUNT];
+    for (u32 i = 0; i < MAX_THREAD_COUNT; ++i)
+    {
+        allocators[i] = lin_allocator_create((u64)ALLOCATION_SIZE * ALLOCATION_COUNT * (i == 0 ? MAX_THREAD_COUNT : 1));
+        assert(allocators[i]);
+    }
+
+    {
+        //  Sizes too large to fit, even ones which would wrap around, fail without moving the allocator
+        const void* const before = lin_allocator_save_state(allocators[0]);
+        assert(lin_alloc_atomic(allocators[0], UINT64_MAX) == NULL);
+        assert(lin_alloc_atomic(allocators[0], UINT64_MAX - 64) == NULL);
+        assert(lin_allocator_save_state(allocators[0]) == before);
+        //  Modes which need more than moving the pointer are refused
+        lin_allocator* const on_demand = lin_allocator_create_with_flags(1 << 20, LIN_ALLOCATOR_COMMIT_ON_DEMAND);
+        assert(on_demand);
+        assert(lin_alloc_atomic(on_demand, ALLOCATION_SIZE) == NULL);
+        lin_allocator_destroy(on_demand);
+        lin_allocator* const chained = lin_allocator_create_with_flags(1 << 20, LIN_ALLOCATOR_CHAINED);
+        assert(chained);
+        assert(lin_alloc_atomic(chained, ALLOCATION_SIZE) == NULL);
+        lin_allocator_destroy(chained);
+    }
+
+    for (u32 thread_count = 1; thread_count <= MAX_THREAD_COUNT; thread_count *= 2)
+    {
+        double total_shared = 0, total_private = 0;
+        for (u32 round = 0; round < ROUNDS; ++round)
+        {
+            total_shared += run(allocators, thread_count, 1);
+            {
+                //  Every allocation must have been handed out exactly once, so no entry was overwritten by another
+                u64 counts[MAX_THREAD_COUNT] = {0};
+                const u64* ptr = lin_allocator_save_state(allocators[0]);
+                lin_allocator_reset(allocators[0]);
+                const u64* const begin = lin_allocator_save_state(allocators[0]);
+                assert((u64)(ptr - begin) == (u64)thread_count * ALLOCATION_COUNT * (ALLOCATION_SIZE / sizeof(u64)));
+                for (const u64* p = begin; p != ptr; p += ALLOCATION_SIZE / sizeof(u64))
+                {
+                    assert(p[0] < thread_count);
+                    assert(p[2] == (p[0] ^ p[1]));
+                    counts[p[0]] += 1;
+                }
+                for (u32 i = 0; i < thread_count; ++i)
+                {
+                    assert(counts[i] == ALLOCATION_COUNT);
+                }
+            }
+
+            total_private += run(allocators, thread_count, 0);
+            for (u32 i = 0; i < thread_count; ++i)
+            {
+                lin_allocator_reset(allocators[i]);
+            }
+        }
+        printf("%u threads: shared allocator with lin_alloc_atomic %g ms, allocator per thread %g ms\n", thread_count,
+               total_shared / ROUNDS, total_private / ROUNDS);
+    }
+
+    for (u32 i = 0; i < MAX_THREAD_COUNT; ++i)
+    {
+        lin_allocator_destroy(allocators[i]);
+    }
+    return 0;
+}
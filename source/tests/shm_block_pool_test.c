@@ -0,0 +1,197 @@
+//
+// Created by jan on 17.10.2026.
+//
+#include "../include/jmem/shm_block_pool.h"
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+enum {BLOCK_SIZE = 24, THREAD_COUNT = 4, PROCESS_COUNT = 2, ITERATION_COUNT = 1 << 16, LIVE_COUNT = 256, PAIR_COUNT = 1 << 20};
+
+typedef struct worker_param_struct worker_param;
+struct worker_param_struct
+{
+    shm_block_pool* pool;
+    u64 id;
+};
+
+static void* worker_fn(void* param)
+{
+    const worker_param* const p = param;
+    u64* live[LIVE_COUNT] = {0};
+    u64 state = p->id + 1;
+    for (u32 i = 0; i < ITERATION_COUNT; ++i)
+    {
+        state = state * 6364136223846793005llu + 1442695040888963407llu;
+        const u32 slot = (u32)(state >> 33) % LIVE_COUNT;
+        if (live[slot])
+        {
+            //  Block must not have been handed out to anyone else while it was held
+            assert(live[slot][0] == p->id && live[slot][1] == slot && live[slot][2] == ~p->id);
+            shm_block_free(p->pool, live[slot]);
+            live[slot] = NULL;
+        }
+        if ((state >> 40) & 1)
+        {
+            live[slot] = shm_block_alloc(p->pool);
+            assert(live[slot]);
+            live[slot][0] = p->id;
+            live[slot][1] = slot;
+            live[slot][2] = ~p->id;
+        }
+    }
+    for (u32 i = 0; i < LIVE_COUNT; ++i)
+    {
+        shm_block_free(p->pool, live[i]);
+    }
+    return NULL;
+}
+
+static double time_pairs(shm_ill_allocator* allocator, shm_block_pool* pool)
+{
+    //  Times pairs of allocating and freeing a block, using the block pool if one is given and the allocator if not
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (u32 i = 0; i < PAIR_COUNT; ++i)
+    {
+        u64* const ptr = pool ? shm_block_alloc(pool) : shm_ill_alloc(allocator, BLOCK_SIZE);
+        assert(ptr);
+        ptr[0] = i;
+        if (pool)
+        {
+            shm_block_free(pool, ptr);
+        }
+        else
+        {
+            shm_ill_jfree(allocator, ptr);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ((double)(end.tv_sec - begin.tv_sec) * 1e9 + (double)(end.tv_nsec - begin.tv_nsec)) / PAIR_COUNT;
+}
+
+int main()
+{
+    static void* pointer_array[4096] = {0};
+    //  Reserved region lets segments added after a fork be seen by every process
+    shm_ill_allocator* allocator = shm_ill_allocator_create_reserved(1 << 16, 1, 0, 1 << 26);
+    assert(allocator);
+
+    //  Block sizes which would overflow, when rounded up or when multiplied into a segment size, are refused
+    assert(shm_block_pool_create(allocator, UINT64_MAX, 0) == NULL);
+    assert(shm_block_pool_create(allocator, UINT64_MAX - 7, 0) == NULL);
+    assert(shm_block_pool_create(allocator, (u64)1 << 60, 0) == NULL);
+    assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+    shm_block_pool* pool = shm_block_pool_create(allocator, BLOCK_SIZE, 0);
+    assert(pool);
+    assert(shm_block_pool_verify(pool) == 0);
+
+    //  First segment is small, so this adds several more
+    for (u32 i = 0; i < 4096; ++i)
+    {
+        pointer_array[i] = shm_block_alloc(pool);
+        assert(pointer_array[i]);
+        memset(pointer_array[i], (int)i, BLOCK_SIZE);
+    }
+    assert(shm_block_pool_verify(pool) == 0);
+    assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+    for (u32 i = 0; i < 4096; ++i)
+    {
+        //  No block was overwritten by another
+        const unsigned char* const bytes = pointer_array[i];
+        for (u32 j = 0; j < BLOCK_SIZE; ++j)
+        {
+            assert(bytes[j] == (unsigned char)i);
+        }
+    }
+
+    for (u32 i = 0; i < 4096; i += 2)
+    {
+        shm_block_free(pool, pointer_array[i]);
+    }
+    assert(shm_block_pool_verify(pool) == 0);
+    //  Freed blocks are reused before any new ones, last freed first
+    for (u32 i = 0; i < 4096; i += 2)
+    {
+        void* const ptr = shm_block_alloc(pool);
+        assert(ptr == pointer_array[4094 - i]);
+    }
+    assert(shm_block_pool_verify(pool) == 0);
+    for (u32 i = 0; i < 4096; ++i)
+    {
+        shm_block_free(pool, pointer_array[i]);
+        pointer_array[i] = NULL;
+    }
+    shm_block_free(pool, NULL);
+    assert(shm_block_pool_verify(pool) == 0);
+    shm_block_pool_destroy(pool);
+    assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+    {
+        //  Threads allocating and freeing at once
+        pool = shm_block_pool_create(allocator, BLOCK_SIZE, 0);
+        assert(pool);
+        pthread_t thread_handles[THREAD_COUNT];
+        worker_param params[THREAD_COUNT];
+        for (u32 i = 0; i < THREAD_COUNT; ++i)
+        {
+            params[i] = (worker_param){.pool = pool, .id = i};
+            const int create = pthread_create(thread_handles + i, NULL, worker_fn, params + i);
+            assert(create == 0);
+        }
+        for (u32 i = 0; i < THREAD_COUNT; ++i)
+        {
+            const int join = pthread_join(thread_handles[i], NULL);
+            assert(join == 0);
+        }
+        assert(shm_block_pool_verify(pool) == 0);
+        shm_block_pool_destroy(pool);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+    }
+
+    {
+        //  Processes allocating and freeing at once, with segments being added after the fork
+        pool = shm_block_pool_create(allocator, BLOCK_SIZE, 0);
+        assert(pool);
+        pid_t pids[PROCESS_COUNT];
+        for (u32 i = 0; i < PROCESS_COUNT; ++i)
+        {
+            pids[i] = fork();
+            assert(pids[i] >= 0);
+            if (pids[i] == 0)
+            {
+                worker_param param = {.pool = pool, .id = THREAD_COUNT + i};
+                worker_fn(&param);
+                _exit(0);
+            }
+        }
+        worker_param param = {.pool = pool, .id = THREAD_COUNT + PROCESS_COUNT};
+        worker_fn(&param);
+        for (u32 i = 0; i < PROCESS_COUNT; ++i)
+        {
+            int status;
+            const pid_t waited = waitpid(pids[i], &status, 0);
+            assert(waited == pids[i] && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+        assert(shm_block_pool_verify(pool) == 0);
+        shm_block_pool_destroy(pool);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+    }
+
+    pool = shm_block_pool_create(allocator, BLOCK_SIZE, 0);
+    assert(pool);
+    printf("alloc/free pair: shm_ill_alloc %g ns, block pool %g ns\n", time_pairs(allocator, NULL),
+           time_pairs(allocator, pool));
+    shm_block_pool_destroy(pool);
+
+    shm_ill_allocator_destroy(allocator);
+    return 0;
+}
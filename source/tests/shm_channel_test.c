@@ -0,0 +1,210 @@
+//
+// Created by jan on 17.10.2026.
+//
+#include "../include/jmem/shm_channel.h"
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+enum
+{
+    BUFFER_SIZE = 1 << 16,
+    BUFFER_COUNT = 1 << 10,
+    PRODUCER_COUNT = 2,
+    CONSUMER_COUNT = 2,
+    MESSAGE_COUNT = 1 << 16,
+    BATCH_SIZE = 32,
+};
+
+typedef struct consumer_param_struct consumer_param;
+struct consumer_param_struct
+{
+    shm_ill_allocator* allocator;
+    shm_channel* channel;
+    u64 received[PRODUCER_COUNT];
+    u64 sum;
+};
+
+static void* consumer_fn(void* param)
+{
+    consumer_param* const p = param;
+    void* ptrs[BATCH_SIZE];
+    u32 count;
+    while ((count = shm_channel_recv_batch(p->channel, BATCH_SIZE, ptrs)) != 0)
+    {
+        for (u32 i = 0; i < count; ++i)
+        {
+            const u64* const message = ptrs[i];
+            assert(message[0] < PRODUCER_COUNT);
+            p->received[message[0]] += 1;
+            p->sum += message[1];
+            shm_ill_jfree(p->allocator, ptrs[i]);
+        }
+    }
+    return NULL;
+}
+
+int main()
+{
+    //  Buffers allocated after the fork must be visible to every process
+    shm_ill_allocator* allocator = shm_ill_allocator_create_reserved(1 << 20, 1, 0, 1 << 28);
+    assert(allocator);
+
+    {
+        //  Values come out in the order they went in, and only as many fit as the capacity allows
+        shm_channel* channel = shm_channel_create(allocator, 5, 0);
+        assert(channel);
+        u64* values[8];
+        for (u32 i = 0; i < 8; ++i)
+        {
+            values[i] = shm_ill_alloc(allocator, sizeof(u64));
+            assert(values[i]);
+            assert(shm_channel_try_send(channel, values[i]) == 0);
+        }
+        assert(shm_channel_try_send(channel, NULL) == -1);
+        void* ptr;
+        for (u32 i = 0; i < 3; ++i)
+        {
+            assert(shm_channel_try_recv(channel, &ptr) == 0);
+            assert(ptr == values[i]);
+        }
+        //  Ring wraps around
+        assert(shm_channel_try_send(channel, NULL) == 0);
+        void* ptrs[16];
+        assert(shm_channel_recv_batch(channel, 16, ptrs) == 6);
+        for (u32 i = 0; i < 5; ++i)
+        {
+            assert(ptrs[i] == values[i + 3]);
+        }
+        assert(ptrs[5] == NULL);
+        assert(shm_channel_try_recv(channel, &ptr) == -1);
+        //  Once closed, whatever is left can still be received, but nothing can be sent
+        assert(shm_channel_try_send(channel, values[0]) == 0);
+        shm_channel_close(channel);
+        assert(shm_channel_send(channel, values[1]) == -1);
+        assert(shm_channel_recv(channel, &ptr) == 0 && ptr == values[0]);
+        assert(shm_channel_recv(channel, &ptr) == -1);
+        assert(shm_channel_recv_batch(channel, 16, ptrs) == 0);
+        for (u32 i = 0; i < 8; ++i)
+        {
+            shm_ill_jfree(allocator, values[i]);
+        }
+        shm_channel_destroy(channel);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+    }
+
+    {
+        //  Producer process hands large buffers to the consumer without copying them. Channel is small, so both sides
+        //  have to wait for each other.
+        shm_channel* channel = shm_channel_create(allocator, 4, SHM_CHANNEL_SINGLE_PRODUCER|SHM_CHANNEL_SINGLE_CONSUMER);
+        assert(channel);
+        struct timespec begin, end;
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        const pid_t pid = fork();
+        assert(pid >= 0);
+        if (pid == 0)
+        {
+            for (u32 i = 0; i < BUFFER_COUNT; ++i)
+            {
+                unsigned char* const buffer = shm_ill_alloc(allocator, BUFFER_SIZE);
+                assert(buffer);
+                memset(buffer, (int)i, BUFFER_SIZE);
+                assert(shm_channel_send(channel, buffer) == 0);
+            }
+            shm_channel_close(channel);
+            _exit(0);
+        }
+        u32 received = 0;
+        void* ptrs[BATCH_SIZE];
+        u32 count;
+        while ((count = shm_channel_recv_batch(channel, BATCH_SIZE, ptrs)) != 0)
+        {
+            for (u32 i = 0; i < count; ++i)
+            {
+                const unsigned char* const buffer = ptrs[i];
+                assert(buffer[0] == (unsigned char)received && buffer[BUFFER_SIZE - 1] == (unsigned char)received);
+                shm_ill_jfree(allocator, ptrs[i]);
+                received += 1;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        assert(received == BUFFER_COUNT);
+        int status;
+        const pid_t waited = waitpid(pid, &status, 0);
+        assert(waited == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        printf("single producer and consumer: %g us per %u byte buffer\n",
+               ((double)(end.tv_sec - begin.tv_sec) * 1e6 + (double)(end.tv_nsec - begin.tv_nsec) / 1e3) / BUFFER_COUNT,
+               BUFFER_SIZE);
+        shm_channel_destroy(channel);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+    }
+
+    {
+        //  Several producer processes and several consumer threads, where every message must arrive exactly once
+        shm_channel* channel = shm_channel_create(allocator, 64, 0);
+        assert(channel);
+        pthread_t thread_handles[CONSUMER_COUNT];
+        consumer_param params[CONSUMER_COUNT];
+        for (u32 i = 0; i < CONSUMER_COUNT; ++i)
+        {
+            params[i] = (consumer_param){.allocator = allocator, .channel = channel};
+            const int create = pthread_create(thread_handles + i, NULL, consumer_fn, params + i);
+            assert(create == 0);
+        }
+        pid_t pids[PRODUCER_COUNT];
+        for (u32 i = 0; i < PRODUCER_COUNT; ++i)
+        {
+            pids[i] = fork();
+            assert(pids[i] >= 0);
+            if (pids[i] == 0)
+            {
+                for (u32 j = 0; j < MESSAGE_COUNT; ++j)
+                {
+                    u64* const message = shm_ill_alloc(allocator, 2 * sizeof(u64));
+                    assert(message);
+                    message[0] = i;
+                    message[1] = j;
+                    assert(shm_channel_send(channel, message) == 0);
+                }
+                _exit(0);
+            }
+        }
+        for (u32 i = 0; i < PRODUCER_COUNT; ++i)
+        {
+            int status;
+            const pid_t waited = waitpid(pids[i], &status, 0);
+            assert(waited == pids[i] && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+        //  Consumers stop once everything sent has been received
+        shm_channel_close(channel);
+        u64 sum = 0;
+        for (u32 i = 0; i < CONSUMER_COUNT; ++i)
+        {
+            const int join = pthread_join(thread_handles[i], NULL);
+            assert(join == 0);
+            sum += params[i].sum;
+        }
+        for (u32 i = 0; i < PRODUCER_COUNT; ++i)
+        {
+            u64 received = 0;
+            for (u32 j = 0; j < CONSUMER_COUNT; ++j)
+            {
+                received += params[j].received[i];
+            }
+            assert(received == MESSAGE_COUNT);
+        }
+        assert(sum == (u64)PRODUCER_COUNT * MESSAGE_COUNT * (MESSAGE_COUNT - 1) / 2);
+        shm_channel_destroy(channel);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+    }
+
+    shm_ill_allocator_destroy(allocator);
+    return 0;
+}
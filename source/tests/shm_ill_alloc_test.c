@@ -4,9 +4,20 @@
 #include "../include/jmem/shm_ill_alloc.h"
 #include <assert.h>
 #include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 
 typedef uint32_t u32;
 
+static void count_double_free(shm_ill_allocator* allocator, void* param)
+{
+    (void)allocator;
+    *(u32*)param += 1;
+}
+
 int main()
 {
     void* pointer_array[1024] = {0};
@@ -30,6 +41,40 @@ int main()
     shm_ill_allocator_destroy(allocator);
     allocator = NULL;
 
+    {
+        //  Counters follow every allocation, reallocation and free
+        allocator = shm_ill_allocator_create(1 << 16, 1);
+        assert(allocator);
+        uint_fast64_t in_use, peak, allocations, frees, reallocations;
+        shm_ill_allocator_counters(allocator, &in_use, &peak, &allocations, &frees, &reallocations);
+        assert(in_use == 0 && peak == 0 && allocations == 0 && frees == 0 && reallocations == 0);
+        for (u32 i = 0; i < 3; ++i)
+        {
+            pointer_array[i] = shm_ill_alloc(allocator, 100);
+            assert(pointer_array[i]);
+        }
+        shm_ill_allocator_counters(allocator, &in_use, &peak, &allocations, NULL, NULL);
+        assert(in_use >= 300 && peak == in_use && allocations == 3);
+        const uint_fast64_t three_blocks = in_use;
+        shm_ill_jfree(allocator, pointer_array[1]);
+        //  First block can not grow in place far enough, so it is moved, which for a moment needs both the old block
+        //  and the new one
+        pointer_array[0] = shm_ill_jrealloc(allocator, pointer_array[0], 1000);
+        assert(pointer_array[0]);
+        shm_ill_allocator_counters(allocator, &in_use, &peak, &allocations, &frees, &reallocations);
+        assert(in_use > three_blocks && peak > in_use && reallocations == 1);
+        assert(allocations == 4 && frees == 2);
+        assert(shm_ill_allocator_verify_incremental(allocator, NULL, NULL) == 0);
+        shm_ill_jfree(allocator, pointer_array[0]);
+        shm_ill_jfree(allocator, pointer_array[2]);
+        const uint_fast64_t old_peak = peak;
+        shm_ill_allocator_counters(allocator, &in_use, &peak, &allocations, &frees, NULL);
+        assert(in_use == 0 && peak == old_peak && allocations == frees);
+        assert(shm_ill_allocator_verify_incremental(allocator, NULL, NULL) == 0);
+        shm_ill_allocator_destroy(allocator);
+        allocator = NULL;
+    }
+
     allocator = shm_ill_allocator_create(64, 1);
     assert(allocator);
     for (u32 i = 0; i < 1024; ++i)
@@ -271,5 +316,429 @@ int main()
     shm_ill_allocator_destroy(allocator);
     allocator = NULL;
 
+    allocator = shm_ill_allocator_create(1 << 16, 1);
+    assert(allocator);
+    assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+    {
+        for (u32 i = 0; i < 256; ++i)
+        {
+            pointer_array[i] = shm_ill_alloc(allocator, 1 + (i * 397) % 1000);
+            assert(pointer_array[i]);
+        }
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        //  Free chunks so that each one is merged with the chunk preceding it, following it, or both
+        for (u32 i = 0; i < 256; i += 4)
+        {
+            shm_ill_jfree(allocator, pointer_array[i]);
+            assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+            shm_ill_jfree(allocator, pointer_array[i + 2]);
+            assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+            shm_ill_jfree(allocator, pointer_array[i + 1]);
+            assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+        }
+        for (u32 i = 0; i < 256; i += 4)
+        {
+            shm_ill_jfree(allocator, pointer_array[i + 3]);
+            assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+        }
+
+        //  Allocate a large block from the merged chunks
+        void* const ptr = shm_ill_alloc(allocator, (1 << 15));
+        assert(ptr);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+        shm_ill_jfree(allocator, ptr);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+    }
+
+    shm_ill_allocator_destroy(allocator);
+    allocator = NULL;
+
+    allocator = shm_ill_allocator_create(1 << 16, 1);
+    assert(allocator);
+
+    {
+        //  Aligned blocks, with their padding carved into free chunks which later allocations can use
+        for (u32 i = 0; i < 256; ++i)
+        {
+            const uint_fast64_t alignment = (uint_fast64_t)16 << (i % 6);
+            pointer_array[i] = (i & 1) ? shm_ill_alloc(allocator, 8 + i) : shm_ill_alloc_aligned(allocator, 8 + i, alignment);
+            assert(pointer_array[i]);
+            assert((i & 1) || ((uintptr_t)pointer_array[i] & (alignment - 1)) == 0);
+            memset(pointer_array[i], 0xCC, 8 + i);
+        }
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        for (u32 i = 0; i < 256; i += 2)
+        {
+            const uint_fast64_t alignment = (uint_fast64_t)16 << (i % 6);
+            void* const ptr = shm_ill_jrealloc_aligned(allocator, pointer_array[i], 600 + i, alignment);
+            assert(ptr);
+            assert(((uintptr_t)ptr & (alignment - 1)) == 0);
+            assert(*(unsigned char*)ptr == 0xCC);
+            pointer_array[i] = ptr;
+        }
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        for (u32 i = 0; i < 256; ++i)
+        {
+            shm_ill_jfree(allocator, pointer_array[i]);
+            pointer_array[i] = NULL;
+        }
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+    }
+
+    shm_ill_allocator_destroy(allocator);
+    allocator = NULL;
+
+    allocator = shm_ill_allocator_create(1 << 16, 1);
+    assert(allocator);
+
+    {
+        //  Pages of empty pools are released, while the pools remain usable
+        for (u32 i = 0; i < 256; ++i)
+        {
+            pointer_array[i] = shm_ill_alloc(allocator, 1000);
+            assert(pointer_array[i]);
+            memset(pointer_array[i], 0xCC, 1000);
+        }
+        for (u32 i = 0; i < 256; ++i)
+        {
+            shm_ill_jfree(allocator, pointer_array[i]);
+            pointer_array[i] = NULL;
+        }
+        assert(shm_ill_allocator_trim(allocator) > 0);
+        assert(shm_ill_allocator_trim(allocator) == 0);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        shm_ill_allocator_set_trim_policy(allocator, 1, 16);
+        for (u32 i = 0; i < 256; ++i)
+        {
+            pointer_array[i] = shm_ill_alloc(allocator, 1000);
+            assert(pointer_array[i]);
+            memset(pointer_array[i], 0xCC, 1000);
+        }
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+        for (u32 i = 0; i < 256; ++i)
+        {
+            shm_ill_jfree(allocator, pointer_array[i]);
+            pointer_array[i] = NULL;
+        }
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+    }
+
+    shm_ill_allocator_destroy(allocator);
+    allocator = NULL;
+
+    allocator = shm_ill_allocator_create_with_flags(1024, 1, SHM_ILL_ALLOCATOR_HUGE_PAGES);
+    assert(allocator);
+
+    {
+        //  Pools backed by huge pages behave like any others
+        for (u32 i = 0; i < 256; ++i)
+        {
+            pointer_array[i] = shm_ill_alloc(allocator, 4000);
+            assert(pointer_array[i]);
+            memset(pointer_array[i], 0xCC, 4000);
+        }
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+        for (u32 i = 0; i < 256; ++i)
+        {
+            shm_ill_jfree(allocator, pointer_array[i]);
+            pointer_array[i] = NULL;
+        }
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+    }
+
+    shm_ill_allocator_destroy(allocator);
+    allocator = NULL;
+
+    allocator = shm_ill_allocator_create(1 << 16, 1);
+    assert(allocator);
+
+    {
+        //  Batches are carved into separate blocks, which can be freed in any order
+        uint_fast64_t sizes[1024];
+        for (u32 i = 0; i < 1024; ++i)
+        {
+            sizes[i] = 1 + (i * 37) % 300;
+        }
+        //  Make one block large enough to get a group of its own
+        sizes[500] = 1 << 15;
+        assert(shm_ill_alloc_batch(allocator, 1024, sizes, pointer_array) == 0);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+        for (u32 i = 0; i < 1024; ++i)
+        {
+            assert(pointer_array[i]);
+            memset(pointer_array[i], (int)(i & 0xFF), sizes[i]);
+        }
+        for (u32 i = 0; i < 1024; ++i)
+        {
+            const unsigned char* const p = pointer_array[i];
+            assert(p[0] == (i & 0xFF) && p[sizes[i] - 1] == (i & 0xFF));
+        }
+        for (u32 i = 0; i < 1024; ++i)
+        {
+            shm_ill_jfree(allocator, pointer_array[(i * 97) & 1023]);
+        }
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+
+        assert(shm_ill_alloc_batch_uniform(allocator, 1024, 48, pointer_array) == 0);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+        for (u32 i = 0; i < 1024; ++i)
+        {
+            assert(pointer_array[i]);
+            memset(pointer_array[i], 0xCC, 48);
+        }
+        for (u32 i = 1024; i != 0; --i)
+        {
+            shm_ill_jfree(allocator, pointer_array[i - 1]);
+            pointer_array[i - 1] = NULL;
+        }
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+    }
+
+    {
+        //  Blocks freed as a batch in any order are merged back into whole pools
+        for (u32 i = 0; i < 1024; ++i)
+        {
+            pointer_array[i] = shm_ill_alloc(allocator, 1 + (i * 13) % 200);
+            assert(pointer_array[i]);
+        }
+        for (u32 i = 0; i < 1024; ++i)
+        {
+            void* const tmp = pointer_array[i];
+            pointer_array[i] = pointer_array[(i * 389) & 1023];
+            pointer_array[(i * 389) & 1023] = tmp;
+        }
+        //  Keep every eighth block, which ends up separating the runs of freed blocks
+        void* kept[128];
+        for (u32 i = 0; i < 128; ++i)
+        {
+            kept[i] = pointer_array[i * 8];
+            pointer_array[i * 8] = NULL;
+        }
+        shm_ill_jfree_batch(allocator, 1024, pointer_array);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+        shm_ill_jfree_batch(allocator, 128, kept);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+        for (u32 i = 0; i < 1024; ++i)
+        {
+            pointer_array[i] = NULL;
+        }
+    }
+
+    {
+        //  Block given twice in a batch, or freed again after being merged into the block before it, is a double free
+        u32 double_frees = 0;
+        shm_ill_allocator_set_double_free_callback(allocator, count_double_free, &double_frees);
+        void* const a = shm_ill_alloc(allocator, 64);
+        void* const b = shm_ill_alloc(allocator, 64);
+        void* const c = shm_ill_alloc(allocator, 64);
+        assert(a && b && c);
+        void* batch[4] = {b, a, b, c};
+        shm_ill_jfree_batch(allocator, 4, batch);
+        assert(double_frees == 1);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+        shm_ill_jfree(allocator, b);
+        assert(double_frees == 2);
+        void* again[2] = {c, a};
+        shm_ill_jfree_batch(allocator, 2, again);
+        assert(double_frees == 4);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+        shm_ill_allocator_set_double_free_callback(allocator, NULL, NULL);
+    }
+
+    {
+        //  Reallocated blocks move down into a free chunk before them, taking the one after them as well if needed
+        void* const a = shm_ill_alloc(allocator, 256);
+        unsigned char* b = shm_ill_alloc(allocator, 256);
+        void* const c = shm_ill_alloc(allocator, 256);
+        unsigned char* const d = shm_ill_alloc(allocator, 256);
+        void* const e = shm_ill_alloc(allocator, 256);
+        void* const f = shm_ill_alloc(allocator, 256);
+        assert(a && b && c && d && e && f);
+        for (u32 i = 0; i < 256; ++i)
+        {
+            b[i] = (unsigned char)i;
+        }
+        shm_ill_jfree(allocator, a);
+        unsigned char* const moved = shm_ill_jrealloc(allocator, b, 400);
+        assert(moved == a);
+        for (u32 i = 0; i < 256; ++i)
+        {
+            assert(moved[i] == (unsigned char)i);
+        }
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+        memset(d, 0xDD, 256);
+        shm_ill_jfree(allocator, c);
+        shm_ill_jfree(allocator, e);
+        //  Chunk after d is not enough on its own, but together with c before it is
+        unsigned char* const grown = shm_ill_jrealloc(allocator, d, 700);
+        assert((uintptr_t)grown < (uintptr_t)d);
+        assert(grown[0] == 0xDD && grown[255] == 0xDD);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+        shm_ill_jfree(allocator, grown);
+        shm_ill_jfree(allocator, moved);
+        shm_ill_jfree(allocator, f);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+    }
+
+    shm_ill_allocator_destroy(allocator);
+    allocator = NULL;
+
+    {
+        //  Pools added by either process after the fork must be visible to both, without any remapping
+        allocator = shm_ill_allocator_create_reserved(1 << 16, 1, 0, 1 << 24);
+        assert(allocator);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+        int to_child[2], to_parent[2];
+        const int pipe_child = pipe(to_child);
+        const int pipe_parent = pipe(to_parent);
+        assert(pipe_child == 0 && pipe_parent == 0);
+        const pid_t pid = fork();
+        assert(pid >= 0);
+        if (pid == 0)
+        {
+            unsigned char* theirs;
+            const ssize_t received = read(to_child[0], &theirs, sizeof(theirs));
+            assert(received == sizeof(theirs));
+            for (u32 i = 0; i < (1 << 17); i += 512)
+            {
+                assert(theirs[i] == 0xA5);
+            }
+            unsigned char* const mine = shm_ill_alloc(allocator, 1 << 17);
+            assert(mine);
+            memset(mine, 0x5A, 1 << 17);
+            shm_ill_jfree(allocator, theirs);
+            assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+            const ssize_t sent = write(to_parent[1], &mine, sizeof(mine));
+            assert(sent == sizeof(mine));
+            _exit(0);
+        }
+        //  Block is too large for the existing pool, so a new one is carved out of the region for it
+        unsigned char* const mine = shm_ill_alloc(allocator, 1 << 17);
+        assert(mine);
+        memset(mine, 0xA5, 1 << 17);
+        const ssize_t sent = write(to_child[1], &mine, sizeof(mine));
+        assert(sent == sizeof(mine));
+        unsigned char* theirs;
+        const ssize_t received = read(to_parent[0], &theirs, sizeof(theirs));
+        assert(received == sizeof(theirs));
+        int status;
+        const pid_t waited = waitpid(pid, &status, 0);
+        assert(waited == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        for (u32 i = 0; i < (1 << 17); i += 512)
+        {
+            assert(theirs[i] == 0x5A);
+        }
+        shm_ill_jfree(allocator, theirs);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+        //  Once the region is used up, allocations fail instead of mapping more memory
+        assert(shm_ill_alloc(allocator, 1 << 24) == NULL);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+        close(to_child[0]);
+        close(to_child[1]);
+        close(to_parent[0]);
+        close(to_parent[1]);
+        shm_ill_allocator_destroy(allocator);
+        allocator = NULL;
+    }
+
+    {
+        //  Pools added by either process after the other attached must be visible to both
+        char name[64];
+        snprintf(name, sizeof(name), "/jmem_shm_ill_alloc_test_%d", (int)getpid());
+        allocator = shm_ill_allocator_create_named(name, 1 << 16, 1, 0, 1 << 28);
+        assert(allocator);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+        //  Callbacks belong to the process which set them, so the attached child does not call this one
+        u32 double_frees = 0;
+        shm_ill_allocator_set_double_free_callback(allocator, count_double_free, &double_frees);
+        int to_child[2], to_parent[2];
+        const int pipe_child = pipe(to_child);
+        const int pipe_parent = pipe(to_parent);
+        assert(pipe_child == 0 && pipe_parent == 0);
+        const pid_t pid = fork();
+        assert(pid >= 0);
+        if (pid == 0)
+        {
+            //  Child attaches by name, like an unrelated process would, while the inherited mapping is still there, so
+            //  the object ends up at a different address, then lets go of the inherited one
+            shm_ill_allocator* const attached = shm_ill_allocator_attach(name);
+            assert(attached && attached != allocator);
+            shm_ill_allocator_detach(allocator);
+            uint_fast64_t offset;
+            const ssize_t received = read(to_child[0], &offset, sizeof(offset));
+            assert(received == sizeof(offset));
+            assert(shm_ill_allocator_refresh(attached) == 0);
+            unsigned char* const theirs = shm_ill_allocator_from_offset(attached, offset);
+            for (u32 i = 0; i < (1 << 17); i += 512)
+            {
+                assert(theirs[i] == 0xA5);
+            }
+            unsigned char* const mine = shm_ill_alloc(attached, 1 << 17);
+            assert(mine);
+            memset(mine, 0x5A, 1 << 17);
+            shm_ill_jfree(attached, theirs);
+            shm_ill_jfree(attached, theirs);
+            assert(double_frees == 0);
+            u32 child_double_frees = 0;
+            shm_ill_allocator_set_double_free_callback(attached, count_double_free, &child_double_frees);
+            shm_ill_jfree(attached, theirs);
+            assert(child_double_frees == 1);
+            assert(shm_ill_allocator_verify(attached, NULL, NULL) == 0);
+            offset = shm_ill_allocator_to_offset(attached, mine);
+            const ssize_t sent = write(to_parent[1], &offset, sizeof(offset));
+            assert(sent == sizeof(offset));
+            shm_ill_allocator_detach(attached);
+            _exit(0);
+        }
+        //  Block is too large for the existing pool, so a new one is added for it
+        unsigned char* const mine = shm_ill_alloc(allocator, 1 << 17);
+        assert(mine);
+        memset(mine, 0xA5, 1 << 17);
+        uint_fast64_t offset = shm_ill_allocator_to_offset(allocator, mine);
+        assert(offset != 0 && shm_ill_allocator_from_offset(allocator, offset) == mine);
+        const ssize_t sent = write(to_child[1], &offset, sizeof(offset));
+        assert(sent == sizeof(offset));
+        const ssize_t received = read(to_parent[0], &offset, sizeof(offset));
+        assert(received == sizeof(offset));
+        int status;
+        const pid_t waited = waitpid(pid, &status, 0);
+        assert(waited == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        assert(shm_ill_allocator_refresh(allocator) == 0);
+        unsigned char* const theirs = shm_ill_allocator_from_offset(allocator, offset);
+        for (u32 i = 0; i < (1 << 17); i += 512)
+        {
+            assert(theirs[i] == 0x5A);
+        }
+        shm_ill_jfree(allocator, theirs);
+        assert(double_frees == 0);
+        shm_ill_jfree(allocator, theirs);
+        assert(double_frees == 1);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+        close(to_child[0]);
+        close(to_child[1]);
+        close(to_parent[0]);
+        close(to_parent[1]);
+        shm_ill_allocator_destroy(allocator);
+        allocator = NULL;
+        //  Object is removed along with the allocator
+        assert(shm_ill_allocator_attach(name) == NULL);
+
+        //  Attaching to an object which is still being created fails, first before it is sized, then before its header
+        //  is written
+        const int fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, 0600);
+        assert(fd >= 0);
+        assert(shm_ill_allocator_attach(name) == NULL);
+        const int truncated = ftruncate(fd, 1 << 16);
+        assert(truncated == 0);
+        assert(shm_ill_allocator_attach(name) == NULL);
+        close(fd);
+        shm_unlink(name);
+    }
+
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,92 @@
+//
+// Created by jan on 17.10.2026.
+//
+//  Compares threads allocating and freeing from one shared allocator, when the whole allocator is guarded by a single
+//  lock and when each of its pools has its own.
+#include "../include/jmem/shm_ill_alloc.h"
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+enum {MAX_THREAD_COUNT = 8, ITERATION_COUNT = 1 << 15, LIVE_COUNT = 64, POOL_SIZE = 1 << 16, POOL_COUNT = 16, ROUNDS = 2};
+
+typedef struct thread_param_struct thread_param;
+struct thread_param_struct
+{
+    shm_ill_allocator* allocator;
+    u64 id;
+};
+
+static void* test_fn(void* param)
+{
+    const thread_param* const p = param;
+    u64* live[LIVE_COUNT] = {0};
+    u64 state = p->id + 1;
+    for (u32 i = 0; i < ITERATION_COUNT; ++i)
+    {
+        state = state * 6364136223846793005llu + 1442695040888963407llu;
+        const u32 slot = (u32)(state >> 33) % LIVE_COUNT;
+        if (live[slot])
+        {
+            //  Block must not have been handed out to anyone else while it was held
+            assert(live[slot][0] == p->id && live[slot][1] == slot);
+            shm_ill_jfree(p->allocator, live[slot]);
+        }
+        const u64 size = 16 + (state >> 40) % 240;
+        live[slot] = shm_ill_alloc(p->allocator, size);
+        assert(live[slot]);
+        live[slot][0] = p->id;
+        live[slot][1] = slot;
+    }
+    for (u32 i = 0; i < LIVE_COUNT; ++i)
+    {
+        shm_ill_jfree(p->allocator, live[i]);
+    }
+    return NULL;
+}
+
+static double run(uint_fast32_t flags, u32 thread_count)
+{
+    shm_ill_allocator* allocator = shm_ill_allocator_create_with_flags(POOL_SIZE, POOL_COUNT, flags);
+    assert(allocator);
+    pthread_t thread_handles[MAX_THREAD_COUNT];
+    thread_param params[MAX_THREAD_COUNT];
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (u32 i = 0; i < thread_count; ++i)
+    {
+        params[i] = (thread_param){.allocator = allocator, .id = i};
+        const int create = pthread_create(thread_handles + i, NULL, test_fn, params + i);
+        assert(create == 0);
+    }
+    for (u32 i = 0; i < thread_count; ++i)
+    {
+        const int join = pthread_join(thread_handles[i], NULL);
+        assert(join == 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+    shm_ill_allocator_destroy(allocator);
+    return (double)(end.tv_sec - begin.tv_sec) * 1e3 + (double)(end.tv_nsec - begin.tv_nsec) / 1e6;
+}
+
+int main()
+{
+    for (u32 thread_count = 1; thread_count <= MAX_THREAD_COUNT; thread_count *= 2)
+    {
+        double total_global = 0, total_pool = 0;
+        for (u32 round = 0; round < ROUNDS; ++round)
+        {
+            total_global += run(0, thread_count);
+            total_pool += run(SHM_ILL_ALLOCATOR_POOL_LOCKS, thread_count);
+        }
+        printf("%u threads: allocator lock %g ms, pool locks %g ms\n", thread_count, total_global / ROUNDS,
+               total_pool / ROUNDS);
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+//
+// Created by jan on 17.10.2026.
+//
+//  Measures the cost of the allocator's locks, by timing pairs of allocations and frees made by a single thread, where
+//  the lock is never contended, and by several threads at once, where it is.
+#include "../include/jmem/shm_ill_alloc.h"
+#include <assert.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+enum {PAIR_COUNT = 1 << 18, CONTENDED_THREAD_COUNT = 4, ALLOCATION_SIZE = 64};
+
+static void* test_fn(void* param)
+{
+    shm_ill_allocator* const allocator = param;
+    for (u32 i = 0; i < PAIR_COUNT / CONTENDED_THREAD_COUNT; ++i)
+    {
+        u64* const ptr = shm_ill_alloc(allocator, ALLOCATION_SIZE);
+        assert(ptr);
+        ptr[0] = i;
+        shm_ill_jfree(allocator, ptr);
+    }
+    return NULL;
+}
+
+static double run(uint_fast32_t flags, u32 thread_count)
+{
+    shm_ill_allocator* allocator = shm_ill_allocator_create_with_flags(1 << 16, 4, flags);
+    assert(allocator);
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    if (thread_count == 1)
+    {
+        for (u32 i = 0; i < PAIR_COUNT; ++i)
+        {
+            u64* const ptr = shm_ill_alloc(allocator, ALLOCATION_SIZE);
+            assert(ptr);
+            ptr[0] = i;
+            shm_ill_jfree(allocator, ptr);
+        }
+    }
+    else
+    {
+        pthread_t thread_handles[CONTENDED_THREAD_COUNT];
+        for (u32 i = 0; i < thread_count; ++i)
+        {
+            const int create = pthread_create(thread_handles + i, NULL, test_fn, allocator);
+            assert(create == 0);
+        }
+        for (u32 i = 0; i < thread_count; ++i)
+        {
+            const int join = pthread_join(thread_handles[i], NULL);
+            assert(join == 0);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+    shm_ill_allocator_destroy(allocator);
+    return ((double)(end.tv_sec - begin.tv_sec) * 1e9 + (double)(end.tv_nsec - begin.tv_nsec)) / PAIR_COUNT;
+}
+
+int main()
+{
+    printf("uncontended: allocator lock %g ns per alloc/free pair, pool locks %g ns per pair\n", run(0, 1),
+           run(SHM_ILL_ALLOCATOR_POOL_LOCKS, 1));
+    printf("%u threads: allocator lock %g ns per alloc/free pair, pool locks %g ns per pair\n", CONTENDED_THREAD_COUNT,
+           run(0, CONTENDED_THREAD_COUNT), run(SHM_ILL_ALLOCATOR_POOL_LOCKS, CONTENDED_THREAD_COUNT));
+    return 0;
+}
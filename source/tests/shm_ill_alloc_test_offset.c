@@ -0,0 +1,87 @@
+//
+// Created by jan on 17.10.2026.
+//
+//  Measures the cost of keeping allocator metadata as offsets rather than pointers, by timing a mix of allocations and
+//  frees of random sizes, once holding live blocks as plain pointers and once holding them as offsets, like a structure
+//  shared between processes would.
+#include "../include/jmem/shm_ill_alloc.h"
+#include <assert.h>
+#include <stdio.h>
+#include <time.h>
+
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+enum {OPERATION_COUNT = 1 << 19, LIVE_COUNT = 1024, MAX_ALLOCATION_SIZE = 1024};
+
+static double run_pointers(void)
+{
+    shm_ill_allocator* allocator = shm_ill_allocator_create(1 << 20, 1);
+    assert(allocator);
+    static u64* live[LIVE_COUNT];
+    u64 state = 1;
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (u32 i = 0; i < OPERATION_COUNT; ++i)
+    {
+        state = state * 6364136223846793005llu + 1442695040888963407llu;
+        const u32 slot = (u32)(state >> 33) % LIVE_COUNT;
+        if (live[slot])
+        {
+            assert(live[slot][0] == slot);
+            shm_ill_jfree(allocator, live[slot]);
+        }
+        live[slot] = shm_ill_alloc(allocator, 8 + (state >> 40) % MAX_ALLOCATION_SIZE);
+        assert(live[slot]);
+        live[slot][0] = slot;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    for (u32 i = 0; i < LIVE_COUNT; ++i)
+    {
+        shm_ill_jfree(allocator, live[i]);
+        live[i] = NULL;
+    }
+    assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+    shm_ill_allocator_destroy(allocator);
+    return ((double)(end.tv_sec - begin.tv_sec) * 1e9 + (double)(end.tv_nsec - begin.tv_nsec)) / OPERATION_COUNT;
+}
+
+static double run_offsets(void)
+{
+    shm_ill_allocator* allocator = shm_ill_allocator_create(1 << 20, 1);
+    assert(allocator);
+    static uint_fast64_t live[LIVE_COUNT];
+    u64 state = 1;
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (u32 i = 0; i < OPERATION_COUNT; ++i)
+    {
+        state = state * 6364136223846793005llu + 1442695040888963407llu;
+        const u32 slot = (u32)(state >> 33) % LIVE_COUNT;
+        u64* ptr = shm_ill_allocator_from_offset(allocator, live[slot]);
+        if (ptr)
+        {
+            assert(ptr[0] == slot);
+            shm_ill_jfree(allocator, ptr);
+        }
+        ptr = shm_ill_alloc(allocator, 8 + (state >> 40) % MAX_ALLOCATION_SIZE);
+        assert(ptr);
+        ptr[0] = slot;
+        live[slot] = shm_ill_allocator_to_offset(allocator, ptr);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    for (u32 i = 0; i < LIVE_COUNT; ++i)
+    {
+        shm_ill_jfree(allocator, shm_ill_allocator_from_offset(allocator, live[i]));
+        live[i] = 0;
+    }
+    assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+    shm_ill_allocator_destroy(allocator);
+    return ((double)(end.tv_sec - begin.tv_sec) * 1e9 + (double)(end.tv_nsec - begin.tv_nsec)) / OPERATION_COUNT;
+}
+
+int main()
+{
+    printf("pointers: %g ns per operation, offsets: %g ns per operation\n", run_pointers(), run_offsets());
+    return 0;
+}
@@ -6,9 +6,55 @@
 #include <string.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <sys/wait.h>
 
 typedef uint32_t u32;
 
+static int MONITOR_STOP = 0;
+
+static void count_double_free(shm_ill_allocator* allocator, void* param)
+{
+    (void)allocator;
+    atomic_fetch_add((u32*)param, 1);
+}
+
+static void* free_fn(void* param)
+{
+    void** const args = param;
+    shm_ill_jfree(args[0], args[1]);
+    return NULL;
+}
+
+static void* monitor_fn(void* param)
+{
+    //  Checks the allocator while others keep using it, the way a health check thread would
+    shm_ill_allocator* const allocator = param;
+    u32 checks = 0;
+    while (!atomic_load(&MONITOR_STOP) || checks == 0)
+    {
+        assert(shm_ill_allocator_verify_incremental(allocator, NULL, NULL) == 0);
+        uint_fast64_t in_use, allocations, frees;
+        shm_ill_allocator_counters(allocator, &in_use, NULL, &allocations, &frees, NULL);
+        (void)in_use;
+        (void)allocations;
+        (void)frees;
+        checks += 1;
+    }
+    return NULL;
+}
+
+static void check_counters_balanced(shm_ill_allocator* allocator)
+{
+    //  Every thread freed all it allocated
+    uint_fast64_t in_use, peak, allocations, frees, reallocations;
+    shm_ill_allocator_counters(allocator, &in_use, &peak, &allocations, &frees, &reallocations);
+    assert(in_use == 0);
+    assert(peak > 0);
+    assert(allocations > 0 && allocations == frees);
+    assert(reallocations > 0);
+}
+
 static void* test_fn(void* param)
 {
     shm_ill_allocator* const allocator = param;
@@ -77,6 +123,14 @@ static void* test_fn(void* param)
     return 0;
 }
 
+static void* cached_test_fn(void* param)
+{
+    shm_ill_allocator* const allocator = param;
+    void* ret = test_fn(param);
+    shm_ill_allocator_thread_flush(allocator);
+    return ret;
+}
+
 int main()
 {
     void* pointer_array[1024] = {0};
@@ -149,6 +203,9 @@ int main()
     assert(allocator);
     enum {THREAD_COUNT = 8};
     pthread_t thread_handles[THREAD_COUNT];
+    pthread_t monitor_handle;
+    int create_monitor = pthread_create(&monitor_handle, NULL, monitor_fn, allocator);
+    assert(create_monitor == 0);
     for (unsigned i = 0; i < THREAD_COUNT; ++i)
     {
         const int create = pthread_create(thread_handles + i, NULL, test_fn, allocator);
@@ -160,6 +217,151 @@ int main()
         const int join = pthread_join(thread_handles[i], NULL);
         assert(join == 0);
     }
+    atomic_store(&MONITOR_STOP, 1);
+    int join_monitor = pthread_join(monitor_handle, NULL);
+    assert(join_monitor == 0);
+    check_counters_balanced(allocator);
+
+    shm_ill_allocator_destroy(allocator);
+    allocator = NULL;
+
+    //  Same again, but with each pool locked on its own, which should leave the heap just as consistent. Allocator is
+    //  also checked by a monitor thread the whole time.
+    allocator = shm_ill_allocator_create_with_flags(1 << 16, 4, SHM_ILL_ALLOCATOR_POOL_LOCKS);
+    assert(allocator);
+    atomic_store(&MONITOR_STOP, 0);
+    create_monitor = pthread_create(&monitor_handle, NULL, monitor_fn, allocator);
+    assert(create_monitor == 0);
+    for (unsigned i = 0; i < THREAD_COUNT; ++i)
+    {
+        const int create = pthread_create(thread_handles + i, NULL, test_fn, allocator);
+        assert(create == 0);
+    }
+
+    for (unsigned i = 0; i < THREAD_COUNT; ++i)
+    {
+        const int join = pthread_join(thread_handles[i], NULL);
+        assert(join == 0);
+    }
+    atomic_store(&MONITOR_STOP, 1);
+    join_monitor = pthread_join(monitor_handle, NULL);
+    assert(join_monitor == 0);
+    assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+    check_counters_balanced(allocator);
+
+    shm_ill_allocator_destroy(allocator);
+    allocator = NULL;
+
+    allocator = shm_ill_allocator_create_with_flags(1024, 32, SHM_ILL_ALLOCATOR_THREAD_CACHE);
+    assert(allocator);
+    for (unsigned i = 0; i < THREAD_COUNT; ++i)
+    {
+        const int create = pthread_create(thread_handles + i, NULL, cached_test_fn, allocator);
+        assert(create == 0);
+    }
+
+    for (unsigned i = 0; i < THREAD_COUNT; ++i)
+    {
+        const int join = pthread_join(thread_handles[i], NULL);
+        assert(join == 0);
+    }
+    assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+    //  Caches were flushed, so nothing is left in use
+    check_counters_balanced(allocator);
+
+    {
+        //  Freed small blocks are handed straight back by the calling thread's cache
+        void* p1 = shm_ill_alloc(allocator, 40);
+        assert(p1);
+        shm_ill_jfree(allocator, p1);
+        void* p2 = shm_ill_alloc(allocator, 40);
+        assert(p2 == p1);
+        for (u32 i = 0; i < 256; ++i)
+        {
+            pointer_array[i] = shm_ill_alloc(allocator, 1 + (i * 7) % 500);
+            assert(pointer_array[i]);
+            memset(pointer_array[i], 0xCC, 1 + (i * 7) % 500);
+        }
+        for (u32 i = 0; i < 256; ++i)
+        {
+            shm_ill_jfree(allocator, pointer_array[i]);
+        }
+        shm_ill_jfree(allocator, p2);
+        shm_ill_allocator_thread_flush(allocator);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+    }
+
+    {
+        //  Freeing a block which is already cached is a double free, whichever thread does it, and the block is still
+        //  only handed out once
+        u32 double_frees = 0;
+        shm_ill_allocator_set_double_free_callback(allocator, count_double_free, &double_frees);
+        void* const p1 = shm_ill_alloc(allocator, 40);
+        assert(p1);
+        shm_ill_jfree(allocator, p1);
+        shm_ill_jfree(allocator, p1);
+        assert(double_frees == 1);
+        void* args[2] = {allocator, p1};
+        pthread_t handle;
+        const int create = pthread_create(&handle, NULL, free_fn, args);
+        assert(create == 0);
+        const int join = pthread_join(handle, NULL);
+        assert(join == 0);
+        assert(double_frees == 2);
+        void* batch[1] = {p1};
+        shm_ill_jfree_batch(allocator, 1, batch);
+        assert(double_frees == 3);
+        void* const p2 = shm_ill_alloc(allocator, 40);
+        void* const p3 = shm_ill_alloc(allocator, 40);
+        assert(p2 == p1 && p3 && p3 != p1);
+        //  Blocks handed out again carry no trace of having been cached
+        shm_ill_jfree(allocator, p2);
+        shm_ill_jfree(allocator, p3);
+        assert(double_frees == 3);
+        shm_ill_allocator_set_double_free_callback(allocator, NULL, NULL);
+        shm_ill_allocator_thread_flush(allocator);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+        check_counters_balanced(allocator);
+    }
+
+    {
+        //  Child must not hand out blocks which are still cached by the parent. Block for passing the child's pointer
+        //  back is too large to be cached.
+        uintptr_t* const shared = shm_ill_alloc(allocator, 1024);
+        assert(shared);
+        void* p1 = shm_ill_alloc(allocator, 40);
+        assert(p1);
+        const pid_t pid = fork();
+        assert(pid >= 0);
+        if (pid == 0)
+        {
+            void* const ptr = shm_ill_alloc(allocator, 40);
+            assert(ptr);
+            *shared = (uintptr_t)ptr;
+            shm_ill_allocator_thread_flush(allocator);
+            _exit(0);
+        }
+        int status;
+        const pid_t waited = waitpid(pid, &status, 0);
+        assert(waited == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        for (u32 i = 0; i < 16; ++i)
+        {
+            pointer_array[i] = shm_ill_alloc(allocator, 40);
+            assert(pointer_array[i]);
+            assert((uintptr_t)pointer_array[i] != *shared);
+        }
+        for (u32 i = 0; i < 16; ++i)
+        {
+            shm_ill_jfree(allocator, pointer_array[i]);
+        }
+        //  Block the child allocated is still used
+        shm_ill_jfree(allocator, (void*)*shared);
+        shm_ill_jfree(allocator, p1);
+        shm_ill_jfree(allocator, shared);
+        shm_ill_allocator_thread_flush(allocator);
+        assert(shm_ill_allocator_verify(allocator, NULL, NULL) == 0);
+        check_counters_balanced(allocator);
+    }
 
     shm_ill_allocator_destroy(allocator);
     allocator = NULL;